@@ -37,10 +37,15 @@ extern "C" {
  * <talker>
  * cap_ptp_ns : 64 bit PTP time of data capture (what avtp_ns is constructed from)
  * send_ptp_ns: 64 bit PTP time for when packet has been handed off to sendto()
+ * tx_ns: time the frame was handed to the NIC if Tx timestamps are
+ *        collected (see log_tx_ts()), otherwise launch time/send_ptp_ns
+ * sched_ns: time the frame entered the qdisc (0 unless Tx timestamps are collected)
+ * tx_hw: 1 if tx_ns is a raw hardware (PHC) timestamp, 0 if software (CLOCK_REALTIME)
  *
  * <listener>
  * rx_ns: 64bit timestamp when packet received (preferrably with HW ts)
  * recv_ptp_ns: 64 bit PTP timestamp when frame has entered application via recvmsg()
+ * rx_hw: 1 if rx_ns is a raw hardware (PHC) timestamp, 0 if software fallback (CLOCK_REALTIME)
  *
  */
 struct logc;
@@ -95,6 +100,53 @@ void log_tx(struct logc *logc,
 	uint64_t send_ptp_ns,
 	uint64_t tx_ns);
 
+/**
+ * log_tx_ts: fill in Tx timestamps of a frame already logged with log_tx()
+ *
+ * Tx timestamps arrive asynchronously on the socket's error queue. The
+ * most recent Tx entry for stream_id and seqnr (within the last 1024
+ * entries) is updated, nothing is added to the log. A software stamp
+ * never replaces a hardware stamp.
+ *
+ * The time spent in the qdisc (ETF/CBS) is tx_ns - sched_ns when both
+ * are software stamps.
+ *
+ * @param logc: log container
+ * @param sid: stream_id (host order)
+ * @param seqnr: avtp seqnr of frame
+ * @param sched_ns: time frame entered qdisc, 0 if not part of this report
+ * @param tx_ns: time frame was handed to NIC, 0 if not part of this report
+ * @param tx_hw: tx_ns is a raw hardware timestamp
+ */
+void log_tx_ts(struct logc *logc,
+	uint64_t sid,
+	uint8_t seqnr,
+	uint64_t sched_ns,
+	uint64_t tx_ns,
+	bool tx_hw);
+
+/**
+ * log_txtime_err: log a frame dropped by ETF
+ *
+ * Written to a separate CSV file (<logfile>_e-<n>) with stream_id,
+ * seqnr, txtime_ns, late_ns and code, where code is
+ * SO_EE_CODE_TXTIME_INVALID_PARAM (1) or SO_EE_CODE_TXTIME_MISSED (2).
+ * Only the first 65536 drops between flushes are kept.
+ *
+ * @param logc: log container
+ * @param sid: stream_id (host order)
+ * @param seqnr: avtp seqnr of frame
+ * @param txtime_ns: requested launch time
+ * @param late_ns: time from launch time until the drop was seen
+ * @param code: reason for drop
+ */
+void log_txtime_err(struct logc *logc,
+	uint64_t sid,
+	uint8_t seqnr,
+	uint64_t txtime_ns,
+	uint64_t late_ns,
+	uint8_t code);
+
 /**
  * log_rx: log Rx entries to a CSV log (if enabled)
  *
@@ -103,18 +155,21 @@ void log_tx(struct logc *logc,
  * - size of payload
  * - seqnr
  * - presentation_time (avtp_time)
- * - Rx timestamp from network subsystem (SO_TIMESTAMPNS)
+ * - Rx timestamp from network subsystem (SO_TIMESTAMPING, hardware if available)
  * - Timestamp retrieved from the PTP clock on the active NIC upon return from recvmsg()
+ * - Whether the Rx timestamp came from the NIC or the software fallback
  *
  * @param logc: log container
  * @param du: received data packet
  * @param rx_ns: timestamp from network layer upon recv of msg
  * @param recv_ptp_ns: timestamp from NIC upon return from recvmsg()
+ * @param rx_hw: rx_ns is a raw hardware timestamp
  */
 void log_rx(struct logc *logc,
 	struct avtpdu_cshdr *du,
 	uint64_t rx_ns,
-	uint64_t recv_ptp_ns);
+	uint64_t recv_ptp_ns,
+	bool rx_hw);
 
 /**
  * log_wakeup_delay: log timestamps for wakeup delay (clock_nanosleep)
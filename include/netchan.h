@@ -32,10 +32,13 @@ extern "C" {
 #include <pthread.h>
 
 #include <ptp_getclock.h>
+#include <netchan_ring.h>
+#include <netchan_lv.h>
 
 #include <linux/if_packet.h>	/* sk_addr */
 #include <linux/net_tstamp.h>	/* sock_txtime */
 #include <stdarg.h>
+#include <sys/uio.h>		/* iovec */
 
 
 enum stream_class {
@@ -113,6 +116,17 @@ struct channel_attrs
 	 * It expects a callback
 	 */
 	char name[32];
+
+	/* Rx only: what to discard when the reader falls behind and the
+	 * ring is full. Defaults to NC_DROP_NEWEST.
+	 */
+	enum nc_overflow_policy overflow;
+
+	/* Rx only: last-value channel (lvchan), only keep the most
+	 * recent sample, read with chan_read_latest() instead of
+	 * chan_read().
+	 */
+	bool last_value;
 };
 
 /* Rename experimental type to NETCHAN subtype for now */
@@ -156,6 +170,31 @@ struct avtpdu_cshdr {
 
 
 
+/**
+ * ring_meta - metadata stored alongside each received sample
+ *
+ * Every slot in a Rx channel's ring starts with this header, followed by
+ * the payload. Slots are cacheline aligned and the header is padded to
+ * 8 bytes, so a borrowed payload (chan_read_borrow()) is naturally
+ * aligned for 64 bit values.
+ *
+ * @ts_rx_ns: Rx timestamp of frame. PHC time when the NIC stamps in
+ *	      hardware (ts_rx_hw), otherwise the kernel's software timestamp
+ *	      (CLOCK_REALTIME). AF_XDP has no per-frame stamp, the time the
+ *	      batch was picked up is used. 0 if fed without timestamp.
+ * @ts_recv_ptp_ns: PTP time when the frame was picked up by nethandler
+ * @avtp_timestamp: avtp_timestamp from the AVTPDU (lower 32 bit of capture time)
+ * @ts_rx_hw: ts_rx_ns is a hardware (PHC) timestamp
+ * @payload: payload, channel's payload_size bytes
+ */
+struct ring_meta {
+	uint64_t ts_rx_ns;
+	uint64_t ts_recv_ptp_ns;
+	uint32_t avtp_timestamp;
+	bool ts_rx_hw;
+	uint8_t payload[0] __attribute__((aligned(8)));
+};
+
 /**
  * channel send operations
  *
@@ -163,6 +202,48 @@ struct avtpdu_cshdr {
  *
  */
 struct channel;
+
+/*
+ * nc_tx_budget - what a CBS channel does with a frame sent ahead of its
+ * reserved bandwidth (interval_ns), see chan_set_tx_budget()
+ *
+ * @NC_BUDGET_OFF: count the frame and send it anyway (default)
+ * @NC_BUDGET_BLOCK: wait until the frame fits the budget, then send
+ * @NC_BUDGET_DROP: discard the frame, the send returns -EAGAIN
+ */
+enum nc_tx_budget {
+	NC_BUDGET_OFF = 0,
+	NC_BUDGET_BLOCK,
+	NC_BUDGET_DROP,
+};
+
+/*
+ * chan_tx_budget_stats - over-budget sends on a CBS channel
+ *
+ * @over_budget: sends ahead of the budget, whatever the policy
+ * @blocked: sends delayed (NC_BUDGET_BLOCK), blocked_ns in total
+ * @dropped: frames discarded (NC_BUDGET_DROP)
+ */
+struct chan_tx_budget_stats {
+	uint64_t over_budget;
+	uint64_t blocked;
+	uint64_t blocked_ns;
+	uint64_t dropped;
+};
+
+/*
+ * chan_sample - one sample for chan_send_schedule()
+ *
+ * @tx_ns: launch time (TAI), 0 for the next free Tx slot
+ * @ts: capture timestamp, as for chan_update()
+ * @data: payload (channel's payload_size)
+ */
+struct chan_sample {
+	uint64_t tx_ns;
+	uint64_t ts;
+	void *data;
+};
+
 struct chan_send_ops {
 	/**
 	 * send_at : send current payload of netchan data at specified timestamp (if applicable)
@@ -182,9 +263,10 @@ struct chan_send_ops {
 	/**
 	 * send_now: update and send data *now*
 	 *
-	 * Provided the Tx budget is not exhausted, the data will be sent
-	 * immideately. Note that based on the expected interval (i.e. CBS
-	 * bandwidth), the function will block until the budget is available.
+	 * The data will be sent immideately. A CBS channel with
+	 * NC_BUDGET_BLOCK (see chan_set_tx_budget()) will first block until
+	 * the budget for the expected interval (i.e. CBS bandwidth) is
+	 * available.
 	 *
 	 * Use the function chan_time_to_tx() to determine elibility to transmit.
 	 *
@@ -208,6 +290,41 @@ struct chan_send_ops {
 	 * @return 0 on success, negative on error
 	 */
 	int (*send_now_wait)(struct channel *ch, void *data);
+
+	/**
+	 * send_schedule - queue future samples with their launch times
+	 *
+	 * Only available for channels where the kernel holds frames until
+	 * their launch time (TAS with ETF), NULL otherwise.
+	 *
+	 * @param chan: active channel
+	 * @param samples: samples in launch time order
+	 * @param n: number of samples
+	 *
+	 * @return number of samples queued, negative on error
+	 */
+	int (*send_schedule)(struct channel *ch, const struct chan_sample *samples, int n);
+};
+
+/**
+ * nc_tx_ring - memory-mapped TPACKET_V2 Tx ring (PACKET_TX_RING)
+ *
+ * Every slot carries a prebuilt Ethernet + 802.1Q header for the
+ * channel, so a send only copies the AVTPDU after it and hands the
+ * slot to the kernel.
+ *
+ * @map: start of mmap()'ed ring (NULL if the channel has no Tx ring)
+ * @map_sz: total size of the mapping
+ * @frame_sz: size of each slot (incl. tpacket2_hdr)
+ * @frame_nr: number of slots
+ * @cur: next slot to use
+ */
+struct nc_tx_ring {
+	void *map;
+	size_t map_sz;
+	unsigned int frame_sz;
+	unsigned int frame_nr;
+	unsigned int cur;
 };
 
 /**
@@ -220,6 +337,11 @@ struct chan_send_ops {
  * @payload_size: num bytes for the payload
  * @payload: grows at the end of the struct
  */
+struct nc_pace;
+
+/* Max number of caller buffers in chan_update_iov() */
+#define CHAN_IOV_MAX 16
+
 struct channel
 {
 	struct nethandler *nh;
@@ -228,6 +350,9 @@ struct channel
 	struct sockaddr_ll sk_addr;
 	uint8_t dst[ETH_ALEN];
 
+	/* Rx only: joined dst multicast group on the Rx socket */
+	bool mc_member;
+
 	/* Guardian mutex of internal state.
 	 */
 	pthread_mutex_t guard;
@@ -288,6 +413,15 @@ struct channel
 	int tx_sock_prio;
 	bool use_so_txtime;
 
+	/* Index of tx_sock in the io_uring fixed file table, -1 if unused */
+	int uring_idx;
+
+	/* Raw frame Tx ring on tx_sock, see nh_set_tx_ring() */
+	struct nc_tx_ring tx_ring;
+
+	/* Mailbox and next slot when sent by the pacer, see chan_pace() */
+	struct nc_pace *pace;
+
 	/* Send-ops, depending on the selected Tx stream class (TAS or CBS)
 	 */
 	struct chan_send_ops *ops;
@@ -295,13 +429,29 @@ struct channel
 	/* private area for callback, embed directly i not struct to
 	 * ease memory management. */
 	struct cb_priv *cbp;
-	int fd_w;
-	int fd_r;
+
+	/* Rx only: samples handed from the Rx thread to the reader */
+	struct nc_ring *ring;
+
+	/* Slot held by the reader between chan_read_borrow() and
+	 * chan_read_release() */
+	struct ring_meta *rx_slot;
+
+	/* Rx only, lvchan: latest sample, replaces the ring. lv_gen is
+	 * the generation last returned by chan_read_latest() */
+	struct nc_lv *lv;
+	uint64_t lv_gen;
 
 	/* payload size */
 	uint16_t payload_size;
 	uint16_t full_size;
 
+	/* Tx only: payload is in the caller's buffers, not in payload[],
+	 * until the next update, see chan_update_iov()
+	 */
+	int tx_iovcnt;
+	struct iovec tx_iov[CHAN_IOV_MAX];
+
 	/*
 	 * To enforce the channel frequency, keep track of next time
 	 * this channel is eligble to transmit.
@@ -329,6 +479,13 @@ struct channel
 	uint64_t next_tx_ns;
 	struct sock_txtime txtime;
 
+	/* CBS only: what to do with a frame ahead of next_tx_ns, see
+	 * chan_set_tx_budget().
+	 */
+	enum nc_tx_budget tx_budget;
+	uint32_t tx_burst;
+	struct chan_tx_budget_stats budget;
+
 	/* time of current sample
 	 *
 	 * This is used to derinve avtp_timestamp and will signal eitehr
@@ -345,11 +502,83 @@ struct channel
 	unsigned char payload[0];
 };
 
+/**
+ * nc_rx_ring - memory-mapped TPACKET_V3 Rx ring (PACKET_RX_RING)
+ *
+ * The kernel fills blocks of frames directly into memory shared with
+ * userspace. A block is handed over once it is full or its retire
+ * timeout expires, and the Rx thread then walks all frames in the block
+ * without any further syscalls.
+ *
+ * @map: start of mmap()'ed ring
+ * @map_sz: total size of the mapping
+ * @block_sz: size of each block (multiple of PAGE_SIZE)
+ * @block_nr: number of blocks in ring
+ * @frame_sz: upper bound of a single frame (incl. tpacket3_hdr)
+ * @cur: next block to inspect
+ */
+struct nc_rx_ring {
+	void *map;
+	size_t map_sz;
+	unsigned int block_sz;
+	unsigned int block_nr;
+	unsigned int frame_sz;
+	unsigned int cur;
+};
+
+/**
+ * nh_fanout_key - how frames are split between the Rx fanout workers
+ *
+ * @NH_FANOUT_SID: by stream class of the registered Rx channel
+ * @NH_FANOUT_PCP: by PCP in the 802.1Q tag, using the class priorities
+ *                 from SRP (untagged frames go to the class B worker)
+ */
+enum nh_fanout_key {
+	NH_FANOUT_SID = 0,
+	NH_FANOUT_PCP
+};
+
+/* Max number of frames read from each socket per nh_poll() */
+#define NH_POLL_BUDGET	64
+
+/* One Rx fanout worker per stream class: TAS, class A, class B */
+#define NH_RX_WORKERS	3
+
+/**
+ * nh_rx_worker - Rx thread with its own socket in the fanout group
+ *
+ * @nh: owning nethandler
+ * @sock: Rx socket, member of the PACKET_FANOUT group
+ * @ring: TPACKET_V3 ring on sock, if nh->use_rx_ring
+ * @tid: worker thread
+ * @sched_prio: SCHED_FIFO priority, 0 to use the default policy
+ * @cpu: CPU to pin the thread to, -1 to not pin
+ * @frames: number of AVTP frames handled by this worker
+ * @spins: number of times the socket was polled
+ * @idle: number of polls that returned no frames
+ */
+struct nh_rx_worker {
+	struct nethandler *nh;
+	int sock;
+	struct nc_rx_ring ring;
+	pthread_t tid;
+	int sched_prio;
+	int cpu;
+	uint64_t frames;
+	uint64_t spins;
+	uint64_t idle;
+};
+
 /* netchan_srp_client needs ref to stream_id_wrapper and channel, so
  * incluide after these structs.
  */
 #include <netchan_srp_client.h>
 
+struct nc_xdp;
+struct nc_uring;
+struct nc_txts;
+struct nc_pacer;
+
 struct nethandler {
 	struct channel *du_tx_head;
 	struct channel *du_tx_tail;
@@ -377,13 +606,101 @@ struct nethandler {
 	int rx_sock;
 	unsigned int link_speed;
 
+	/* eBPF Rx filter shared by rx_sock and the fanout workers, one
+	 * map entry per registered StreamID. -1 when the kernel refused
+	 * the program, the classic filter is then rebuilt instead, see
+	 * nc_set_rx_filter().
+	 */
+	int rx_flt_prog;
+	int rx_flt_map;
+
 	const char ifname[IFNAMSIZ];
 	bool is_lo;
 	int ifidx;
+
+	/* NIC stamps all incoming frames with PHC time, otherwise
+	 * software timestamps are used for Rx */
+	bool rx_hwts;
+
+	/* Rx socket holds a promiscuous membership (default), see
+	 * nh_set_promisc() */
+	bool promisc;
 	char mac[6];
 	bool running;
 	pthread_t tid;
 
+	/* Set while the Rx thread should keep running. Cleared (without
+	 * touching running) when the Rx thread must be restarted after
+	 * changing the Rx backend.
+	 */
+	bool rx_active;
+
+	/* Optional TPACKET_V3 ring attached to rx_sock, see nh_set_rx_ring() */
+	bool use_rx_ring;
+	struct nc_rx_ring rx_ring;
+
+	/* New Tx channels send prebuilt frames via a TPACKET_V2 ring,
+	 * optionally bypassing the Qdiscs, see nh_set_tx_ring()
+	 */
+	bool use_tx_ring;
+	bool tx_qdisc_bypass;
+
+	/* Busy-poll Rx, see nh_set_rx_busy_poll(). rx_spins and
+	 * rx_idle count polls and empty polls by the Rx thread.
+	 * rx_busy_cpu is where the Rx thread runs while busy-polling
+	 * (-1 to stay on rx_cpu).
+	 */
+	bool rx_busy_poll;
+	int rx_busy_cpu;
+	uint64_t rx_spins;
+	uint64_t rx_idle;
+
+	/* Placement of the Rx and SRP threads, see nh_set_rx_affinity(),
+	 * nh_set_rx_sched(), nh_set_srp_sched() and nh_set_numa().
+	 *
+	 * A cpu of -1 means not pinned, a sched_prio of 0 means
+	 * SCHED_OTHER. numa_node is the node the NIC is attached to (-1
+	 * if unknown), with use_numa, threads that are not pinned are
+	 * kept on the CPUs local to the NIC and Rx buffers are allocated
+	 * on its node.
+	 */
+	int rx_cpu;
+	int rx_sched_prio;
+	int srp_cpu;
+	int srp_sched_prio;
+	int numa_node;
+	bool use_numa;
+
+	/* No Rx thread, the caller receives with nh_poll(). poll_fd is an
+	 * epoll fd for all Rx sockets, see nh_get_fd().
+	 */
+	bool poll_mode;
+	int poll_fd;
+
+	/* Optional PACKET_FANOUT group of Rx workers, one per stream
+	 * class, see nh_set_rx_fanout(). When used, rx_sock is only
+	 * kept for control (ioctl, memberships) and receives nothing.
+	 */
+	bool use_rx_fanout;
+	enum nh_fanout_key fanout_key;
+	int fanout_id;
+	struct nh_rx_worker rxw[NH_RX_WORKERS];
+
+	/* Optional AF_XDP socket (Rx and Tx), see nh_enable_xdp() */
+	struct nc_xdp *xdp;
+
+	/* Optional io_uring backend (Rx and Tx), see nh_enable_io_uring() */
+	struct nc_uring *uring;
+
+	/* Optional error queue collector for Tx sockets, see
+	 * nh_enable_txtime_stats() and nh_enable_tx_timestamps()
+	 */
+	struct nc_txts *txts;
+	bool tx_timestamps;
+
+	/* Optional Tx pacing thread, see nh_enable_pacer() */
+	struct nc_pacer *pacer;
+
 	/*
 	 * A nethandler handles the SRP connection
 	 *
@@ -412,6 +729,27 @@ struct nethandler {
 	 */
 	int ptp_fd;
 
+	/* PHC - CLOCK_TAI, refreshed at most once a second by
+	 * nh_wait_until() so that waits do not read the PHC.
+	 */
+	int64_t ptp_tai_offset_ns;
+	uint64_t ptp_tai_offset_ts;
+
+	/* nh_wait_until() sleeps until wait_margin_ns before target and
+	 * spins the rest, the margin follows the observed sleep overshoot
+	 */
+	uint64_t wait_margin_ns;
+	uint64_t wait_overshoot_ns;
+
+	/* TAS launch guard, minimum time from sendmsg() to txtime. Seeded
+	 * at create, adapted from send latency (tas_send_ns, EWMA) and
+	 * TXTIME errors, see nh_get_tx_guard().
+	 */
+	uint64_t tas_launch_ns;
+	uint64_t tas_send_ns;
+	uint32_t tas_clean_sends;
+	bool tx_guard_fixed;
+
 	/* reference to cpu_dma_latency, once opened and set to 0,
 	 * computer /should/ refrain from entering high cstates
 	 *
@@ -431,17 +769,93 @@ struct nethandler {
 	 */
 	struct logc *logger;
 
-	/* hashmap, chan_id -> cb_entity  */
+	/* Rx dispatch table, stream_id -> cb_entity
+	 *
+	 * hmap_sz is the max number of streams, the table itself is
+	 * a power of 2 number of buckets (hmap_mask+1), see
+	 * nh_reg_callback().
+	 *
+	 * Buckets only hold StreamIDs, the callback for slot i of
+	 * bucket b is hm_ent[b * NH_BUCKET_SLOTS + i].
+	 *
+	 * While at most 8 streams are registered, they are also kept
+	 * in hm_small (one of the two hm_small_buf, NULL otherwise) and
+	 * looked up without hashing.
+	 *
+	 * hmap, hm_ent and hm_small_buf live in one mapping of
+	 * hmap_map_sz bytes.
+	 */
 	size_t hmap_sz;
-	struct cb_entity *hmap;
+	size_t hmap_cnt;
+	uint32_t hmap_mask;
+	struct nh_bucket *hmap;
+	struct cb_entity *hm_ent;
+	struct nh_small *hm_small;
+	struct nh_small *hm_small_buf;
+	uint32_t hm_small_idx;
+	size_t hmap_map_sz;
+
+	/* Rx dispatch grace period: a frame is handed to its callback
+	 * with rx_readers[rx_epoch & 1] raised. Removing an entry flips
+	 * the epoch and waits for the previous readers to finish, see
+	 * nh_unreg_callback().
+	 */
+	uint32_t rx_epoch;
+	uint32_t rx_readers[2];
 };
 
 /* socket helpers
  */
 int nc_create_rx_sock(const char *ifname);
+int nc_set_rx_filter(int sock, const uint64_t *sids, int n);
+int nc_rx_filter_create(int max_sids, int *map_fd);
+int nc_rx_filter_attach(int sock, int prog_fd);
+int nc_rx_filter_add(int map_fd, uint64_t sid);
+int nc_rx_filter_del(int map_fd, uint64_t sid);
+bool nc_enable_rx_hwts(int sock, const char *ifname);
+struct msghdr;
+uint64_t nc_get_rx_ts(struct msghdr *msg, bool *hw);
+int nc_set_busy_poll(int sock, int usec);
+int nc_join_rx_fanout(int sock, int *fanout_id);
+int nc_set_fanout_sid(int sock, const uint64_t *sids, const uint8_t *worker, int n, uint8_t def);
+int nc_set_fanout_pcp(int sock, const uint8_t pcp_worker[8], uint8_t def);
+bool nc_setup_rx_ring(int sock, struct nc_rx_ring *ring);
+void nc_teardown_rx_ring(int sock, struct nc_rx_ring *ring);
 bool nc_create_tas_tx_sock(struct channel *ch);
 bool nc_create_cbs_tx_sock(struct channel *ch);
+/* PCP of stream class and SRP VID (0, i.e. priority tag, without SRP) */
+uint16_t nc_chan_vlan_tci(struct channel *ch);
+bool nc_setup_tx_ring(struct channel *ch, bool qdisc_bypass);
+void nc_teardown_tx_ring(struct channel *ch);
+int nc_create_group_tx_sock(struct nethandler *nh, bool tas);
+struct chan_group;
+int nc_group_send(struct chan_group *grp, uint64_t *tx_ns);
 int nc_handle_sock_err(int sock, int ptp_fd);
+/* Report SO_EE_ORIGIN_TXTIME error, 1 if reported, 0 if not TXTIME, -1 unknown code */
+struct sock_extended_err;
+int nc_report_txtime_err(struct sock_extended_err *serr, int ptp_fd);
+/* Feedback to TAS launch guard: time spent sending, deadline missed */
+void nc_tx_guard_sent(struct nethandler *nh, uint64_t send_ns);
+void nc_tx_guard_missed(struct nethandler *nh, uint64_t late_ns);
+/* AVTPDU of channel as header + payload, or header + the caller's
+ * buffers after chan_update_iov(). iov must have room for
+ * 1 + CHAN_IOV_MAX entries, returns the number used.
+ */
+int nc_chan_pdu_iov(struct channel *ch, struct iovec *iov);
+/* As nh_wait_until(), but target is CLOCK_TAI (launch times, tai_get_ns()) */
+int64_t nc_wait_tai(struct nethandler *nh, uint64_t tai_target_ns);
+
+/* Raw bpf(2) helpers, shared by the eBPF Rx filter and AF_XDP */
+union bpf_attr;
+int nc_bpf(int cmd, union bpf_attr *attr);
+int nc_bpf_map_create(int type, int key_sz, int val_sz, int entries);
+int nc_bpf_map_update(int map_fd, void *key, void *val);
+int nc_bpf_map_delete(int map_fd, void *key);
+#define NC_INSN(c, d, s, o, i) \
+	((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define NC_LD_MAP_FD(d, fd)						\
+	NC_INSN(BPF_LD | BPF_DW | BPF_IMM, (d), BPF_PSEUDO_MAP_FD, 0, (fd)), \
+	NC_INSN(0, 0, 0, 0, 0)
 
 #define ARRAY_SIZE(x) (x != NULL ? sizeof(x) / sizeof(x[0]) : -1)
 
@@ -455,6 +869,8 @@ const struct channel_attrs * nc_get_chan_ref(char *name, const struct channel_at
 
 /**
  * @deprecated
+ *
+ * @returns 0 on success, -1 on error. Data must be read with chan_read().
  */
 int nc_rx_create(char *name, struct channel_attrs *attrs, int arr_size);
 
@@ -573,12 +989,35 @@ bool chan_valid(struct channel *ch);
  *
  * @param ch: channel to update
  * @param ts: capture/presentation timestamp
- * @param data: data to copy into payload (size is fixed from chan_create())
+ * @param data: data to copy into payload (size is fixed from chan_create()),
+ *              not copied if it is chan_get_payload()
  *
  * @returns 0 on success, errno on failure.
  */
 int chan_update(struct channel *ch, uint64_t ts, void *data);
 
+/**
+ * chan_update_iov : update channel with payload in the caller's buffers
+ *
+ * As chan_update(), but the payload is not copied into the channel.
+ * The frame is sent as the AVTP header from the channel followed by the
+ * buffers, gathered by the kernel (or copied once into the Tx ring,
+ * io_uring slot or XSK frame). A payload assembled from several regions
+ * no longer needs a temporary buffer.
+ *
+ * The buffers are referenced until the next update of the channel and
+ * must stay valid (and unchanged) until then.
+ *
+ * @param ch: Tx channel to update
+ * @param ts: capture/presentation timestamp
+ * @param iov: payload buffers, in order
+ * @param iovcnt: number of buffers, at most CHAN_IOV_MAX
+ *
+ * @returns 0 on success, -EINVAL if the buffers do not add up to the
+ *          channel's payload size.
+ */
+int chan_update_iov(struct channel *ch, uint64_t ts, const struct iovec *iov, int iovcnt);
+
 /**
  * chan_dump_state: Dump internal state about channel and nethandler
  *
@@ -593,13 +1032,12 @@ void chan_dump_state(struct channel *ch);
 /**
  * wait_for_tx_slot(): Sleep until Tx is ready
  *
- * To help align clocks, do a clock_nanosleep() until the next tx-slot has arrived
+ * To help align clocks, wait (nh_wait_until()) until the next tx-slot has arrived
  *
- * Note: The ETC Qdisc scheduler prohibits tx-time too close to actual
- * time, so the client must be woken up a bit prior to this. This
- * function will therefore wait for approx 100us before the next period
- * slot. If the client runs with periods < 100us or a tighter deadline
- * is needed, the client should handle its own blocking.
+ * Note: The ETF Qdisc scheduler prohibits tx-time too close to actual
+ * time, so the client must be woken up a bit prior to this. For TAS
+ * channels, this function returns the launch guard (see
+ * nh_get_tx_guard()) before the next period slot.
  *
  * For CBS, a better approach is periodic timer (pt_init / pt_next_cycle)
  *
@@ -611,6 +1049,10 @@ int wait_for_tx_slot(struct channel *ch);
 /**
  * chan_get_payload : Return a pointer to the most recent payload in the channel
  *
+ * For Tx channels, the payload can be written in place and then sent
+ * without copying: chan_update() and chan_send_now() skip the copy when
+ * data is the pointer returned here.
+ *
  * @param pdu AVTP dataunit
  * @returns pointer to payload
  */
@@ -620,17 +1062,82 @@ void * chan_get_payload(struct channel *);
 /**
  * chan_dleay() delay a channel for the specified number of ns
  *
- * FIXME: we are slowly moving towards a situation where we expect
- *	  phc2sys to synchronize the system clock, so this function
- *	  should be ripe for simplification.
+ * Same as nh_wait_until() on the channel's nethandler.
  *
  * @param ptp_target_delay_ns: absolute timestamp for PTP time to delay to
  * @param du: data-unit for netchan internals (need access to PTP fd)
  *
- * @returns: the delay error (in ns)
+ * @returns: the delay error (in ns), negative if late
  */
 int64_t chan_delay(struct channel *du, uint64_t ptp_target_delay_ns);
 
+/*
+ * nh_tx_guard - margins used for a stream class
+ *
+ * launch_ns: minimum time from the frame is handed to the kernel until
+ *            its launch time (SCM_TXTIME), 0 for CBS classes (sent
+ *            immediately).
+ * wakeup_ns: how early nh_wait_until() wakes up before a target (and
+ *            spins the rest).
+ *
+ * wait_for_tx_slot() returns launch_ns before the slot, the sleep ends
+ * wakeup_ns before that.
+ */
+struct nh_tx_guard {
+	uint64_t launch_ns;
+	uint64_t wakeup_ns;
+};
+
+/**
+ * nh_get_tx_guard() get current guard margins for a stream class
+ *
+ * Both margins start from conservative defaults when the nethandler is
+ * created and are adapted while running:
+ * - wakeup_ns follows the overshoot of every sleep in nh_wait_until()
+ * - launch_ns follows the time TAS sends spend in sendmsg(), and is
+ *   raised on every missed or invalid txtime reported by ETF (requires
+ *   nh_enable_txtime_stats()). Without drops, it slowly decays towards
+ *   twice the send time.
+ *
+ * @param nh: nethandler container
+ * @param sc: stream class
+ * @param guard: current margins (out)
+ * @returns: 0 on success, -EINVAL on error
+ */
+int nh_get_tx_guard(struct nethandler *nh, enum stream_class sc, struct nh_tx_guard *guard);
+
+/**
+ * nh_set_tx_guard() fix guard margins, disabling calibration
+ *
+ * launch_ns applies to TAS, wakeup_ns to all classes.
+ *
+ * @param nh: nethandler container
+ * @param guard: margins to use, NULL to go back to adaptive margins
+ * @returns: true on success
+ */
+bool nh_set_tx_guard(struct nethandler *nh, const struct nh_tx_guard *guard);
+
+/**
+ * nh_wait_until() wait until an absolute PTP time
+ *
+ * The target is converted to CLOCK_TAI (the PHC-TAI offset is read at
+ * most once a second, we expect phc2sys to keep the two in sync). The
+ * caller sleeps (clock_nanosleep()) until a margin before the target
+ * and then spins on CLOCK_TAI (vDSO, no syscall) until the target is
+ * reached. The margin is calibrated from the overshoot of previous
+ * sleeps, within [5, 500] us.
+ *
+ * The outcome is written to the wakeup-delay log (ptp target, TAI
+ * target, TAI wakeup), nothing is printed.
+ *
+ * @param nh: nethandler container
+ * @param ptp_target_ns: absolute PTP time to wait for
+ *
+ * @returns: target - actual wakeup (ns), negative if late (e.g. target
+ *           already passed)
+ */
+int64_t nh_wait_until(struct nethandler *nh, uint64_t ptp_target_ns);
+
 /**
  * Simpel wrappers to channel-ops, soon to be @deprecated
  *
@@ -640,6 +1147,237 @@ int chan_send(struct channel *ch, uint64_t *tx_ns);
 int chan_send_now(struct channel *ch, void *data);
 int chan_send_now_wait(struct channel *ch, void *data);
 
+/**
+ * chan_send_iov : update channel from the caller's buffers and send
+ *
+ * chan_update_iov() followed by chan_send().
+ *
+ * @param ch: Tx channel
+ * @param ts: capture/presentation timestamp
+ * @param iov: payload buffers, in order
+ * @param iovcnt: number of buffers, at most CHAN_IOV_MAX
+ * @param tx_ns: requested/actual Tx time, as for chan_send() (optional)
+ *
+ * @returns payload bytes sent, negative on error
+ */
+int chan_send_iov(struct channel *ch, uint64_t ts, const struct iovec *iov, int iovcnt,
+		uint64_t *tx_ns);
+
+/**
+ * chan_send_schedule : hand future samples of a TAS channel to ETF in one call
+ *
+ * Each sample is sent with its own SCM_TXTIME and held by the ETF
+ * qdisc until its launch time. A producer of precomputed data (e.g. a
+ * motion profile) can then wake up once per batch instead of once per
+ * period.
+ *
+ * A sample with tx_ns = 0 goes in the next free Tx slot of the
+ * channel. An explicit tx_ns must not be earlier than the next free
+ * slot (the channel's reserved bandwidth) nor closer than the launch
+ * guard (see nh_get_tx_guard()), the schedule stops at such a sample.
+ * next_tx_ns is moved past the last sample queued.
+ *
+ * The call never blocks: samples are queued until the socket (or Tx
+ * ring) runs out of room, so the number of samples queued may be less
+ * than n and the rest must be retried later (-EAGAIN if none fit).
+ * With batched io_uring, the samples are submitted before returning.
+ *
+ * Not available for CBS channels or with AF_XDP (-EOPNOTSUPP).
+ *
+ * @param ch: TAS channel
+ * @param samples: samples in launch time order
+ * @param n: number of samples
+ *
+ * @returns number of samples queued, negative errno if none were queued.
+ */
+int chan_send_schedule(struct channel *ch, const struct chan_sample *samples, int n);
+
+/**
+ * chan_pace : let the nethandler's pacer send the channel
+ *
+ * Instead of keeping the cadence in the talker thread (chan_send_now(),
+ * wait_for_tx_slot()), the application posts samples to a mailbox
+ * (chan_post()) and the pacer thread (nh_enable_pacer()) sends the
+ * newest sample at every Tx slot (interval_ns) of the channel. TAS
+ * channels are sent with the slot as launch time, CBS channels when
+ * the slot arrives.
+ *
+ * Nothing is sent before the first post. A slot without a new sample
+ * resends the previous one. The channel must not be sent from the
+ * application while paced. Pacing stops when the channel is destroyed.
+ *
+ * @param ch: Tx channel
+ *
+ * @returns 0 on success, -EINVAL if ch is not a Tx channel or the pacer
+ *          is not enabled, -EEXIST if already paced.
+ */
+int chan_pace(struct channel *ch);
+
+/**
+ * chan_post : replace the sample waiting for the channel's next slot
+ *
+ * Never blocks on the pacer, newest value wins. Must not be called
+ * from more than one thread at a time for the same channel.
+ *
+ * @param ch: paced channel
+ * @param ts: capture timestamp, as for chan_update()
+ * @param data: payload (channel's payload_size)
+ *
+ * @returns 0 on success, -EINVAL if the channel is not paced.
+ */
+int chan_post(struct channel *ch, uint64_t ts, const void *data);
+
+/*
+ * chan_pace_stats - Tx slots of a paced channel
+ *
+ * @sent: frames sent by the pacer
+ * @coalesced: samples replaced in the mailbox before they were sent
+ * @duplicates: slots without a new sample, previous sample sent again
+ * @late: slots skipped, the pacer was too late to meet them
+ */
+struct chan_pace_stats {
+	uint64_t sent;
+	uint64_t coalesced;
+	uint64_t duplicates;
+	uint64_t late;
+};
+
+/**
+ * chan_get_pace_stats : get pacing counters of a channel
+ *
+ * @param ch: paced channel
+ * @param stats: copy of current counters (out)
+ *
+ * @returns 0 on success, -EINVAL if the channel is not paced.
+ */
+int chan_get_pace_stats(struct channel *ch, struct chan_pace_stats *stats);
+
+/*
+ * chan_group - Tx channels updated and sent together
+ *
+ * Members are ordered with all TAS channels first ([0, nr_tas)), the
+ * rest are CBS. Each class is sent through one group socket with a
+ * single sendmmsg(), the members' own sockets are not used.
+ */
+struct mmsghdr;
+struct iovec;
+struct chan_group {
+	struct nethandler *nh;
+	int nr;
+	int nr_tas;
+	struct channel **ch;
+
+	/* Index of each member in the caller's array (for data) */
+	int *order;
+
+	int tas_sock;
+	int cbs_sock;
+
+	/* Preallocated for nc_group_send(), control holds one SCM_TXTIME
+	 * per TAS member, iov 1 + CHAN_IOV_MAX entries per member.
+	 */
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	uint8_t *control;
+	uint64_t *txtime;
+};
+
+/**
+ * chan_group_create : group Tx channels sharing the same period
+ *
+ * For talkers with many channels that are sent in the same cycle. All
+ * members are updated with chan_group_update() and sent with
+ * chan_group_send_at(), which costs one sendmmsg() per stream class
+ * (TAS, CBS) instead of one syscall per channel.
+ *
+ * The channels are still owned by the caller and must outlive the
+ * group. A channel can be member of several groups and still be sent
+ * on its own.
+ *
+ * @param nh: nethandler all channels belong to
+ * @param ch: array of Tx channels
+ * @param nr: number of channels in ch
+ *
+ * @returns new group or NULL on error (invalid or Rx channel, AF_XDP)
+ */
+struct chan_group * chan_group_create(struct nethandler *nh, struct channel **ch, int nr);
+
+/**
+ * chan_group_destroy : close group sockets and free group
+ *
+ * The member channels are left untouched.
+ *
+ * @param grp: indirect ref to group (caller's ref will be NULL'd)
+ */
+void chan_group_destroy(struct chan_group **grp);
+
+/**
+ * chan_group_update : chan_update() all members of the group
+ *
+ * @param grp: channel group
+ * @param ts: capture/presentation timestamp (common for all members)
+ * @param data: one payload per member, same order as in
+ *              chan_group_create() (not the internal TAS-first order)
+ *
+ * @returns 0 on success, negative errno on failure.
+ */
+int chan_group_update(struct chan_group *grp, uint64_t ts, void **data);
+
+/**
+ * chan_group_send_at : send current payload of all members
+ *
+ * TAS members get their own SCM_TXTIME as computed by chan_send() (the
+ * next free slot of each channel, or tx_ns if set and valid). CBS
+ * members are sent immediately, there is no launch time below CBS.
+ * They are held to their Tx budget (chan_set_tx_budget()) as for a
+ * single send, except that NC_BUDGET_BLOCK drops as well, the group
+ * does not wait for one member. Dropped members are not counted.
+ *
+ * With io_uring enabled (nh_enable_io_uring()), all members are queued
+ * on the ring and submitted with a single io_uring_enter().
+ *
+ * @param grp: channel group
+ * @param tx_ns: requested launch time for TAS members (optional)
+ *
+ * @returns number of frames sent, negative errno on failure.
+ */
+int chan_group_send_at(struct chan_group *grp, uint64_t *tx_ns);
+
+/*
+ * chan_txtime_stats - frames dropped by ETF for a Tx stream
+ *
+ * Collected from the error queue of the Tx socket(s), see
+ * nh_enable_txtime_stats(). Lateness is the time from the requested
+ * launch time until the error was picked up from the error queue, i.e.
+ * an upper bound.
+ *
+ * hist[0] counts drops less than 1 us late, hist[i] drops [2^(i-1),
+ * 2^i) us late. The last bin also holds everything later than that.
+ */
+#define CHAN_TXTIME_HIST_BINS 16
+struct chan_txtime_stats {
+	/* txtime passed before the frame was dequeued */
+	uint64_t missed;
+	/* txtime rejected on enqueue (in the past, or wrong clock) */
+	uint64_t invalid;
+	uint64_t max_late_ns;
+	uint64_t hist[CHAN_TXTIME_HIST_BINS];
+};
+
+/**
+ * chan_get_txtime_stats : get TXTIME errors reported for Tx channel
+ *
+ * Counts are per stream_id, frames sent through a channel group are
+ * included.
+ *
+ * @param ch: Tx channel
+ * @param stats: copy of current counters (out)
+ *
+ * @returns 0 on success, -EINVAL if ch is not a Tx channel or
+ *          nh_enable_txtime_stats() has not been called.
+ */
+int chan_get_txtime_stats(struct channel *ch, struct chan_txtime_stats *stats);
+
 /**
  * chan_time_to_tx : ns left until a new frame can be sent.
  *
@@ -652,6 +1390,46 @@ int chan_send_now_wait(struct channel *ch, void *data);
  */
 uint64_t chan_time_to_tx(struct channel *ch);
 
+/**
+ * chan_set_tx_budget : enforce the reserved bandwidth of a CBS channel
+ *
+ * The SRP reservation (and the CBS idleSlope) is one frame every
+ * interval_ns. A talker sending more often than that steals
+ * bandwidth from every other stream in the same CBS queue. CBS
+ * channels follow the same next_tx_ns as TAS channels, as a token
+ * bucket: burst frames can be sent back to back, after that one frame
+ * per interval_ns. A slack of interval_ns/8 absorbs wakeup jitter of a
+ * periodic talker.
+ *
+ * A send ahead of the budget is always counted. By default
+ * (NC_BUDGET_OFF) it is sent anyway, otherwise it blocks or is dropped.
+ * A dropped frame does not use up a sequence number. A talker that
+ * only cares about the newest value should use the pacer (chan_pace(),
+ * chan_post()) which sends it in the next slot.
+ *
+ * A paced channel never blocks, the pacer would stall every other
+ * channel. NC_BUDGET_BLOCK acts as NC_BUDGET_DROP and the newest sample
+ * goes out in the next slot.
+ *
+ * @param ch: CBS Tx channel
+ * @param policy: what to do with a frame ahead of the budget
+ * @param burst: frames that may be sent back to back (0 is the same as 1)
+ *
+ * @returns 0 on success, -EINVAL if ch is not a CBS Tx channel or the
+ *          policy is unknown.
+ */
+int chan_set_tx_budget(struct channel *ch, enum nc_tx_budget policy, uint32_t burst);
+
+/**
+ * chan_get_tx_budget_stats : get over-budget counters of a CBS channel
+ *
+ * @param ch: CBS Tx channel
+ * @param stats: copy of current counters (out)
+ *
+ * @returns 0 on success, -EINVAL if ch is not a CBS Tx channel
+ */
+int chan_get_tx_budget_stats(struct channel *ch, struct chan_tx_budget_stats *stats);
+
 /**
  * chan_read : read data from incoming channel.
  *
@@ -676,6 +1454,115 @@ int chan_read(struct channel *ch, void *data);
  */
 int chan_read_wait(struct channel *ch, void *data);
 
+/**
+ * chan_read_borrow : borrow oldest sample in incoming channel without copying it
+ *
+ * Blocks like chan_read() until a sample is available. The returned
+ * pointer refers to the payload in a library-owned slot and stays valid
+ * until chan_read_release() is called. Until then, the same sample is
+ * returned by repeated calls to chan_read_borrow().
+ *
+ * Note: while a slot is borrowed, it cannot be reused for new samples. A
+ * reader that holds on to a slot for too long will cause incoming
+ * samples to be dropped, regardless of overflow policy.
+ *
+ * @param ch: channel
+ * @param meta: optional, set to timestamps for the sample
+ *
+ * @return const pointer to payload (payload_size bytes) or NULL on error
+ */
+const void * chan_read_borrow(struct channel *ch, const struct ring_meta **meta);
+
+/**
+ * chan_read_release : release sample returned by chan_read_borrow()
+ *
+ * The payload pointer (and meta) must not be used after this call.
+ *
+ * @param ch: channel
+ *
+ * @return 0 on success, -EINVAL if no sample was borrowed
+ */
+int chan_read_release(struct channel *ch);
+
+/**
+ * chan_read_latest : get most recent sample from a last-value channel
+ *
+ * Never blocks and does not enter the kernel (unless a readiness fd is
+ * in use, see chan_get_fd()), this is intended for control loops that
+ * only care about the newest value. Only valid for
+ * channels created with attrs->last_value set.
+ *
+ * @param ch: incoming lvchan
+ * @param data: memory to store payload to (payload_size bytes)
+ * @param meta: optional, set to timestamps for the sample
+ *
+ * @return 1 if the sample is new since the last call, 0 if it has been
+ *         returned before, -EAGAIN if nothing has been received yet,
+ *         -EINVAL on error
+ */
+int chan_read_latest(struct channel *ch, void *data, struct ring_meta *meta);
+
+/**
+ * chan_try_read : read oldest sample from incoming channel without blocking
+ *
+ * Same as chan_read(), but returns -EAGAIN instead of waiting when the
+ * channel is empty. Intended for event loops waiting on chan_get_fd().
+ *
+ * @param ch: channel
+ * @param data: memory to store received data to
+ *
+ * @return bytes received, -EAGAIN if empty or -EINVAL on error
+ */
+int chan_try_read(struct channel *ch, void *data);
+
+/**
+ * chan_get_fd : get readiness fd for incoming channel
+ *
+ * Returns an eventfd that becomes readable (POLLIN) when a sample
+ * arrives in a channel that was found empty by the reader. It can be
+ * added to the caller's epoll set along with other channels, timers and
+ * nh_get_fd().
+ *
+ * The fd is reset by chan_try_read() (or chan_read_latest() for an
+ * lvchan) when it finds no new sample, so once readable, drain the
+ * channel until -EAGAIN (or 0) is returned. The caller must not read
+ * or close the fd.
+ *
+ * The fd is created on first call, until then the Rx path does not pay
+ * for signalling it. It is closed when the channel is destroyed.
+ *
+ * @param ch: incoming channel
+ *
+ * @return fd or negative errno on error
+ */
+int chan_get_fd(struct channel *ch);
+
+/**
+ * chan_set_overflow_policy : select what to discard when reader falls behind
+ *
+ * The Rx thread never blocks on a slow reader. Once the channel's ring
+ * is full, either the incoming sample (NC_DROP_NEWEST) or the oldest
+ * unread sample (NC_DROP_OLDEST) is discarded. With NC_OVERWRITE, any
+ * unread sample is replaced by the incoming one.
+ *
+ * @param ch: incoming channel
+ * @param policy: overflow policy
+ *
+ * @return 0 on success, -EINVAL on error
+ */
+int chan_set_overflow_policy(struct channel *ch, enum nc_overflow_policy policy);
+
+/**
+ * chan_get_dropped : number of incoming samples discarded for channel
+ *
+ * Safe to call from any thread while the channel is active.
+ *
+ * @param ch: incoming channel
+ *
+ * @return samples dropped since the channel was created
+ */
+uint64_t chan_get_dropped(struct channel *ch);
+
 /**
  * nh_create_init - create and initialize nethandler
  *
@@ -686,6 +1573,65 @@ int chan_read_wait(struct channel *ch, void *data);
  */
 struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const char *logfile);
 
+/**
+ * nh_create_init_poll - create nethandler without an Rx thread
+ *
+ * For single-threaded (run-to-completion) applications. No internal Rx
+ * thread is started, instead the caller waits on nh_get_fd() (alone or
+ * as part of its own epoll set) and calls nh_poll() to receive frames
+ * and run the Rx callbacks on its own thread.
+ *
+ * Rx fanout (nh_set_rx_fanout()) is not available in this mode.
+ *
+ * @param ifname: NIC to attach to
+ * @param hmap_size: sizeof incoming frame hashmap
+ *
+ * @returns struct nethandler on success, NULL on error
+ */
+struct nethandler * nh_create_init_poll(const char *ifname, size_t hmap_size, const char *logfile);
+
+/**
+ * nh_create_init_nophc - create nethandler on a NIC without a PHC
+ *
+ * As nh_create_init(), but a missing PTP hardware clock is not fatal.
+ * Like on lo, there is then no PTP time to synchronise with (PTP
+ * timestamps read as 0) and launch times are taken as CLOCK_TAI. Meant
+ * for virtual interfaces (veth, tap) in tests, not for a real network.
+ *
+ * @param ifname: NIC to attach to
+ * @param hmap_size: sizeof incoming frame hashmap
+ *
+ * @returns struct nethandler on success, NULL on error
+ */
+struct nethandler * nh_create_init_nophc(const char *ifname, size_t hmap_size, const char *logfile);
+
+/**
+ * nh_get_fd - get fd signalling pending Rx frames
+ *
+ * An epoll fd covering all Rx sockets of the nethandler (including the
+ * XSK when AF_XDP is enabled). It is readable (POLLIN) while frames are
+ * pending and stays the same for the lifetime of the nethandler.
+ *
+ * @param nh: nethandler created with nh_create_init_poll()
+ *
+ * @returns fd, or -EINVAL if nh has an Rx thread
+ */
+int nh_get_fd(struct nethandler *nh);
+
+/**
+ * nh_poll - receive pending frames on the caller's thread
+ *
+ * Waits up to timeout_ms for frames, then reads what is pending and
+ * dispatches each to its Rx callback, i.e. into the Rx channels. Without
+ * an Rx ring or AF_XDP, at most NH_POLL_BUDGET frames are read per call.
+ *
+ * @param nh: nethandler created with nh_create_init_poll()
+ * @param timeout_ms: max time to wait, 0 to return immediately, -1 to wait forever
+ *
+ * @returns number of frames received, negative errno on error
+ */
+int nh_poll(struct nethandler *nh, int timeout_ms);
+
 /**
  * nh_reg_callback - Register a callback for a given stream_id
  *
@@ -700,13 +1646,29 @@ struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const c
  * @param priv_data: private data used by the callback (to keep state between invocations)
  * @param cb: callback function pointer
  *
- * @returns negative (-EINVAL) on error, 0 on success
+ * @returns 0 on success, -EEXIST if stream_id already has a callback,
+ *          -ENOMEM if hmap_size streams are registered, -EINVAL on error
  */
 int nh_reg_callback(struct nethandler *nh,
 		uint64_t stream_id,
 		void *priv_data,
 		int (*cb)(void *priv_data, struct avtpdu_cshdr *du));
 
+/**
+ * nh_unreg_callback - Remove callback for a given stream_id
+ *
+ * Called when an Rx channel is destroyed, after this, frames for
+ * stream_id are ignored. Waits for Rx threads still running the
+ * callback, so priv_data can be freed on return. Must not be called
+ * from a callback.
+ *
+ * @param nh nethandler container
+ * @param stream_id StreamID passed to nh_reg_callback()
+ *
+ * @returns 0 on success, -ENOENT if not registered, -EINVAL on error
+ */
+int nh_unreg_callback(struct nethandler *nh, uint64_t stream_id);
+
 
 /**
  * nethandler standard callback
@@ -722,6 +1684,19 @@ int nh_reg_callback(struct nethandler *nh,
  */
 int nh_std_cb(void *data, struct avtpdu_cshdr *du);
 
+/**
+ * nethandler last-value callback
+ *
+ * Used by lvchans, publishes incoming data to the channel's last-value
+ * buffer, overwriting whatever was there.
+ *
+ * @param data: private data field
+ * @param du: incoming data unit from the network layer.
+ *
+ * @returns: 0 on success, negative code on error
+ */
+int nh_lv_cb(void *data, struct avtpdu_cshdr *du);
+
 /**
  * nh_feed_pdu - feed a avtpdu to nethandler which will be passed to relevant callback
  *
@@ -735,12 +1710,33 @@ int nh_std_cb(void *data, struct avtpdu_cshdr *du);
  * @returns
  */
 int nh_feed_pdu(struct nethandler *nh, struct avtpdu_cshdr *du);
+/* As nh_feed_pdu(), rx_hw_ns is stored as a software timestamp (ts_rx_hw not set) */
 int nh_feed_pdu_ts(struct nethandler *nh, struct avtpdu_cshdr *du,
 		uint64_t rx_hw_ns,
 		uint64_t recv_ptp_ns);
 
 /**
- * nh_get_num_(tx|rx) : get the number of Tx or Rx pipes registred
+ * nh_feed_frame_ts - feed a full Ethernet frame to nethandler
+ *
+ * Common entry for all Rx backends. Frames that are not AVTP (optionally
+ * behind a single 802.1Q tag) are ignored, the AVTPDU of the rest is
+ * passed on to nh_feed_pdu_ts() and logged.
+ *
+ * @param nh: nethandler container
+ * @param frame: start of Ethernet header
+ * @param rx_ns: Rx timestamp of frame
+ * @param recv_ptp_ns: PTP time when frame was picked up
+ * @param rx_hw: rx_ns is a raw hardware (PHC) timestamp, not software
+ *
+ * @returns 0 if frame was delivered, negative on error
+ */
+int nh_feed_frame_ts(struct nethandler *nh, unsigned char *frame,
+		uint64_t rx_ns,
+		uint64_t recv_ptp_ns,
+		bool rx_hw);
+
+/**
+ * nh_get_num_(tx|rx) : get the number of Tx or Rx channels registred
  *
  * @param: nh nethandler container
  * @returns: number of registered channels
@@ -779,6 +1775,350 @@ void nh_set_verbose(struct nethandler *nh, bool verbose);
  */
 void nh_set_srp(struct nethandler *nh, bool use_srp);
 
+/**
+ * nh_set_promisc() - keep Rx socket in or out of promiscuous mode
+ *
+ * The Rx socket is opened in promiscuous mode. Rx channels join their
+ * multicast group explicitly, so listeners to multicast streams still
+ * receive their frames with promiscuous mode disabled, and the NIC's
+ * MAC filter keeps unrelated unicast traffic away.
+ *
+ * Note: unicast streams to any MAC other than the NIC's own require
+ * promiscuous mode.
+ *
+ * @param: nh nethandler container
+ * @param: enable false to leave promiscuous mode
+ * @returns: true on success
+ */
+bool nh_set_promisc(struct nethandler *nh, bool enable);
+
+/**
+ * nh_set_rx_ring() - use a memory-mapped TPACKET_V3 ring for Rx
+ *
+ * Instead of one recvmsg() (and one PTP clock read) per frame, the Rx
+ * thread will wait for the kernel to hand over a block of frames and
+ * feed every frame in the block directly from the ring to the
+ * registered callbacks. The PTP clock is read once per block.
+ *
+ * Note: a block is only handed over once it is full or its retire
+ * timeout (1 ms) expires, so at low frame rates this adds up to 1 ms of
+ * latency compared to the default recvmsg() path.
+ *
+ * The Rx thread is restarted when the backend changes.
+ *
+ * @param: nh nethandler container
+ * @param: enable true to use the ring, false to revert to recvmsg()
+ * @returns: true on success
+ */
+bool nh_set_rx_ring(struct nethandler *nh, bool enable);
+
+/**
+ * nh_set_tx_ring() - send raw, prebuilt frames through a PACKET_TX_RING
+ *
+ * Tx channels created after this call get a raw socket with a
+ * memory-mapped TPACKET_V2 ring. The Ethernet header, including an
+ * 802.1Q tag with the PCP of the stream class and the VID learned via
+ * SRP (0 without SRP), is written to every slot once. A send only
+ * copies the AVTPDU to the next slot and kicks the socket, the kernel
+ * no longer builds a header per frame and the PCP does not depend on
+ * the egress-qos-map of a VLAN interface.
+ *
+ * TAS channels still pass their launch time (SCM_TXTIME) to ETF. The
+ * control message of a kick applies to every frame it sends, so each
+ * frame is kicked on its own (one sendmsg() per frame, as without the
+ * ring). The ring saves the header build and copy, not the syscall.
+ *
+ * With qdisc_bypass, frames are handed directly to the driver
+ * (PACKET_QDISC_BYPASS). This skips ETF and CBS in software, only use
+ * it where the NIC (or the network) does the shaping.
+ *
+ * Not available with io_uring.
+ *
+ * @param: nh nethandler container
+ * @param: enable true to use the Tx ring for new channels
+ * @param: qdisc_bypass send directly to the driver
+ * @returns: true on success
+ */
+bool nh_set_tx_ring(struct nethandler *nh, bool enable, bool qdisc_bypass);
+
+/**
+ * nh_set_rx_busy_poll() - spin on the Rx socket(s) instead of sleeping
+ *
+ * By default, the Rx thread sleeps in recvmsg()/poll() and every frame
+ * pays for the interrupt, softirq and thread wakeup. With busy-poll
+ * enabled, the Rx thread (and any fanout worker) never blocks but
+ * spins on non-blocking reads of the socket, ring or XSK. SO_BUSY_POLL
+ * and SO_PREFER_BUSY_POLL are set on the sockets so that drivers
+ * supporting it (AF_XDP) are polled directly from the Rx thread.
+ *
+ * This burns a full CPU, the Rx thread should be pinned to an isolated
+ * core, see cpu.
+ *
+ * The Rx thread(s) are restarted.
+ *
+ * @param: nh nethandler container
+ * @param: enable true to spin, false to revert to blocking reads
+ * @param: cpu CPU to pin the Rx thread to while busy-polling, -1 to keep
+ *         the placement from nh_set_rx_affinity()
+ * @returns: true on success
+ */
+bool nh_set_rx_busy_poll(struct nethandler *nh, bool enable, int cpu);
+
+/**
+ * nh_set_rx_affinity() - pin the Rx thread to a CPU
+ *
+ * Applied immediately if the Rx thread is running, and every time it
+ * is (re)started. Fanout workers are placed with nh_set_rx_worker().
+ *
+ * @param: nh nethandler container
+ * @param: cpu CPU to pin the Rx thread to, -1 to unpin
+ * @returns: true on success
+ */
+bool nh_set_rx_affinity(struct nethandler *nh, int cpu);
+
+/**
+ * nh_set_rx_sched() - run the Rx thread with SCHED_FIFO
+ *
+ * Applied immediately if the Rx thread is running, and every time it
+ * is (re)started, so there is no window where the thread runs with the
+ * default policy (as opposed to setting it from the outside with chrt).
+ *
+ * @param: nh nethandler container
+ * @param: sched_prio SCHED_FIFO priority (1..99), 0 for SCHED_OTHER
+ * @returns: true on success, false if the priority is out of range or
+ *           the caller is not permitted to use SCHED_FIFO
+ */
+bool nh_set_rx_sched(struct nethandler *nh, int sched_prio);
+
+/**
+ * nh_set_srp_sched() - set priority and CPU of the SRP threads
+ *
+ * Applies to the SRP monitor and talker announcer threads, immediately
+ * if they are running and when they are created by nh_set_srp().
+ *
+ * @param: nh nethandler container
+ * @param: sched_prio SCHED_FIFO priority (1..99), 0 for SCHED_OTHER
+ * @param: cpu CPU to pin the threads to, -1 to unpin
+ * @returns: true on success
+ */
+bool nh_set_srp_sched(struct nethandler *nh, int sched_prio, int cpu);
+
+/**
+ * nh_get_numa_node() - NUMA node the NIC is attached to
+ *
+ * Read from /sys/class/net/<ifname>/device/numa_node.
+ *
+ * @param: nh nethandler container
+ * @returns: node, or -1 if not known (e.g. lo, single node systems)
+ */
+int nh_get_numa_node(struct nethandler *nh);
+
+/**
+ * nh_set_numa() - keep Rx threads and buffers on the NIC's NUMA node
+ *
+ * Threads without an explicit CPU (Rx thread, fanout workers and SRP
+ * threads) are restricted to the CPUs local to the NIC
+ * (/sys/class/net/<ifname>/device/local_cpulist), and the Rx buffers
+ * (dispatch table, channel rings and last-value buffers, both existing
+ * and future) are moved to and allocated from the NIC's node.
+ *
+ * @param: nh nethandler container
+ * @param: enable true to follow the NIC's node
+ * @returns: true on success, false if the node is not known
+ */
+bool nh_set_numa(struct nethandler *nh, bool enable);
+
+/**
+ * nh_create_thread() - create a library thread with the given placement
+ *
+ * Used for all threads created by netchan. The policy and affinity are
+ * set before the thread starts running. If cpu is -1 and NUMA placement
+ * is enabled, the thread is restricted to the NIC's local CPUs. If the
+ * caller is not allowed to use SCHED_FIFO, the thread is created with
+ * the default policy instead.
+ *
+ * @param: nh nethandler container
+ * @param: tid thread id (out)
+ * @param: fn thread function
+ * @param: arg argument to fn
+ * @param: sched_prio SCHED_FIFO priority, 0 for SCHED_OTHER
+ * @param: cpu CPU to pin the thread to, -1 for none
+ * @returns: 0 on success, negative errno on error
+ */
+int nh_create_thread(struct nethandler *nh, pthread_t *tid, void *(*fn)(void *), void *arg,
+		int sched_prio, int cpu);
+
+/**
+ * nh_get_rx_spin_stats() - get number of polls done by the Rx thread(s)
+ *
+ * Summed over the Rx thread and all fanout workers. In blocking mode,
+ * idle polls are timeouts (250 ms), with busy-poll the ratio of idle to
+ * total polls is the fraction of the spinning CPU spent waiting.
+ *
+ * @param: nh nethandler container
+ * @param: spins total number of polls (optional)
+ * @param: idle number of polls that returned no frames (optional)
+ * @returns: 0 on success, -EINVAL on error
+ */
+int nh_get_rx_spin_stats(struct nethandler *nh, uint64_t *spins, uint64_t *idle);
+
+/**
+ * nh_set_rx_fanout() - split Rx between one worker thread per stream class
+ *
+ * A single Rx thread handles frames in arrival order, so a burst of
+ * class B frames will delay TAS and class A frames queued behind it.
+ * With fanout enabled, one Rx socket is opened per stream class and
+ * joined to a PACKET_FANOUT group. A cBPF fanout program selects the
+ * socket (and thereby the worker thread) for each frame, either by the
+ * stream class of the registered Rx channel or by the PCP of the frame,
+ * see enum nh_fanout_key. Each worker can run with its own SCHED_FIFO
+ * priority and CPU, see nh_set_rx_worker().
+ *
+ * The program is regenerated whenever Rx channels are added or
+ * removed. Frames for unknown streams go to the class B worker.
+ *
+ * Note: not available together with AF_XDP (nh_enable_xdp()).
+ *
+ * The Rx thread(s) are restarted when the backend changes.
+ *
+ * @param: nh nethandler container
+ * @param: enable true to use fanout workers, false to revert to a single Rx thread
+ * @param: key how to select worker for a frame
+ * @returns: true on success
+ */
+bool nh_set_rx_fanout(struct nethandler *nh, bool enable, enum nh_fanout_key key);
+
+/**
+ * nh_set_rx_worker() - set scheduling of the Rx fanout worker for a class
+ *
+ * Takes effect the next time the worker is started, running workers
+ * are restarted.
+ *
+ * @param: nh nethandler container
+ * @param: sc stream class handled by the worker
+ * @param: sched_prio SCHED_FIFO priority (1..99), 0 for default policy
+ * @param: cpu CPU to pin the worker to, -1 for no pinning
+ * @returns: true on success
+ */
+bool nh_set_rx_worker(struct nethandler *nh, enum stream_class sc, int sched_prio, int cpu);
+
+/**
+ * nh_enable_xdp() - use an AF_XDP socket for Rx and Tx
+ *
+ * An XDP program is attached to the NIC, redirecting frames with
+ * registered StreamIDs to an XSK bound to queue_id. All other traffic
+ * (SRP, PTP etc) continues through the regular network stack. The Rx
+ * thread is restarted to read from the XSK.
+ *
+ * Tx channels created *after* this call will send through the same XSK.
+ *
+ * Note: AF_XDP bypasses the Qdiscs, i.e. no ETF or CBS shaping is
+ * applied. The channel interval is instead enforced in userspace and
+ * frames are sent with an explicit 802.1Q tag (PCP from the stream
+ * class).
+ *
+ * Once enabled, XDP stays enabled until nh_destroy().
+ *
+ * @param: nh nethandler container
+ * @param: queue_id NIC Rx queue to bind to (frames arriving on other
+ *         queues are still received through the regular Rx socket)
+ * @returns: true on success
+ */
+bool nh_enable_xdp(struct nethandler *nh, int queue_id);
+
+/**
+ * nh_enable_io_uring() - send and receive through io_uring
+ *
+ * Tx channels queue their frames on a shared io_uring (fixed files,
+ * IORING_OP_SENDMSG with the same SCM_TXTIME as the regular socket
+ * path) and the Rx thread receives with a single multishot recvmsg
+ * into a provided buffer ring, i.e. no syscall per frame on Rx.
+ *
+ * With batch_tx, frames are only queued by chan_send_*() and not handed
+ * to the kernel until nh_flush_tx() is called (or the queue is full).
+ * A talker with many channels can then update and send all channels
+ * for a cycle and submit them with a single syscall. Note that the
+ * launch time (txtime) of TAS frames must still be sufficiently far
+ * into the future when the batch is flushed.
+ *
+ * Not available with AF_XDP, Rx fanout or the TPACKET_V3 ring. Once
+ * enabled, io_uring stays enabled until nh_destroy().
+ *
+ * @param: nh nethandler container
+ * @param: batch_tx defer submission of Tx frames to nh_flush_tx()
+ * @returns: true on success
+ */
+bool nh_enable_io_uring(struct nethandler *nh, bool batch_tx);
+
+/**
+ * nh_flush_tx() - submit all Tx frames queued with io_uring
+ *
+ * @param: nh nethandler container
+ * @returns: number of frames submitted, negative errno on error
+ */
+int nh_flush_tx(struct nethandler *nh);
+
+/**
+ * nh_enable_tx_timestamps() - measure when frames actually leave
+ *
+ * All Tx sockets (existing and new channels, channel groups) request
+ * timestamps when a frame enters the qdisc and when it is handed to
+ * the NIC. A collector thread matches them to the Tx entry in the log
+ * by stream_id and seqnr, filling in sched_ns and tx_ns (and tx_hw if
+ * the latter is a PHC timestamp). Without this, tx_ns is the launch
+ * time (TAS) or the time of sendmsg() (CBS).
+ *
+ * Hardware timestamps require the NIC to be configured for Tx
+ * timestamping (tx_type HWTSTAMP_TX_ON, usually done by ptp4l),
+ * otherwise software timestamps are used. Frames sent through AF_XDP
+ * are not timestamped.
+ *
+ * Only useful with a logger. Once enabled, the collector runs until
+ * nh_destroy().
+ *
+ * @param: nh nethandler container
+ * @returns: true on success
+ */
+bool nh_enable_tx_timestamps(struct nethandler *nh);
+
+/**
+ * nh_enable_txtime_stats() - count frames dropped by ETF
+ *
+ * TAS sockets request a report (SOF_TXTIME_REPORT_ERRORS) when ETF
+ * drops a frame, either on enqueue (invalid launch time) or because
+ * the launch time passed while queued. The latter happens after
+ * sendmsg() has returned, and was only noticed if a later send failed.
+ *
+ * A collector thread now drains the error queue of all Tx sockets and
+ * counts drops per stream, see chan_get_txtime_stats(). Each drop is
+ * also written to the logger (a separate "_e" CSV file).
+ *
+ * Uses the same collector as nh_enable_tx_timestamps(). Once enabled,
+ * the collector runs until nh_destroy().
+ *
+ * @param: nh nethandler container
+ * @returns: true on success
+ */
+bool nh_enable_txtime_stats(struct nethandler *nh);
+
+/**
+ * nh_enable_pacer() - send paced channels from a single library thread
+ *
+ * Every talker thread keeping its own cadence means one sleeping
+ * thread per stream, and the wakeup jitter of each shows up on the
+ * wire. The pacer keeps the next Tx slot of all paced channels
+ * (chan_pace()) in a timer wheel (125 us ticks) and wakes up once per
+ * tick with something due, using nh_wait_until() accuracy.
+ *
+ * Once enabled, the pacer runs until nh_destroy().
+ *
+ * @param: nh nethandler container
+ * @param: sched_prio SCHED_FIFO priority of pacer thread, 0 for SCHED_OTHER
+ * @param: cpu CPU to pin the pacer thread to, -1 for none
+ * @returns: true on success
+ */
+bool nh_enable_pacer(struct nethandler *nh, int sched_prio, int cpu);
+
 /**
  * nh_set_trace_breakval() - set breakvalue for tracebuffer.
  *
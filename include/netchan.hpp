@@ -158,6 +158,46 @@ public:
 
         return chan_send_now_wait(ch, data) == ch->payload_size;
     }
+
+    // Queue future samples (TAS), returns number of samples queued
+    int send_schedule(const struct chan_sample *samples, int n) {
+        if (!ch)
+            return -EINVAL;
+
+        return chan_send_schedule(ch, samples, n);
+    }
+
+    // Send payload gathered from the caller's buffers
+    int send_iov(uint64_t ts, const struct iovec *iov, int iovcnt, uint64_t *tx_ns = nullptr) {
+        if (!ch)
+            return -EINVAL;
+
+        return chan_send_iov(ch, ts, iov, iovcnt, tx_ns);
+    }
+
+    // Hand cadence to the nethandler's pacer (nh_enable_pacer())
+    bool pace() {
+        if (!ch)
+            return false;
+
+        return chan_pace(ch) == 0;
+    }
+
+    // Replace sample sent in the next slot of a paced channel
+    bool post(uint64_t ts, const void *data) {
+        if (!ch)
+            return false;
+
+        return chan_post(ch, ts, data) == 0;
+    }
+
+    // CBS: count, block or drop frames ahead of the reserved interval
+    bool set_tx_budget(enum nc_tx_budget policy, uint32_t burst = 1) {
+        if (!ch)
+            return false;
+
+        return chan_set_tx_budget(ch, policy, burst) == 0;
+    }
 };
 
 class NetChanRx : public NetChan {
@@ -182,6 +222,52 @@ public:
         return chan_read_wait(ch, data) > 0;
     }
 
+    const void * borrow(const struct ring_meta **meta = nullptr) {
+        if (!ch)
+            return nullptr;
+
+        return chan_read_borrow(ch, meta);
+    }
+
+    bool release() {
+        if (!ch)
+            return false;
+
+        return chan_read_release(ch) == 0;
+    }
+
+    int read_latest(void *data, struct ring_meta *meta = nullptr) {
+        if (!ch)
+            return -EINVAL;
+
+        return chan_read_latest(ch, data, meta);
+    }
+
+    int try_read(void *data) {
+        if (!ch)
+            return -EINVAL;
+
+        return chan_try_read(ch, data);
+    }
+
+    int get_fd(void) {
+        if (!ch)
+            return -EINVAL;
+
+        return chan_get_fd(ch);
+    }
+
+    bool set_overflow_policy(enum nc_overflow_policy policy) {
+        if (!ch)
+            return false;
+
+        return chan_set_overflow_policy(ch, policy) == 0;
+    }
+
+    uint64_t dropped() {
+        return chan_get_dropped(ch);
+    }
+
 };
 } //  namespace netchan
 
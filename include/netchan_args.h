@@ -23,6 +23,9 @@ static struct argp_option options[] = {
        {"break"     , 'b', "USEC", 0, "Stop program and ftrace if calculated E2E delay is larger than [USEC]"},
        {"txprio_cbs"    , 'p', "PRIO", 0, "Local Qdisc mqprio priority for CBS socket. If not set, default SO_PRIORITY (2)  will be used."},
        {"txprio_tas"    , 'P', "PRIO", 0, "Local Qdisc mqprio priority for TAS socket. If not set, default SO_PRIORITY (3)  will be used."},
+       {"rx_ring"   , 'r', NULL  , 0, "Use a memory-mapped TPACKET_V3 ring for incoming frames"},
+       {"xdp"       , 'x', "QUEUE", 0, "Use AF_XDP bound to NIC queue QUEUE for Rx and Tx (bypasses Qdiscs)"},
+       {"no_promisc", 'n', NULL  , 0, "Keep NIC out of promiscuous mode, only join multicast groups of Rx channels"},
        { 0 }
 };
 
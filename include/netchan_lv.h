@@ -0,0 +1,80 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \package netchan_lv
+ *
+ * Last-value buffer, a single-writer seqlock protected double buffer.
+ *
+ * The writer fills the buffer not currently published and flips to it
+ * when done. Readers copy out the most recent value without taking a
+ * lock, blocking or entering the kernel. A reader only has to retry if
+ * the writer wraps around to the buffer being copied, i.e. publishes
+ * twice during a single read.
+ */
+struct nc_lv;
+
+/**
+ * nc_lv_create() create a new last-value buffer
+ *
+ * @param elem_sz size of value (bytes)
+ * @returns new buffer or NULL on error
+ */
+struct nc_lv * nc_lv_create(size_t elem_sz);
+
+/**
+ * nc_lv_destroy() release buffer memory
+ *
+ * @param lv indirect ref to buffer (caller's ref will be NULL'd)
+ */
+void nc_lv_destroy(struct nc_lv **lv);
+
+/**
+ * nc_lv_map_size() size of the mapping starting at lv (bytes)
+ */
+size_t nc_lv_map_size(struct nc_lv *lv);
+
+/**
+ * nc_lv_begin() get buffer to fill with next value (writer)
+ *
+ * @param lv buffer container
+ * @returns pointer to elem_sz bytes, valid until nc_lv_publish()
+ */
+void * nc_lv_begin(struct nc_lv *lv);
+
+/**
+ * nc_lv_publish() make value from nc_lv_begin() the latest
+ *
+ * @param lv buffer container
+ */
+void nc_lv_publish(struct nc_lv *lv);
+
+/**
+ * nc_lv_read() copy out latest value (reader)
+ *
+ * The value can be split in a header and a body, copied to separate
+ * destinations in the same consistent snapshot.
+ *
+ * @param lv buffer container
+ * @param hdr optional, destination for the first hdr_sz bytes
+ * @param hdr_sz size of header (bytes), 0 if not split
+ * @param dst destination for the remaining elem_sz - hdr_sz bytes
+ * @param gen optional, set to generation (number of values published) of the value copied
+ * @returns 0 on success, -EAGAIN if nothing published yet, -EINVAL on error
+ */
+int nc_lv_read(struct nc_lv *lv, void *hdr, size_t hdr_sz, void *dst, uint64_t *gen);
+
+#ifdef __cplusplus
+}
+#endif
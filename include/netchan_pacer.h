@@ -0,0 +1,98 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <netchan.h>
+
+/**
+ * \package netchan_pacer
+ *
+ * Library-managed Tx cadence for a nethandler.
+ *
+ * Paced channels get a mailbox holding the latest posted sample
+ * (nc_pacer_post()). A single thread keeps a hashed timer wheel with
+ * the next Tx slot of every paced channel and sends the mailbox
+ * content of each channel at its slot:
+ *
+ * - channels with launch time (TAS/ETF) are sent ahead of the slot
+ *   with the slot as txtime (launch guard + one tick early)
+ * - other channels are sent when the slot arrives (nc_wait_tai())
+ *
+ * A sample replaced in the mailbox before it was sent is counted as
+ * coalesced, a slot without a new sample resends the previous one and
+ * is counted as a duplicate.
+ *
+ * The mailbox is a seqlock, posting never blocks on the pacer, but
+ * each channel must have a single writer.
+ */
+struct nc_pacer;
+
+/**
+ * nc_pacer_create() create pacer and start its thread
+ *
+ * @param nh nethandler container
+ * @param sched_prio SCHED_FIFO priority, 0 for SCHED_OTHER
+ * @param cpu CPU to pin the thread to, -1 for none
+ * @returns new pacer or NULL on error
+ */
+struct nc_pacer * nc_pacer_create(struct nethandler *nh, int sched_prio, int cpu);
+
+/**
+ * nc_pacer_destroy() stop thread and free pacer and all mailboxes
+ *
+ * @param pacer indirect ref to pacer (caller's ref will be NULL'd)
+ */
+void nc_pacer_destroy(struct nc_pacer **pacer);
+
+/**
+ * nc_pacer_add() hand Tx cadence of channel to pacer
+ *
+ * The first slot is the channel's next Tx slot, but at least a couple
+ * of ms into the future. Nothing is sent until a sample is posted.
+ *
+ * @param pacer pacer
+ * @param ch Tx channel
+ * @returns 0 on success, negative errno on error
+ */
+int nc_pacer_add(struct nc_pacer *pacer, struct channel *ch);
+
+/**
+ * nc_pacer_del() stop pacing channel and free its mailbox
+ *
+ * Must be called before the channel is closed.
+ *
+ * @param pacer pacer
+ * @param ch Tx channel
+ */
+void nc_pacer_del(struct nc_pacer *pacer, struct channel *ch);
+
+/**
+ * nc_pacer_post() replace sample in channel's mailbox
+ *
+ * @param ch paced channel
+ * @param ts capture timestamp, as for chan_update()
+ * @param data payload (channel's payload_size)
+ * @returns 0 on success, negative errno on error
+ */
+int nc_pacer_post(struct channel *ch, uint64_t ts, const void *data);
+
+/**
+ * nc_pacer_get_stats() get pacing counters for channel
+ *
+ * @param pacer pacer
+ * @param ch paced channel
+ * @param stats copy of counters (out)
+ * @returns 0 on success, negative errno on error
+ */
+int nc_pacer_get_stats(struct nc_pacer *pacer, struct channel *ch, struct chan_pace_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \package netchan_ring
+ *
+ * Single-producer/single-consumer ring of fixed-size slots used to hand
+ * incoming samples from the Rx thread to the reader of a channel.
+ *
+ * The producer reserves a slot, fills it in place and commits it. The
+ * consumer acquires the oldest slot and releases it once done. Neither
+ * side takes a lock or enters the kernel unless the consumer has gone
+ * to sleep waiting for data, in which case it is woken via a futex.
+ *
+ * The ring lives in a shared mapping, so it can be inherited across
+ * fork().
+ *
+ * The producer never blocks. What happens when the reader falls behind
+ * and the ring is full is decided by the overflow policy, every sample
+ * discarded is counted.
+ */
+struct nc_ring;
+
+/**
+ * Overflow policy, what to discard when a new sample arrives.
+ *
+ * NC_DROP_NEWEST: ring full, discard the new sample (default)
+ * NC_DROP_OLDEST: ring full, discard the oldest unread sample
+ * NC_OVERWRITE:   discard all unread samples, the reader only ever
+ *                 sees the most recent value
+ */
+enum nc_overflow_policy {
+	NC_DROP_NEWEST = 0,
+	NC_DROP_OLDEST,
+	NC_OVERWRITE
+};
+
+/**
+ * nc_ring_create() create a new ring
+ *
+ * The number of slots is derived from the expected interval between
+ * samples, enough to buffer approx 1 sec of data, rounded up to a power
+ * of 2 (min 8, max 4096 slots and at most 1MB in total).
+ *
+ * @param elem_sz size of each element (bytes)
+ * @param interval_ns minimum interval between two elements
+ * @returns new ring or NULL on error
+ */
+struct nc_ring * nc_ring_create(size_t elem_sz, uint64_t interval_ns);
+
+/**
+ * nc_ring_destroy() release ring memory
+ *
+ * @param ring indirect ref to ring (caller's ref will be NULL'd)
+ */
+void nc_ring_destroy(struct nc_ring **ring);
+
+/**
+ * nc_ring_capacity() number of slots in ring
+ */
+uint32_t nc_ring_capacity(struct nc_ring *ring);
+
+/**
+ * nc_ring_map_size() size of the mapping starting at ring (bytes)
+ */
+size_t nc_ring_map_size(struct nc_ring *ring);
+
+/**
+ * nc_ring_set_overflow() set policy for a full ring
+ *
+ * @param ring ring container
+ * @param policy what to discard, see enum nc_overflow_policy
+ */
+void nc_ring_set_overflow(struct nc_ring *ring, enum nc_overflow_policy policy);
+
+/**
+ * nc_ring_get_overflow() get active overflow policy
+ */
+enum nc_overflow_policy nc_ring_get_overflow(struct nc_ring *ring);
+
+/**
+ * nc_ring_dropped() number of samples discarded since ring was created
+ */
+uint64_t nc_ring_dropped(struct nc_ring *ring);
+
+/**
+ * nc_ring_reserve() get next free slot (producer)
+ *
+ * Depending on the overflow policy, unread slots may be discarded to
+ * make room.
+ *
+ * @param ring ring container
+ * @returns pointer to slot, NULL if the new sample must be dropped
+ */
+void * nc_ring_reserve(struct nc_ring *ring);
+
+/**
+ * nc_ring_commit() publish the slot returned by nc_ring_reserve()
+ *
+ * If the consumer is blocked in nc_ring_wait(), it is woken up.
+ *
+ * @param ring ring container
+ */
+void nc_ring_commit(struct nc_ring *ring);
+
+/**
+ * nc_ring_acquire() claim oldest unread slot (consumer)
+ *
+ * The slot is protected from the producer until nc_ring_release().
+ *
+ * @param ring ring container
+ * @returns pointer to slot, NULL if ring is empty
+ */
+void * nc_ring_acquire(struct nc_ring *ring);
+
+/**
+ * nc_ring_release() hand the slot returned by nc_ring_acquire() back to the producer
+ *
+ * @param ring ring container
+ */
+void nc_ring_release(struct nc_ring *ring);
+
+/**
+ * nc_ring_wait() block until ring has data or is closed
+ *
+ * @param ring ring container
+ * @returns 0 when data is available, -EPIPE if closed, -EINVAL on error
+ */
+int nc_ring_wait(struct nc_ring *ring);
+
+/**
+ * nc_ring_close() mark ring as closed and wake any blocked consumer
+ *
+ * Data already in the ring can still be read, but nc_ring_wait() will
+ * no longer block.
+ *
+ * @param ring ring container
+ */
+void nc_ring_close(struct nc_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
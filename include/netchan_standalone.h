@@ -29,6 +29,9 @@ void nc_breakval(int break_us);
 void nc_verbose(void);
 void nc_set_logfile(const char *logfile);
 void nc_tx_sock_prio(int prio, enum stream_class sc);
+void nc_use_rx_ring(void);
+void nc_use_xdp(int queue);
+void nc_no_promisc(void);
 
 
 /**
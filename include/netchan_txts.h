@@ -0,0 +1,102 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <netchan.h>
+
+/**
+ * \package netchan_txts
+ *
+ * Error queue collector for Tx sockets of a nethandler.
+ *
+ * A single thread waits for all registered sockets (epoll, EPOLLERR)
+ * and drains their error queue.
+ *
+ * TXTIME errors (ETF dropped the frame) are counted per stream_id with
+ * a lateness histogram (nc_txts_get_stats()) and written to the logger
+ * (log_txtime_err()).
+ *
+ * With Tx timestamps enabled (nc_txts_enable_stamps()), registered
+ * sockets also request a timestamp when
+ * the frame enters the qdisc (SCM_TSTAMP_SCHED) and when it is handed
+ * to the NIC (SCM_TSTAMP_SND, raw hardware if the NIC is configured
+ * for Tx timestamping, software otherwise). The kernel loops the frame
+ * back on the socket's error queue with the timestamp attached.
+ *
+ * The collector finds stream_id and seqnr in the looped frame and
+ * fills in the Tx entry in the logger (log_tx_ts()). The time spent in
+ * ETF/CBS is the difference between the two (when both are software
+ * stamps).
+ */
+struct nc_txts;
+
+/**
+ * nc_txts_create() create collector and start its thread
+ *
+ * @param nh nethandler container
+ * @returns new collector or NULL on error
+ */
+struct nc_txts * nc_txts_create(struct nethandler *nh);
+
+/**
+ * nc_txts_destroy() stop thread and free collector
+ *
+ * Registered sockets are left open, but no longer drained.
+ *
+ * @param txts indirect ref to collector (caller's ref will be NULL'd)
+ */
+void nc_txts_destroy(struct nc_txts **txts);
+
+/**
+ * nc_txts_enable_stamps() request Tx timestamps on sockets added from now on
+ *
+ * Sockets already registered must be added again.
+ *
+ * @param txts collector
+ */
+void nc_txts_enable_stamps(struct nc_txts *txts);
+
+/**
+ * nc_txts_add() start draining error queue of socket
+ *
+ * Enables Tx timestamps if requested. Adding a socket twice is not an
+ * error.
+ *
+ * @param txts collector
+ * @param sock Tx socket (AF_PACKET)
+ * @returns 0 on success, negative errno on error
+ */
+int nc_txts_add(struct nc_txts *txts, int sock);
+
+/**
+ * nc_txts_del() stop collecting from socket
+ *
+ * Must be called before the socket is closed. The TXTIME stats of sid
+ * are dropped, a new channel with the same stream_id starts from zero.
+ *
+ * @param txts collector
+ * @param sock Tx socket
+ * @param sid stream_id of the channel owning sock, 0 for shared sockets
+ */
+void nc_txts_del(struct nc_txts *txts, int sock, uint64_t sid);
+
+/**
+ * nc_txts_get_stats() get TXTIME error counters for a stream
+ *
+ * @param txts collector
+ * @param sid stream_id
+ * @param stats copy of counters (out), zeroed if nothing is reported for sid
+ * @returns 0 on success, negative errno on error
+ */
+int nc_txts_get_stats(struct nc_txts *txts, uint64_t sid, struct chan_txtime_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
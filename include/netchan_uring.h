@@ -0,0 +1,115 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <netchan.h>
+
+/**
+ * \package netchan_uring
+ *
+ * io_uring transport for nethandler.
+ *
+ * Two rings are used, one shared by all Tx channels (serialized by a
+ * lock) and one owned by the Rx thread (or the nh_poll() caller).
+ *
+ * Tx: each frame is copied to a slot and queued as an
+ * IORING_OP_SENDMSG on the channel's socket through the fixed file
+ * table, with SCM_TXTIME for TAS channels exactly as the sendmsg() path.
+ * The kernel reads the slot when the queue is submitted, so the channel
+ * can be updated immediately. In batch mode, frames are not submitted
+ * until nc_uring_flush() (or the ring is full), i.e. all channels
+ * sending in one cycle cost one io_uring_enter().
+ *
+ * Rx: a single multishot IORING_OP_RECVMSG on rx_sock picks buffers
+ * from a provided buffer ring, every frame is fed to nh_feed_frame_ts()
+ * straight from the buffer before it is handed back to the kernel.
+ */
+struct nc_uring;
+
+/**
+ * nc_uring_create() set up Tx and Rx rings
+ *
+ * @param nh nethandler container (rx_sock must be open)
+ * @param batch_tx queue frames until nc_uring_flush()
+ * @returns new uring container or NULL on error
+ */
+struct nc_uring * nc_uring_create(struct nethandler *nh, bool batch_tx);
+
+/**
+ * nc_uring_destroy() tear down rings and release all buffers
+ *
+ * Queued (not submitted) frames are dropped.
+ *
+ * @param uring indirect ref to container (caller's ref will be NULL'd)
+ */
+void nc_uring_destroy(struct nc_uring **uring);
+
+/**
+ * nc_uring_get_fd() get fd of the Rx ring (readable when completions are pending)
+ *
+ * @param uring uring container
+ * @returns ring fd, negative on error
+ */
+int nc_uring_get_fd(struct nc_uring *uring);
+
+/**
+ * nc_uring_rx() wait for frames on rx_sock and feed them to nethandler
+ *
+ * Arms the multishot receive if needed (first call, or after the
+ * kernel ran out of buffers or the arming thread exited).
+ *
+ * @param nh nethandler container
+ * @param timeout_ms max time to wait for frames
+ * @returns number of frames processed, negative on error
+ */
+int nc_uring_rx(struct nethandler *nh, int timeout_ms);
+
+/**
+ * nc_uring_add_tx() add Tx socket of channel to the fixed file table
+ *
+ * @param uring uring container
+ * @param ch Tx channel, ch->uring_idx is set on success
+ * @returns 0 on success, negative on error
+ */
+int nc_uring_add_tx(struct nc_uring *uring, struct channel *ch);
+
+/**
+ * nc_uring_del_tx() remove Tx socket of channel from the fixed file table
+ *
+ * Frames already queued for the channel are submitted first.
+ *
+ * @param uring uring container
+ * @param ch Tx channel
+ */
+void nc_uring_del_tx(struct nc_uring *uring, struct channel *ch);
+
+/**
+ * nc_uring_sendmsg() queue a frame for Tx
+ *
+ * Data, destination and control messages are copied, msg can be
+ * reused as soon as this returns.
+ *
+ * @param ch Tx channel (added with nc_uring_add_tx())
+ * @param msg as for sendmsg()
+ * @returns bytes queued, -1 on error with errno set (as sendmsg())
+ */
+int nc_uring_sendmsg(struct channel *ch, struct msghdr *msg);
+
+/**
+ * nc_uring_flush() submit all queued frames
+ *
+ * @param uring uring container
+ * @returns number of frames submitted, negative on error
+ */
+int nc_uring_flush(struct nc_uring *uring);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,17 @@
 #define NS_IN_SEC  (1000L * NS_IN_MS)
 #define NS_IN_HOUR (3600L * NS_IN_SEC)
 
+/* Hint to the CPU that we are spinning (saves power, yields to the
+ * sibling hyperthread) */
+static inline void nc_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
 static inline void ts_normalize(struct timespec *ts)
 {
 	if (!ts)
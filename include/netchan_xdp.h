@@ -0,0 +1,111 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <netchan.h>
+
+/**
+ * \package netchan_xdp
+ *
+ * AF_XDP (XSK) transport for nethandler.
+ *
+ * A small XDP program is attached to the NIC. It redirects AVTP frames
+ * (ethertype 0x22f0, optionally VLAN tagged) with a registered StreamID
+ * to a single XSK bound to one NIC queue, everything else is passed on
+ * to the regular network stack.
+ *
+ * Rx and Tx share one UMEM. The lower half of the frames are used for
+ * the fill/Rx rings, the upper half is a free-list for outgoing frames.
+ *
+ * Note: frames sent via AF_XDP bypass the Qdisc layer entirely, i.e.
+ * neither ETF nor CBS will shape the traffic. Tx channels using XDP
+ * enforce their reserved interval in userspace (next_tx_ns) for both
+ * TAS and CBS.
+ */
+struct nc_xdp;
+
+/**
+ * nc_xdp_create() create UMEM, XSK and attach the XDP program
+ *
+ * @param nh nethandler container (ifidx must be set)
+ * @param queue_id NIC queue to bind the XSK to
+ * @returns new xdp container or NULL on error
+ */
+struct nc_xdp * nc_xdp_create(struct nethandler *nh, int queue_id);
+
+/**
+ * nc_xdp_destroy() detach program and release all resources
+ *
+ * @param xdp indirect ref to container (caller's ref will be NULL'd)
+ */
+void nc_xdp_destroy(struct nc_xdp **xdp);
+
+/**
+ * nc_xdp_add_stream() let frames with stream_id through to the XSK
+ *
+ * @param xdp xdp container
+ * @param stream_id StreamID (host order)
+ * @returns 0 on success, negative on error
+ */
+int nc_xdp_add_stream(struct nc_xdp *xdp, uint64_t stream_id);
+
+/**
+ * nc_xdp_del_stream() stop redirecting frames with stream_id
+ *
+ * @param xdp xdp container
+ * @param stream_id StreamID (host order)
+ * @returns 0 on success, negative on error
+ */
+int nc_xdp_del_stream(struct nc_xdp *xdp, uint64_t stream_id);
+
+/**
+ * nc_xdp_get_fd() get fd of XSK (for poll())
+ *
+ * @param xdp xdp container
+ * @returns XSK fd, negative on error
+ */
+int nc_xdp_get_fd(struct nc_xdp *xdp);
+
+/**
+ * nc_xdp_rx() wait for frames on the XSK and feed them to nethandler
+ *
+ * All frames available on the Rx ring are passed to nh_feed_frame_ts()
+ * before the buffers are returned to the fill ring.
+ *
+ * @param nh nethandler container
+ * @param timeout_ms max time to wait for frames
+ * @returns number of frames processed, negative on error
+ */
+int nc_xdp_rx(struct nethandler *nh, int timeout_ms);
+
+/**
+ * nc_xdp_send() copy a frame into UMEM and queue it on the Tx ring
+ *
+ * The Ethernet (and VLAN) header is constructed from the channel, the
+ * AVTP header and payload is copied directly from ch->pdu.
+ *
+ * @param ch Tx channel
+ * @returns bytes queued (full frame), negative on error
+ */
+int nc_xdp_send(struct channel *ch);
+
+/**
+ * nc_create_xdp_tx() use the XSK of the nethandler for this Tx channel
+ *
+ * Replaces the channel's send-ops with the XDP variant.
+ *
+ * @param ch Tx channel
+ * @returns true on success
+ */
+bool nc_create_xdp_tx(struct channel *ch);
+
+#ifdef __cplusplus
+}
+#endif
@@ -84,18 +84,22 @@ def filter_sids(dft, dfl, sids, invalid_periods=None, e2e_limit=None, period_lim
         # Decide if rx or tx should be dropped (Tx and Rx may have
         # multiple channels going different ways)
         if (df_t['rx_ns'] == 0).all():
-            df_t = df_t.drop(['rx_ns', 'recv_ptp_ns'], axis=1)
+            df_t = df_t.drop(['rx_ns', 'recv_ptp_ns', 'rx_hw'], axis=1, errors='ignore')
             df_l = df_l.drop(['cap_ptp_ns', 'send_ptp_ns', 'tx_ns'], axis=1)
             df = pd.merge(df_t, df_l, on=['stream_id', 'avtp_ns', 'seqnr', 'sz'], suffixes=['_l', '_t'])
         else:
-            df_l = df_l.drop(['rx_ns', 'recv_ptp_ns'], axis=1)
+            df_l = df_l.drop(['rx_ns', 'recv_ptp_ns', 'rx_hw'], axis=1, errors='ignore')
             df_t = df_t.drop(['cap_ptp_ns', 'send_ptp_ns', 'tx_ns'], axis=1)
             df = pd.merge(df_t, df_l, on=['stream_id', 'avtp_ns', 'seqnr', 'sz'], suffixes=['_l', '_t'])
 
         # Adjust for LEAP second adjustment (CLOCK_REALTIME is 37 seconds ahead)
+        # Hardware Rx timestamps (rx_hw) are already in PHC time.
         df['send_ptp_ns'] += int(37*1e9)
         df['tx_ns'] += int(37*1e9)
-        df['rx_ns'] += int(37*1e9)
+        if 'rx_hw' in df:
+            df.loc[df['rx_hw'] == 0, 'rx_ns'] += int(37*1e9)
+        else:
+            df['rx_ns'] += int(37*1e9)
 
         df['cap2tx']  = df['tx_ns'] - df['cap_ptp_ns']
         df['tx2rx']   = df['rx_ns'] - df['tx_ns']
@@ -13,7 +13,9 @@ def main(txf, rxf, outf):
                                           'recv_ptp_ns_x': 'recv_ptp_ns',
                                           'cap_ptp_ns_y' : 'cap_ptp_ns',
                                           'send_ptp_ns_y': 'send_ptp_ns'})
-    df_merged = df_merged.drop(columns=['cap_ptp_ns_x', 'send_ptp_ns_x', 'rx_ns_y', 'recv_ptp_ns_y'])
+    df_merged = df_merged.rename(columns={'rx_hw_x': 'rx_hw'})
+    df_merged = df_merged.drop(columns=['cap_ptp_ns_x', 'send_ptp_ns_x', 'rx_ns_y', 'recv_ptp_ns_y', 'rx_hw_y'],
+                               errors='ignore')
     df_merged.to_csv(outf)
 
 
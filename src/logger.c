@@ -28,8 +28,14 @@ struct log_buffer
 	uint64_t tx_ns[BSZ];
 	uint64_t rx_ns[BSZ];
 	uint64_t recv_ptp_ns[BSZ];
+	uint8_t rx_hw[BSZ];
+	uint64_t sched_ns[BSZ];
+	uint8_t tx_hw[BSZ];
 }__attribute__((packed));
 
+/* How far back log_tx_ts() looks for the matching Tx entry */
+#define TX_TS_WINDOW 1024
+
 struct wakeup_delay_buffer
 {
 	FILE *delayfp;
@@ -39,6 +45,19 @@ struct wakeup_delay_buffer
 	uint64_t cpu_actual_ns[BSZ];
 }__attribute__((packed));
 
+/* Frames dropped by ETF, hopefully rare, entries beyond this are lost */
+#define TXERR_BSZ 65536
+
+struct txtime_err_buffer
+{
+	int idx;
+	uint64_t sid[TXERR_BSZ];
+	uint8_t seqnr[TXERR_BSZ];
+	uint64_t txtime_ns[TXERR_BSZ];
+	uint64_t late_ns[TXERR_BSZ];
+	uint8_t code[TXERR_BSZ];
+}__attribute__((packed));
+
 struct logc
 {
 	pthread_mutex_t m;
@@ -47,6 +66,7 @@ struct logc
 	/* buffer */
 	struct log_buffer *lb;
 	struct wakeup_delay_buffer *wdb;
+	struct txtime_err_buffer *teb;
 
 };
 
@@ -70,6 +90,16 @@ static int _log_create_wakeup_delay_buffer(struct logc *logc)
 	return 0;
 }
 
+static int _log_create_txtime_err_buffer(struct logc *logc)
+{
+	if (!logc)
+		return -EINVAL;
+	logc->teb = calloc(1, sizeof(struct txtime_err_buffer));
+	if (!logc->teb)
+		return -ENOMEM;
+	return 0;
+}
+
 static int _log_create_ts(struct logc *logc)
 {
 	if (!logc)
@@ -90,8 +120,12 @@ static int _log_create_ts(struct logc *logc)
 		logc->lb->avtp_ns[i] = 0;
 		logc->lb->cap_ptp_ns[i] = 0;
 		logc->lb->send_ptp_ns[i] = 0;
+		logc->lb->tx_ns[i] = 0;
 		logc->lb->rx_ns[i] = 0;
 		logc->lb->recv_ptp_ns[i] = 0;
+		logc->lb->rx_hw[i] = 0;
+		logc->lb->sched_ns[i] = 0;
+		logc->lb->tx_hw[i] = 0;
 	}
 	return 0;
 }
@@ -119,7 +153,8 @@ struct logc * log_create(const char *logfile)
 	strncpy(logc->logfile, logfile, strlen(logfile));
 
 	/* Create buffers */
-	if (_log_create_ts(logc) || _log_create_wakeup_delay_buffer(logc))
+	if (_log_create_ts(logc) || _log_create_wakeup_delay_buffer(logc) ||
+		_log_create_txtime_err_buffer(logc))
 		goto err_out;
 
 	pthread_mutex_unlock(&logc->m);
@@ -145,6 +180,10 @@ void log_destroy(struct logc *logc)
     free(logc->wdb);
     logc->wdb = NULL;
   }
+  if (logc->teb) {
+    free(logc->teb);
+    logc->teb = NULL;
+  }
 
   free(logc);
 }
@@ -155,6 +194,8 @@ static void _log_reset(struct logc *logc)
 		logc->lb->idx = 0;
 	if (logc->wdb)
 		logc->wdb->idx = 0;
+	if (logc->teb)
+		logc->teb->idx = 0;
 }
 
 void log_reset(struct logc *logc)
@@ -177,9 +218,9 @@ static void _flush_ts(const char *logfile, struct log_buffer *lb)
 
 	FILE *fp = fopen(logfile, "w+");
 	if (fp) {
-		fprintf(fp, "stream_id,sz,seqnr,avtp_ns,cap_ptp_ns,send_ptp_ns,tx_ns,rx_ns,recv_ptp_ns\n");
+		fprintf(fp, "stream_id,sz,seqnr,avtp_ns,cap_ptp_ns,send_ptp_ns,tx_ns,rx_ns,recv_ptp_ns,rx_hw,sched_ns,tx_hw\n");
 		for (int i = 0; i < lb->idx; i++) {
-			fprintf(fp, "%lu,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu\n",
+			fprintf(fp, "%lu,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%u,%lu,%u\n",
 				lb->sid[i],
 				lb->sz[i],
 				lb->seqnr[i],
@@ -188,7 +229,10 @@ static void _flush_ts(const char *logfile, struct log_buffer *lb)
 				lb->send_ptp_ns[i],
 				lb->tx_ns[i],
 				lb->rx_ns[i],
-				lb->recv_ptp_ns[i]);
+				lb->recv_ptp_ns[i],
+				lb->rx_hw[i],
+				lb->sched_ns[i],
+				lb->tx_hw[i]);
 		}
 		fflush(fp);
 		fclose(fp);
@@ -220,6 +264,32 @@ static void _flush_wakeup_delay(const char *logfile, struct wakeup_delay_buffer
 	}
 }
 
+static void _flush_txtime_err(const char *logfile, struct txtime_err_buffer *teb)
+{
+	if (!logfile || !teb)
+		return;
+
+	/* No frames dropped, avoid creating an empty file */
+	if (teb->idx == 0)
+		return;
+
+	FILE *fp = fopen(logfile, "w+");
+	if (fp) {
+		fprintf(fp, "stream_id,seqnr,txtime_ns,late_ns,code\n");
+		for (int i = 0; i < teb->idx; i++) {
+			fprintf(fp, "%lu,%u,%lu,%lu,%u\n",
+				teb->sid[i],
+				teb->seqnr[i],
+				teb->txtime_ns[i],
+				teb->late_ns[i],
+				teb->code[i]);
+		}
+		fflush(fp);
+		fclose(fp);
+		printf("%s(): wrote %d entries to txtime-error-log (%s)\n", __func__, teb->idx, logfile);
+	}
+}
+
 void log_flush_and_rotate(struct logc *logc)
 {
 	if (!logc)
@@ -238,6 +308,12 @@ void log_flush_and_rotate(struct logc *logc)
 		snprintf(ldf, 255, "%s_d-%d", logc->logfile, logc->flush_ctr);
 		_flush_wakeup_delay(ldf, logc->wdb);
 	}
+
+	if (logc->teb) {
+		char lef[256] = {0};
+		snprintf(lef, 255, "%s_e-%d", logc->logfile, logc->flush_ctr);
+		_flush_txtime_err(lef, logc->teb);
+	}
 	logc->flush_ctr++;
 	_log_reset(logc);
 	pthread_mutex_unlock(&logc->m);
@@ -249,7 +325,8 @@ static void _log(struct logc *logc,
 		uint64_t send_ptp_ns,
 		uint64_t tx_ns,
 		uint64_t rx_ns,
-		uint64_t recv_ptp_ns)
+		uint64_t recv_ptp_ns,
+		bool rx_hw)
 {
 	pthread_mutex_lock(&logc->m);
 	if (logc->lb->idx < BSZ) {
@@ -262,6 +339,9 @@ static void _log(struct logc *logc,
 		logc->lb->tx_ns[logc->lb->idx] = tx_ns;
 		logc->lb->rx_ns[logc->lb->idx] = rx_ns;
 		logc->lb->recv_ptp_ns[logc->lb->idx] = recv_ptp_ns;
+		logc->lb->rx_hw[logc->lb->idx] = rx_hw;
+		logc->lb->sched_ns[logc->lb->idx] = 0;
+		logc->lb->tx_hw[logc->lb->idx] = 0;
 		logc->lb->idx++;
 	} else {
 	  log_flush_and_rotate(logc);
@@ -276,16 +356,73 @@ void log_tx(struct logc *logc,
 	uint64_t tx_ns)
 {
 	if (logc && du)
-		_log(logc, du, cap_ts_ns, send_ptp_ns, tx_ns, 0, 0);
+		_log(logc, du, cap_ts_ns, send_ptp_ns, tx_ns, 0, 0, false);
+}
+
+void log_tx_ts(struct logc *logc,
+	uint64_t sid,
+	uint8_t seqnr,
+	uint64_t sched_ns,
+	uint64_t tx_ns,
+	bool tx_hw)
+{
+	if (!logc || !logc->lb)
+		return;
+
+	pthread_mutex_lock(&logc->m);
+	struct log_buffer *lb = logc->lb;
+	int stop = lb->idx > TX_TS_WINDOW ? lb->idx - TX_TS_WINDOW : 0;
+
+	/* Most recent first, seqnr wraps at 256. Rx entries have no
+	 * send_ptp_ns.
+	 */
+	for (int i = lb->idx - 1; i >= stop; i--) {
+		if (lb->sid[i] != sid || lb->seqnr[i] != seqnr || !lb->send_ptp_ns[i])
+			continue;
+		if (sched_ns)
+			lb->sched_ns[i] = sched_ns;
+
+		/* Do not let a software stamp replace a hardware stamp */
+		if (tx_ns && (tx_hw || !lb->tx_hw[i])) {
+			lb->tx_ns[i] = tx_ns;
+			lb->tx_hw[i] = tx_hw;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&logc->m);
+}
+
+void log_txtime_err(struct logc *logc,
+	uint64_t sid,
+	uint8_t seqnr,
+	uint64_t txtime_ns,
+	uint64_t late_ns,
+	uint8_t code)
+{
+	if (!logc || !logc->teb)
+		return;
+
+	pthread_mutex_lock(&logc->m);
+	struct txtime_err_buffer *teb = logc->teb;
+	if (teb->idx < TXERR_BSZ) {
+		teb->sid[teb->idx] = sid;
+		teb->seqnr[teb->idx] = seqnr;
+		teb->txtime_ns[teb->idx] = txtime_ns;
+		teb->late_ns[teb->idx] = late_ns;
+		teb->code[teb->idx] = code;
+		teb->idx++;
+	}
+	pthread_mutex_unlock(&logc->m);
 }
 
 void log_rx(struct logc *logc,
 	struct avtpdu_cshdr *du,
 	uint64_t rx_ns,
-	uint64_t recv_ptp_ns)
+	uint64_t recv_ptp_ns,
+	bool rx_hw)
 {
 	if (logc && du)
-		_log(logc, du, 0, 0, 0, rx_ns, recv_ptp_ns);
+		_log(logc, du, 0, 0, 0, rx_ns, recv_ptp_ns, rx_hw);
 }
 
 void log_wakeup_delay(struct logc *logc,
@@ -7,6 +7,11 @@
  */
 #include <netchan.h>
 #include <netchan_srp_client.h>
+#include <netchan_xdp.h>
+#include <netchan_uring.h>
+#include <netchan_txts.h>
+#include <netchan_pacer.h>
+#include <netchan_ring.h>
 #include <logger.h>
 #include <tracebuffer.h>
 
@@ -30,13 +35,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-
-struct pipe_meta {
-	uint64_t ts_rx_ns;
-	uint64_t ts_recv_ptp_ns;
-	uint32_t avtp_timestamp;
-	uint8_t payload[0];
-}__attribute__((packed));
+#include <poll.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/mempolicy.h>
 
 /**
  * cb_priv: private data for callbacks
@@ -47,17 +51,22 @@ struct pipe_meta {
  * and create this automatically when creating new fifos
  *
  * @param sz: size of data to read/write
- * @param fd: filedescriptor to write to/read from
+ * @param ring: ring to publish incoming data to
+ * @param lv: last-value buffer to publish to (lvchan, no ring)
  * @param meta: metadata about the data
+ * @param evfd: readiness eventfd, see chan_get_fd()
+ * @param armed: reader is waiting on evfd, next sample must signal it
  */
 struct cb_priv
 {
 	int sz;
-	/* FIFO FD */
-	int fd;
+	struct nc_ring *ring;
+	struct nc_lv *lv;
+	int evfd;
+	uint32_t armed;
 
 	/* meta-info about the stream  */
-	struct pipe_meta meta;
+	struct ring_meta meta;
 };
 
 /**
@@ -66,10 +75,36 @@ struct cb_priv
  * This is used to find the correct callback to process incoming frames.
  */
 struct cb_entity {
-	uint64_t stream_id;
 	void *priv_data;
 	int (*cb)(void *priv_data, struct avtpdu_cshdr *du);
 };
+
+/**
+ * nh_bucket: one bucket in the Rx dispatch table
+ *
+ * A bucket is exactly one cacheline: the StreamIDs are compared against
+ * the incoming ID in one go and a miss knows from the same line whether
+ * to probe on. The callbacks live in a parallel array (nethandler's
+ * hm_ent, NH_BUCKET_SLOTS per bucket), only touched on a hit. An empty
+ * slot has StreamID 0 (never valid).
+ *
+ * @param sid: StreamIDs (host order)
+ * @param overflow: number of entries that probed past this bucket
+ */
+#define NH_BUCKET_SLOTS 7
+struct nh_bucket {
+	uint64_t sid[NH_BUCKET_SLOTS];
+	uint32_t overflow;
+	uint32_t pad;
+} __attribute__((aligned(64)));
+
+/* Dense copy of the dispatch table while it holds few streams */
+#define NH_SMALL_SLOTS 8
+struct nh_small {
+	uint64_t sid[NH_SMALL_SLOTS];
+	struct cb_entity *ent[NH_SMALL_SLOTS];
+	uint32_t n;
+};
 #define GUARD pthread_mutex_lock(&ch->guard)
 #define UNGUARD pthread_mutex_unlock(&ch->guard)
 
@@ -255,17 +290,7 @@ static struct channel * _chan_create(struct nethandler *nh,
 	_chan_set_streamclass(ch, attrs->sc, attrs->interval_ns);
 
 	ch->tx_sock = -1;
-
-	/* Set up pipes for Rx/Tx */
-	int pfd[2];
-	if (pipe(pfd) == -1) {
-		ERROR(ch, "Unable to create pipe-pair during setup (%d: %s)", errno, strerror(errno));
-		chan_destroy(&ch);
-		return NULL;
-	}
-	ch->fd_r = pfd[0];
-	ch->fd_w = pfd[1];
-
+	ch->uring_idx = -1;
 
 	pthread_mutex_init(&ch->ready_mtx, NULL);
 	pthread_cond_init(&ch->ready_cond, NULL);
@@ -303,6 +328,30 @@ struct channel *chan_create_tx(struct nethandler *nh, struct channel_attrs *attr
 		break;
 	}
 
+	if (nh->use_tx_ring && !nh->xdp && !nc_setup_tx_ring(ch, nh->tx_qdisc_bypass)) {
+		ERROR(ch, "Failed setting up Tx ring for channel");
+		chan_destroy(&ch);
+		return NULL;
+	}
+
+	if (nh->txts && nc_txts_add(nh->txts, ch->tx_sock))
+		WARN(ch, "Failed adding channel to Tx error queue collector");
+
+	if (nh->uring && nc_uring_add_tx(nh->uring, ch)) {
+		ERROR(ch, "Failed adding Tx channel to io_uring");
+		chan_destroy(&ch);
+		return NULL;
+	}
+
+	/* Replace socket ops with XSK, the socket is kept as the channel
+	 * is still identified as a Tx channel by it.
+	 */
+	if (nh->xdp && !nc_create_xdp_tx(ch)) {
+		ERROR(ch, "Failed attaching Tx channel to XSK");
+		chan_destroy(&ch);
+		return NULL;
+	}
+
 	/* We are ready to send, the first attempt should fly straight through */
 	ch->next_tx_ns = tai_get_ns();
 
@@ -333,6 +382,98 @@ struct channel *chan_create_tx(struct nethandler *nh, struct channel_attrs *attr
 }
 
 
+/*
+ * Join or leave the multicast group of an Rx channel on the shared Rx
+ * socket. The kernel refcounts memberships, so channels sharing a group
+ * can join and leave independently.
+ */
+static int _chan_mc_membership(struct channel *ch, bool join)
+{
+	bool bcast = memcmp(ch->dst, "\xff\xff\xff\xff\xff\xff", ETH_ALEN) == 0;
+	if (!(ch->dst[0] & 0x01) || bcast)
+		return 0;
+	if (ch->mc_member == join)
+		return 0;
+	if (ch->nh->rx_sock < 0)
+		return -EBADF;
+
+	struct packet_mreq mr;
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = ch->nh->ifidx;
+	mr.mr_type = PACKET_MR_MULTICAST;
+	mr.mr_alen = ETH_ALEN;
+	memcpy(mr.mr_address, ch->dst, ETH_ALEN);
+	if (setsockopt(ch->nh->rx_sock, SOL_PACKET,
+			join ? PACKET_ADD_MEMBERSHIP : PACKET_DROP_MEMBERSHIP,
+			&mr, sizeof(mr)) == -1) {
+		WARN(ch, "failed %s multicast group %s => %d: %s",
+			join ? "joining" : "leaving", ether_ntoa((struct ether_addr *)ch->dst),
+			errno, strerror(errno));
+		return -errno;
+	}
+	DEBUG(ch, "%s multicast group %s", join ? "joined" : "left",
+		ether_ntoa((struct ether_addr *)ch->dst));
+	ch->mc_member = join;
+	return 0;
+}
+
+/*
+ * Node of the NIC, -1 if not known (virtual devices have no
+ * device/numa_node, single node systems report -1)
+ */
+static int _nh_read_numa_node(const char *ifname)
+{
+	char path[128];
+	int node = -1;
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+	FILE *fp = fopen(path, "r");
+	if (fp) {
+		if (fscanf(fp, "%d", &node) != 1)
+			node = -1;
+		fclose(fp);
+	}
+	return node;
+}
+
+/*
+ * Prefer node for memory in [addr, addr+len), existing pages are
+ * moved. node < 0 reverts to the default policy.
+ */
+static int _nh_numa_bind(void *addr, size_t len, int node)
+{
+	if (!addr || !len)
+		return -EINVAL;
+
+	/* mbind() works on whole pages */
+	uintptr_t pg = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)addr & ~(pg - 1);
+	len += (uintptr_t)addr - start;
+	addr = (void *)start;
+
+	unsigned long mask = 0;
+	if (node >= 0) {
+		if (node >= (int)(sizeof(mask) * 8))
+			return -EINVAL;
+		mask = 1UL << node;
+	}
+	if (syscall(SYS_mbind, addr, len, node >= 0 ? MPOL_PREFERRED : MPOL_DEFAULT,
+			node >= 0 ? &mask : NULL, node >= 0 ? sizeof(mask) * 8 : 0,
+			node >= 0 ? MPOL_MF_MOVE : 0) < 0)
+		return -errno;
+	return 0;
+}
+
+static void _nh_numa_bind_chan(struct channel *ch, int node)
+{
+	int res = 0;
+	if (ch->ring)
+		res = _nh_numa_bind(ch->ring, nc_ring_map_size(ch->ring), node);
+	else if (ch->lv)
+		res = _nh_numa_bind(ch->lv, nc_lv_map_size(ch->lv), node);
+	if (res)
+		WARN(ch, "%s(): failed binding Rx buffer to node %d (%s)", __func__, node, strerror(-res));
+}
+
 struct channel *chan_create_rx(struct nethandler *nh, struct channel_attrs *attrs)
 {
 	if (!nh || !attrs)
@@ -341,40 +482,54 @@ struct channel *chan_create_rx(struct nethandler *nh, struct channel_attrs *attr
 	if (!ch)
 		return NULL;
 
-	if (ch->dst[0] == 0x01 && ch->dst[1] == 0x00 && ch->dst[2] == 0x5E) {
-		DEBUG(ch, "receive data on a multicast group, adding membership");
-
-		struct packet_mreq mr;
-		memset(&mr, 0, sizeof(mr));
-		mr.mr_ifindex = ch->nh->ifidx;
-		mr.mr_type = PACKET_MR_PROMISC;
-		if (setsockopt(ch->nh->rx_sock, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)) == -1) {
-			WARN(ch, "failed setting multicast membership, may not receive frames! => %d: %s",
-				errno, strerror(errno));
-		}
-	}
+	/* Let the NIC filter on the group rather than relying on
+	 * promiscuous mode, left again in chan_stop()
+	 */
+	_chan_mc_membership(ch, true);
 
 	/* trigger on incoming DUs and attach a generic callback
-	 * and write data into correct pipe.
+	 * and write data into the channel's ring.
 	 *
-	 * data to feed through the pipe, we need to keep track of
-	 * metadata such as timestamps etc, so we cannot copy just the
-	 * payload, we need additional fields - thus a temp buffer that
-	 * follows the pdu.
+	 * Each slot in the ring holds metadata such as timestamps
+	 * alongside the payload, the ring is sized to hold approx 1 sec
+	 * of data at the reserved interval.
+	 *
+	 * An lvchan keeps only the latest sample (same layout) in a
+	 * seqlocked double buffer instead.
 	 */
-	ch->cbp = malloc(sizeof(struct cb_priv) + ch->payload_size);
-	if (!ch->cbp) {
-		UNGUARD;
+	ch->cbp = calloc(1, sizeof(struct cb_priv));
+	if (ch->cbp)
+		ch->cbp->evfd = -1;
+	if (attrs->last_value)
+		ch->lv = nc_lv_create(sizeof(struct ring_meta) + ch->payload_size);
+	else
+		ch->ring = nc_ring_create(sizeof(struct ring_meta) + ch->payload_size, ch->interval_ns);
+	if ((!ch->ring && !ch->lv) || !ch->cbp) {
+		ERROR(ch, "Failed allocating Rx buffer for channel");
 		chan_destroy(&ch);
 		return NULL;
 	}
 
-	ch->cbp->fd = ch->fd_w;
+	ch->cbp->ring = ch->ring;
+	ch->cbp->lv = ch->lv;
 	ch->cbp->sz = ch->payload_size;
+	nc_ring_set_overflow(ch->ring, attrs->overflow);
+	if (ch->nh->use_numa)
+		_nh_numa_bind_chan(ch, ch->nh->numa_node);
 
 	/* Add ref to internal list for memory mgmt */
 	nh_add_rx(ch->nh, ch);
-	nh_reg_callback(ch->nh, ch->sidw.s64, ch->cbp, nh_std_cb);
+	int res = nh_reg_callback(ch->nh, ch->sidw.s64, ch->cbp, ch->lv ? nh_lv_cb : nh_std_cb);
+	if (res) {
+		ERROR(ch, "Failed registering Rx callback for 0x%016"PRIx64" (%s)",
+			ch->sidw.s64, strerror(-res));
+
+		/* Not registered, must not unregister whoever owns the StreamID */
+		free(ch->cbp);
+		ch->cbp = NULL;
+		chan_destroy(&ch);
+		return NULL;
+	}
 
 	/* Listener will be marked ready by SRP monitor thread, but  */
 	if (!ch->nh->use_srp)
@@ -438,32 +593,34 @@ bool chan_stop(struct channel *ch)
 			nc_srp_remove_listener(ch);
 	}
 
-
-	/* FIXME: abort current blocking reads to ch->fd_r but without
-	 * destroying the pipe.
-	 *
-	 * We have marked channel as !ready, so read() will detect this
-	 * and close down.
+	/* Kick blocked readers out of chan_read(), we have marked
+	 * channel as !ready, so they will detect this and close down.
 	 */
-	char *dummy = (char *)calloc(1, ch->payload_size);
-	write(ch->fd_w, dummy, ch->payload_size);
+	nc_ring_close(ch->ring);
+
+	if (ch->tx_sock < 0)
+		_chan_mc_membership(ch, false);
 
 	return true;
 }
 
 static void _chan_destroy(struct channel **ch, bool unlink)
 {
-	chan_stop(*ch);
+	/* nh_remove_tx/rx() clear ch->nh */
+	struct nethandler *nh = (*ch)->nh;
 
-	if ((*ch)->fd_r >= 0)
-		close((*ch)->fd_r);
-	if ((*ch)->fd_w >= 0)
-		close((*ch)->fd_w);
+	chan_stop(*ch);
 
 	/* Must remove channel from Tx or Rx list */
 	if ((*ch)->tx_sock >= 0) {
 		if (unlink)
 			nh_remove_tx(*ch);
+		if (nh) {
+			nc_uring_del_tx(nh->uring, *ch);
+			nc_pacer_del(nh->pacer, *ch);
+			nc_txts_del(nh->txts, (*ch)->tx_sock, (*ch)->sidw.s64);
+		}
+		nc_teardown_tx_ring(*ch);
 		close((*ch)->tx_sock);
 		(*ch)->tx_sock = -1;
 	} else {
@@ -471,8 +628,15 @@ static void _chan_destroy(struct channel **ch, bool unlink)
 			nh_remove_rx(*ch);
 	}
 
-	if ((*ch)->cbp)
+	/* Returns once the Rx thread is done with cbp and the buffers */
+	if ((*ch)->cbp) {
+		nh_unreg_callback(nh, (*ch)->sidw.s64);
+		if ((*ch)->cbp->evfd >= 0)
+			close((*ch)->cbp->evfd);
 		free((*ch)->cbp);
+	}
+	nc_ring_destroy(&(*ch)->ring);
+	nc_lv_destroy(&(*ch)->lv);
 
 	free(*ch);
 	*ch = NULL;
@@ -503,8 +667,8 @@ bool chan_valid(struct channel *ch)
 		if (ch->cbp || ch->interval_ns <= 0)
 			return false;
 	} else {
-		/* Rx *must* have callback-buffer */
-		if (!ch->cbp)
+		/* Rx *must* have callback-buffer and ring (or lv) */
+		if (!ch->cbp || (!ch->ring && !ch->lv))
 			return false;
 	}
 
@@ -516,13 +680,18 @@ bool chan_valid(struct channel *ch)
 	if (ch->payload_size <= 0)
 		return false;
 
-	/* fd_w, fd_r */
-	if (ch->fd_w == 0 && ch->fd_r == 0)
-		return false;
-
 	return true;
 }
 
+static void _chan_update_hdr(struct channel *ch, uint64_t ts)
+{
+	ch->sample_ns = ts;
+	ch->pdu.seqnr++;
+	ch->pdu.avtp_timestamp = htonl(tai_to_avtp_ns(ts));
+	ch->pdu.tv = 1;
+	ch->pdu.sdl = htons(ch->payload_size);
+}
+
 int chan_update(struct channel *ch, uint64_t ts, void *data)
 {
 	if (!chan_valid(ch))
@@ -531,15 +700,153 @@ int chan_update(struct channel *ch, uint64_t ts, void *data)
 	if (!data)
 		return -ENOMEM;
 
-	ch->sample_ns = ts;
-	ch->pdu.seqnr++;
-	ch->pdu.avtp_timestamp = htonl(tai_to_avtp_ns(ts));
-	ch->pdu.tv = 1;
-	ch->pdu.sdl = htons(ch->payload_size);
-	memcpy(ch->payload, data, ch->payload_size);
+	_chan_update_hdr(ch, ts);
+	ch->tx_iovcnt = 0;
+
+	/* Written in place (chan_get_payload()) */
+	if (data != ch->payload)
+		memcpy(ch->payload, data, ch->payload_size);
+	return 0;
+}
+
+int chan_update_iov(struct channel *ch, uint64_t ts, const struct iovec *iov, int iovcnt)
+{
+	if (!chan_valid(ch) || ch->tx_sock < 0 || !iov || iovcnt <= 0 || iovcnt > CHAN_IOV_MAX)
+		return -EINVAL;
+
+	size_t sz = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_base && iov[i].iov_len)
+			return -EINVAL;
+		sz += iov[i].iov_len;
+	}
+	if (sz != ch->payload_size)
+		return -EINVAL;
+
+	_chan_update_hdr(ch, ts);
+	memcpy(ch->tx_iov, iov, iovcnt * sizeof(*iov));
+	ch->tx_iovcnt = iovcnt;
+	return 0;
+}
+
+int nc_chan_pdu_iov(struct channel *ch, struct iovec *iov)
+{
+	iov[0].iov_base = &ch->pdu;
+	if (!ch->tx_iovcnt) {
+		iov[0].iov_len = sizeof(struct avtpdu_cshdr) + ch->payload_size;
+		return 1;
+	}
+	iov[0].iov_len = sizeof(struct avtpdu_cshdr);
+	memcpy(&iov[1], ch->tx_iov, ch->tx_iovcnt * sizeof(*iov));
+	return 1 + ch->tx_iovcnt;
+}
+
+struct chan_group * chan_group_create(struct nethandler *nh, struct channel **ch, int nr)
+{
+	if (!nh || !ch || nr <= 0)
+		return NULL;
+	if (nh->xdp) {
+		ERROR(NULL, "%s(): channel groups not available with AF_XDP", __func__);
+		return NULL;
+	}
+
+	int nr_tas = 0;
+	for (int i = 0; i < nr; i++) {
+		if (!chan_valid(ch[i]) || ch[i]->nh != nh || ch[i]->tx_sock < 0) {
+			ERROR(NULL, "%s(): member %d is not a Tx channel of this nethandler", __func__, i);
+			return NULL;
+		}
+		if (ch[i]->sc == SC_TAS)
+			nr_tas++;
+	}
+
+	struct chan_group *grp = calloc(1, sizeof(*grp));
+	if (!grp)
+		return NULL;
+	grp->nh = nh;
+	grp->nr = nr;
+	grp->nr_tas = nr_tas;
+	grp->tas_sock = -1;
+	grp->cbs_sock = -1;
+	grp->ch = calloc(nr, sizeof(*grp->ch));
+	grp->order = calloc(nr, sizeof(*grp->order));
+	grp->msgs = calloc(nr, sizeof(*grp->msgs));
+	grp->iov = calloc(nr * (1 + CHAN_IOV_MAX), sizeof(*grp->iov));
+	grp->txtime = calloc(nr, sizeof(*grp->txtime));
+	grp->control = calloc(nr_tas ? nr_tas : 1, CMSG_SPACE(sizeof(uint64_t)));
+	if (!grp->ch || !grp->order || !grp->msgs || !grp->iov || !grp->txtime || !grp->control)
+		goto err;
+
+	/* TAS members first, they are sent on the socket with SO_TXTIME */
+	int tas = 0, cbs = nr_tas;
+	for (int i = 0; i < nr; i++) {
+		int idx = ch[i]->sc == SC_TAS ? tas++ : cbs++;
+		grp->ch[idx] = ch[i];
+		grp->order[idx] = i;
+	}
+
+	if (nr_tas) {
+		grp->tas_sock = nc_create_group_tx_sock(nh, true);
+		if (grp->tas_sock < 0)
+			goto err;
+	}
+	if (nr > nr_tas) {
+		grp->cbs_sock = nc_create_group_tx_sock(nh, false);
+		if (grp->cbs_sock < 0)
+			goto err;
+	}
+	if (nh->txts) {
+		nc_txts_add(nh->txts, grp->tas_sock);
+		nc_txts_add(nh->txts, grp->cbs_sock);
+	}
+	return grp;
+err:
+	ERROR(NULL, "%s(): failed creating channel group", __func__);
+	chan_group_destroy(&grp);
+	return NULL;
+}
+
+void chan_group_destroy(struct chan_group **grp)
+{
+	if (!grp || !*grp)
+		return;
+	nc_txts_del((*grp)->nh->txts, (*grp)->tas_sock, 0);
+	nc_txts_del((*grp)->nh->txts, (*grp)->cbs_sock, 0);
+	if ((*grp)->tas_sock >= 0)
+		close((*grp)->tas_sock);
+	if ((*grp)->cbs_sock >= 0)
+		close((*grp)->cbs_sock);
+	free((*grp)->ch);
+	free((*grp)->order);
+	free((*grp)->msgs);
+	free((*grp)->iov);
+	free((*grp)->txtime);
+	free((*grp)->control);
+	free(*grp);
+	*grp = NULL;
+}
+
+int chan_group_update(struct chan_group *grp, uint64_t ts, void **data)
+{
+	if (!grp || !data)
+		return -EINVAL;
+
+	/* data follows the caller's order, the group is sorted by class */
+	for (int i = 0; i < grp->nr; i++) {
+		int res = chan_update(grp->ch[i], ts, data[grp->order[i]]);
+		if (res)
+			return res;
+	}
 	return 0;
 }
 
+int chan_group_send_at(struct chan_group *grp, uint64_t *tx_ns)
+{
+	if (!grp)
+		return -EINVAL;
+	return nc_group_send(grp, tx_ns);
+}
+
 void chan_dump_state(struct channel *ch)
 {
 	if (!chan_valid(ch)) {
@@ -566,22 +873,19 @@ int wait_for_tx_slot(struct channel *ch)
 {
 	if (!chan_valid(ch))
 		return -EINVAL;
-	uint64_t ts_tai = tai_get_ns();
+	/* account for offload to NIC (launch guard), nc_wait_tai()
+	 * handles wakeup accuracy
+	 */
+	struct nh_tx_guard guard;
+	if (nh_get_tx_guard(ch->nh, ch->sc, &guard))
+		return -EINVAL;
 
 	/* No need to wait */
-	if (ts_tai > ch->next_tx_ns)
+	if (tai_get_ns() + guard.launch_ns > ch->next_tx_ns)
 		return 0;
 
-	struct timespec ts = {
-		.tv_sec = ch->next_tx_ns / 1000000000,
-		.tv_nsec = ch->next_tx_ns % 1000000000,
-	};
-	ts_normalize(&ts);
-
-	/* account for offload to NIC and wakeup accuracy */
-	ts_subtract_ns(&ts, 100000);
-
-	return clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts, NULL);
+	nc_wait_tai(ch->nh, ch->next_tx_ns - guard.launch_ns);
+	return 0;
 }
 
 /* FIXME: Deprecated, only left as placeholder for later */
@@ -607,55 +911,196 @@ int chan_send_now_wait(struct channel *ch, void *data)
 	return ch->ops->send_now_wait(ch, data);
 }
 
-int64_t chan_delay(struct channel *du, uint64_t ptp_target_delay_ns)
+int chan_send_iov(struct channel *ch, uint64_t ts, const struct iovec *iov, int iovcnt,
+		uint64_t *tx_ns)
 {
-	/* Calculate delay
-	 * - take CLOCK_MONOTONIC ts and current PTP Time, find diff between the 2
-	 * - set sleep to ptp_delay ts + monotonic_diff
-	 */
-	uint64_t now_ptp_ns = get_ptp_ts_ns(du->nh->ptp_fd);
-	if (ptp_target_delay_ns < now_ptp_ns)
-		return ptp_target_delay_ns - now_ptp_ns;
+	int res = chan_update_iov(ch, ts, iov, iovcnt);
+	if (res)
+		return res;
+	return chan_send(ch, tx_ns);
+}
 
-	/* NOTE: we assume both clocks run with same rate, i.e. that 1
-	 * ns on PTP is of same length as 1 ns on CPU
-	 */
-	uint64_t rel_delay_ns = ptp_target_delay_ns - now_ptp_ns;
+int chan_send_schedule(struct channel *ch, const struct chan_sample *samples, int n)
+{
+	if (!chan_valid(ch) || !ch->ops || ch->tx_sock < 0 || !samples || n <= 0)
+		return -EINVAL;
+	if (!ch->ops->send_schedule)
+		return -EOPNOTSUPP;
+	return ch->ops->send_schedule(ch, samples, n);
+}
 
-	struct timespec ts_cpu = {0}, ts_wakeup = {0};
-	if (clock_gettime(CLOCK_MONOTONIC, &ts_cpu) == -1) {
-		WARN(du, "%s() FAILED (%d, %s)", __func__, errno, strerror(errno));
-		return -1;
+#define NH_WAIT_MARGIN_INIT_NS	(50 * NS_IN_US)
+#define NH_WAIT_MARGIN_MIN_NS	(5 * NS_IN_US)
+#define NH_WAIT_MARGIN_MAX_NS	(500 * NS_IN_US)
+
+#define NH_GUARD_LAUNCH_MIN_NS	(10 * NS_IN_US)
+#define NH_GUARD_LAUNCH_MAX_NS	(1 * NS_IN_MS)
+#define NH_GUARD_DECAY_SENDS	1000
+
+static uint64_t _nh_ptp_to_tai(struct nethandler *nh, uint64_t ptp_ns, uint64_t tai_now)
+{
+	if (nh->ptp_fd < 0)
+		return ptp_ns;
+
+	if (tai_now - __atomic_load_n(&nh->ptp_tai_offset_ts, __ATOMIC_RELAXED) > NS_IN_SEC) {
+		int64_t offset = get_ptp_ts_ns(nh->ptp_fd) - tai_get_ns();
+		__atomic_store_n(&nh->ptp_tai_offset_ns, offset, __ATOMIC_RELAXED);
+		__atomic_store_n(&nh->ptp_tai_offset_ts, tai_now, __ATOMIC_RELAXED);
+	}
+	return ptp_ns - __atomic_load_n(&nh->ptp_tai_offset_ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * Track sleep overshoot (EWMA, 1/8) and set margin to twice the
+ * average. A single overshoot larger than the margin raises it
+ * immediately, it then decays with the average.
+ */
+static void _nh_wait_calibrate(struct nethandler *nh, uint64_t overshoot_ns)
+{
+	if (nh->tx_guard_fixed)
+		return;
+
+	uint64_t avg = __atomic_load_n(&nh->wait_overshoot_ns, __ATOMIC_RELAXED);
+	avg = avg - avg / 8 + overshoot_ns / 8;
+	__atomic_store_n(&nh->wait_overshoot_ns, avg, __ATOMIC_RELAXED);
+
+	uint64_t margin = 2 * avg + NH_WAIT_MARGIN_MIN_NS;
+	if (overshoot_ns + NH_WAIT_MARGIN_MIN_NS > margin)
+		margin = overshoot_ns + NH_WAIT_MARGIN_MIN_NS;
+	if (margin > NH_WAIT_MARGIN_MAX_NS)
+		margin = NH_WAIT_MARGIN_MAX_NS;
+	__atomic_store_n(&nh->wait_margin_ns, margin, __ATOMIC_RELAXED);
+}
+
+static int64_t _nh_wait_tai(struct nethandler *nh, uint64_t target, uint64_t ptp_target_ns)
+{
+	uint64_t now = tai_get_ns();
+	if (target <= now)
+		return (int64_t)(target - now);
+
+	uint64_t margin = __atomic_load_n(&nh->wait_margin_ns, __ATOMIC_RELAXED);
+	if (target - now > margin) {
+		uint64_t sleep_ns = target - margin;
+		struct timespec ts = {
+			.tv_sec = sleep_ns / NS_IN_SEC,
+			.tv_nsec = sleep_ns % NS_IN_SEC,
+		};
+		while (clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+		now = tai_get_ns();
+		_nh_wait_calibrate(nh, now > sleep_ns ? now - sleep_ns : 0);
 	}
-	ts_cpu.tv_nsec += rel_delay_ns;
-	ts_normalize(&ts_cpu);
-	uint64_t cpu_target_delay_ns = ts_cpu.tv_sec * NS_IN_SEC + ts_cpu.tv_nsec;
 
-	if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts_cpu, NULL) == -1)
-		WARN(du, "%s(): clock_nanosleep failed (%d, %s)", __func__, errno, strerror(errno));
+	while ((now = tai_get_ns()) < target)
+		nc_cpu_relax();
+
+	log_wakeup_delay(nh->logger, ptp_target_ns, target, now);
+	return (int64_t)(target - now);
+}
+
+int64_t nh_wait_until(struct nethandler *nh, uint64_t ptp_target_ns)
+{
+	if (!nh)
+		return 0;
+	return _nh_wait_tai(nh, _nh_ptp_to_tai(nh, ptp_target_ns, tai_get_ns()), ptp_target_ns);
+}
+
+int64_t nc_wait_tai(struct nethandler *nh, uint64_t tai_target_ns)
+{
+	if (!nh)
+		return 0;
+	return _nh_wait_tai(nh, tai_target_ns, tai_target_ns);
+}
+
+static inline uint64_t _guard_clamp(uint64_t v, uint64_t lo, uint64_t hi)
+{
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+void nc_tx_guard_sent(struct nethandler *nh, uint64_t send_ns)
+{
+	if (!nh || nh->tx_guard_fixed)
+		return;
 
-	clock_gettime(CLOCK_MONOTONIC, &ts_wakeup);
-	uint64_t cpu_wakeup_ns = ts_wakeup.tv_sec * NS_IN_SEC + ts_wakeup.tv_nsec;
-	int64_t error_cpu_ns = cpu_target_delay_ns - cpu_wakeup_ns;
+	uint64_t avg = __atomic_load_n(&nh->tas_send_ns, __ATOMIC_RELAXED);
+	avg = avg - avg / 8 + send_ns / 8;
+	__atomic_store_n(&nh->tas_send_ns, avg, __ATOMIC_RELAXED);
 
-	log_wakeup_delay(du->nh->logger, ptp_target_delay_ns, cpu_target_delay_ns, cpu_wakeup_ns);
-	if (du->nh->tb) {
-		tb_tag(du->nh->tb, "_delay(), target=%lu, current=%lu, error=%ld (%s)",
-			ptp_target_delay_ns,
-			cpu_wakeup_ns,
-			error_cpu_ns,
-			error_cpu_ns < 0 ? "late" : "early");
+	/* Send took (almost) all of the guard, raise it right away */
+	uint64_t launch = __atomic_load_n(&nh->tas_launch_ns, __ATOMIC_RELAXED);
+	if (send_ns + NH_GUARD_LAUNCH_MIN_NS > launch) {
+		launch = _guard_clamp(send_ns + NH_GUARD_LAUNCH_MIN_NS,
+				NH_GUARD_LAUNCH_MIN_NS, NH_GUARD_LAUNCH_MAX_NS);
+		__atomic_store_n(&nh->tas_launch_ns, launch, __ATOMIC_RELAXED);
+		return;
 	}
 
-	INFO(du, "%s(): PTP Target: %lu, actual: %lu, error: %.3f (us) (%s)",
-		__func__, cpu_target_delay_ns, cpu_wakeup_ns,
-		1.0 * error_cpu_ns / 1000,
-		error_cpu_ns < 0 ? "late" : "early");
+	/* Decay 1/8 towards floor after a series of sends without drops */
+	if (__atomic_add_fetch(&nh->tas_clean_sends, 1, __ATOMIC_RELAXED) < NH_GUARD_DECAY_SENDS)
+		return;
+	__atomic_store_n(&nh->tas_clean_sends, 0, __ATOMIC_RELAXED);
+	uint64_t floor = _guard_clamp(2 * avg, NH_GUARD_LAUNCH_MIN_NS, NH_GUARD_LAUNCH_MAX_NS);
+	if (launch > floor)
+		__atomic_store_n(&nh->tas_launch_ns, launch - (launch - floor) / 8, __ATOMIC_RELAXED);
+}
+
+void nc_tx_guard_missed(struct nethandler *nh, uint64_t late_ns)
+{
+	if (!nh || nh->tx_guard_fixed)
+		return;
+
+	/* At least +50%, or by how late the frame was */
+	uint64_t launch = __atomic_load_n(&nh->tas_launch_ns, __ATOMIC_RELAXED);
+	launch += late_ns > launch / 2 ? late_ns : launch / 2;
+	__atomic_store_n(&nh->tas_launch_ns,
+			_guard_clamp(launch, NH_GUARD_LAUNCH_MIN_NS, NH_GUARD_LAUNCH_MAX_NS),
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&nh->tas_clean_sends, 0, __ATOMIC_RELAXED);
+}
+
+int nh_get_tx_guard(struct nethandler *nh, enum stream_class sc, struct nh_tx_guard *guard)
+{
+	if (!nh || !guard)
+		return -EINVAL;
 
-	return error_cpu_ns;
+	switch (sc) {
+	case SC_TAS:
+		guard->launch_ns = __atomic_load_n(&nh->tas_launch_ns, __ATOMIC_RELAXED);
+		break;
+	case SC_CLASS_A:
+	case SC_CLASS_B:
+		guard->launch_ns = 0;
+		break;
+	default:
+		return -EINVAL;
+	}
+	guard->wakeup_ns = __atomic_load_n(&nh->wait_margin_ns, __ATOMIC_RELAXED);
+	return 0;
 }
 
+bool nh_set_tx_guard(struct nethandler *nh, const struct nh_tx_guard *guard)
+{
+	if (!nh)
+		return false;
+	if (!guard) {
+		nh->tx_guard_fixed = false;
+		return true;
+	}
+	if (!guard->launch_ns || !guard->wakeup_ns)
+		return false;
+
+	nh->tx_guard_fixed = true;
+	__atomic_store_n(&nh->tas_launch_ns, guard->launch_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&nh->wait_margin_ns, guard->wakeup_ns, __ATOMIC_RELAXED);
+	return true;
+}
 
+int64_t chan_delay(struct channel *du, uint64_t ptp_target_delay_ns)
+{
+	if (!du)
+		return 0;
+	return nh_wait_until(du->nh, ptp_target_delay_ns);
+}
 
 uint64_t chan_time_to_tx(struct channel *ch)
 {
@@ -669,39 +1114,72 @@ uint64_t chan_time_to_tx(struct channel *ch)
 	return tai_now > ch->next_tx_ns ? 0 : ch->next_tx_ns - tai_now;
 }
 
-int _chan_read(struct channel *ch, void *data, bool read_delay)
+int chan_set_tx_budget(struct channel *ch, enum nc_tx_budget policy, uint32_t burst)
 {
-	if (!chan_valid(ch) || ch->stopping)
+	if (!chan_valid(ch) || ch->tx_sock < 0 || ch->sc == SC_TAS)
 		return -EINVAL;
 
-	size_t rpsz = sizeof(struct pipe_meta) + ch->payload_size;
-
-	/*
-	 * Ingress point: Read data from pipe
-	 */
-	int res = read(ch->fd_r, &ch->cbp->meta, rpsz);
-	if (res < 0) {
-		ERROR(ch, "read() from channel FAILED (%d: %s)", errno, strerror(errno));
-		return res;
+	switch (policy) {
+	case NC_BUDGET_OFF:
+	case NC_BUDGET_BLOCK:
+	case NC_BUDGET_DROP:
+		ch->tx_budget = policy;
+		ch->tx_burst = burst;
+		return 0;
 	}
+	return -EINVAL;
+}
 
-	/* See if we have moved to an invalid state while blocking for a
-	 * value (chan_stop() uses this trick to kick us out of a
-	 * blocking read)
-	 */
-	if (!chan_valid(ch))
+int chan_get_tx_budget_stats(struct channel *ch, struct chan_tx_budget_stats *stats)
+{
+	if (!chan_valid(ch) || ch->tx_sock < 0 || ch->sc == SC_TAS || !stats)
 		return -EINVAL;
+	*stats = ch->budget;
+	return 0;
+}
+
+/*
+ * Ingress point: Get oldest sample from ring, block until available.
+ *
+ * See if we have moved to an invalid state while blocking for a value
+ * (chan_stop() closes the ring to kick us out of a blocking read)
+ */
+static struct ring_meta * _chan_read_slot(struct channel *ch)
+{
+	if (!chan_valid(ch) || ch->stopping)
+		return NULL;
 
-	memcpy(data, &ch->cbp->meta.payload, ch->payload_size);
+	/* With NC_DROP_OLDEST/NC_OVERWRITE, the Rx thread may discard the
+	 * slot before we get to claim it, go back to waiting.
+	 */
+	struct ring_meta *slot = NULL;
+	while (!slot) {
+		if (nc_ring_wait(ch->ring) < 0 || !chan_valid(ch))
+			return NULL;
+		slot = nc_ring_acquire(ch->ring);
+	}
+	return slot;
+}
 
+/*
+ * Post-process a sample that has been handed back to the ring.
+ *
+ * Note: if the E2E delay exceeds ftrace_break_us, the nethandler (and
+ * thereby ch) is destroyed!
+ */
+static void _chan_read_done(struct channel *ch,
+			uint64_t ts_recv_ptp_ns,
+			uint32_t avtp_timestamp,
+			bool read_delay)
+{
 	/* Reconstruct PTP capture timestamp from sender */
-	uint64_t lavtp = tai_to_avtp_ns(ch->cbp->meta.ts_recv_ptp_ns);
-	if (lavtp < ch->cbp->meta.avtp_timestamp) {
+	uint64_t lavtp = tai_to_avtp_ns(ts_recv_ptp_ns);
+	if (lavtp < avtp_timestamp) {
 		INFO(ch, "avtp_timestamp wrapped along the way");
 		lavtp += ((uint64_t)1<<32)-1;
 	}
-	int64_t avtp_diff = lavtp - ch->cbp->meta.avtp_timestamp;
-	uint64_t ptp_capture = ch->cbp->meta.ts_recv_ptp_ns - avtp_diff;
+	int64_t avtp_diff = lavtp - avtp_timestamp;
+	uint64_t ptp_capture = ts_recv_ptp_ns - avtp_diff;
 
 	/* track E2E delay if --break is passed */
 	if (ch->nh->ftrace_break_us > 0 && (avtp_diff/1000)  > ch->nh->ftrace_break_us) {
@@ -714,30 +1192,192 @@ int _chan_read(struct channel *ch, void *data, bool read_delay)
 		tb_close(ch->nh->tb);
 		ch->nh->tb = NULL;
 		nh_destroy(&ch->nh);
-		return res;
+		return;
 	}
 
-	/* Extract timing-data from pipe, reconstruct avtp_timestamp,
+	/* Extract timing-data from ring, reconstruct avtp_timestamp,
 	 * find diff since it was sent and calculate offset to determine
 	 * length of sleep before moving on.
 	 */
-	if (read_delay) {
-		int64_t err = chan_delay(ch, ptp_capture + ch->sc);
-		INFO(ch, "%s() Sample spent %ld ns from capture to recvmsg() (reconstructed ts: %lu, missed by %ld ns",
-			__func__, avtp_diff, ptp_capture + ch->sc, err);
-	}
-
-	return res;
+	if (read_delay)
+		nh_wait_until(ch->nh, ptp_capture + get_class_delay_bound_ns(ch));
 }
 
-int chan_read(struct channel *ch, void *data)
+int _chan_read(struct channel *ch, void *data, bool read_delay)
 {
-	return _chan_read(ch, data, false);
+	struct ring_meta *meta = _chan_read_slot(ch);
+	if (!meta)
+		return -EINVAL;
+
+	int res = sizeof(struct ring_meta) + ch->payload_size;
+	memcpy(data, &meta->payload, ch->payload_size);
+	uint64_t ts_recv_ptp_ns = meta->ts_recv_ptp_ns;
+	uint32_t avtp_timestamp = meta->avtp_timestamp;
+	nc_ring_release(ch->ring);
+
+	_chan_read_done(ch, ts_recv_ptp_ns, avtp_timestamp, read_delay);
+	return res;
 }
 
-int chan_read_wait(struct channel *ch, void *data)
+/*
+ * Reader found nothing new, reset readiness fd and ask Rx to signal the
+ * next sample.
+ *
+ * Returns true if the channel was re-armed (caller must look again to
+ * not miss a sample arriving in between), false if it was already
+ * armed or no readiness fd is in use.
+ */
+static bool _chan_rearm(struct channel *ch)
 {
-	return _chan_read(ch, data, true);
+	struct cb_priv *cbp = ch->cbp;
+	if (!cbp || cbp->evfd < 0 || __atomic_load_n(&cbp->armed, __ATOMIC_ACQUIRE))
+		return false;
+
+	eventfd_t val;
+	eventfd_read(cbp->evfd, &val);
+	__atomic_store_n(&cbp->armed, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return true;
+}
+
+/*
+ * Rx side: sample has been published, signal the reader if it is
+ * waiting on the readiness fd. Without a readiness fd, armed is never
+ * set and this is a single load, no fence.
+ *
+ * evfd is stored before the reader can arm (chan_get_fd()) and starts
+ * out readable, so the first wait does not depend on a signal.
+ */
+static inline void _chan_signal(struct cb_priv *cbp)
+{
+	if (__atomic_load_n(&cbp->evfd, __ATOMIC_ACQUIRE) < 0)
+		return;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&cbp->armed, __ATOMIC_RELAXED) &&
+		__atomic_exchange_n(&cbp->armed, 0, __ATOMIC_SEQ_CST))
+		eventfd_write(cbp->evfd, 1);
+}
+
+int chan_read(struct channel *ch, void *data)
+{
+	return _chan_read(ch, data, false);
+}
+
+int chan_read_wait(struct channel *ch, void *data)
+{
+	return _chan_read(ch, data, true);
+}
+
+int chan_try_read(struct channel *ch, void *data)
+{
+	if (!data || !chan_valid(ch) || !ch->ring || ch->stopping)
+		return -EINVAL;
+
+	struct ring_meta *meta = nc_ring_acquire(ch->ring);
+	if (!meta && _chan_rearm(ch))
+		meta = nc_ring_acquire(ch->ring);
+	if (!meta)
+		return -EAGAIN;
+
+	int res = sizeof(struct ring_meta) + ch->payload_size;
+	memcpy(data, &meta->payload, ch->payload_size);
+	uint64_t ts_recv_ptp_ns = meta->ts_recv_ptp_ns;
+	uint32_t avtp_timestamp = meta->avtp_timestamp;
+	nc_ring_release(ch->ring);
+
+	_chan_read_done(ch, ts_recv_ptp_ns, avtp_timestamp, false);
+	return res;
+}
+
+int chan_get_fd(struct channel *ch)
+{
+	if (!chan_valid(ch) || !ch->cbp)
+		return -EINVAL;
+	if (ch->cbp->evfd >= 0)
+		return ch->cbp->evfd;
+
+	/* Start out readable, there may already be samples waiting
+	 * and the first read (finding the channel empty) arms it.
+	 */
+	int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	__atomic_store_n(&ch->cbp->evfd, fd, __ATOMIC_RELEASE);
+	return fd;
+}
+
+const void * chan_read_borrow(struct channel *ch, const struct ring_meta **meta)
+{
+	if (!ch)
+		return NULL;
+
+	struct ring_meta *slot = ch->rx_slot;
+	if (!slot)
+		slot = _chan_read_slot(ch);
+	if (!slot)
+		return NULL;
+
+	ch->rx_slot = slot;
+	if (meta)
+		*meta = slot;
+	return slot->payload;
+}
+
+int chan_read_release(struct channel *ch)
+{
+	if (!ch || !ch->ring || !ch->rx_slot)
+		return -EINVAL;
+
+	uint64_t ts_recv_ptp_ns = ch->rx_slot->ts_recv_ptp_ns;
+	uint32_t avtp_timestamp = ch->rx_slot->avtp_timestamp;
+	ch->rx_slot = NULL;
+	nc_ring_release(ch->ring);
+
+	_chan_read_done(ch, ts_recv_ptp_ns, avtp_timestamp, false);
+	return 0;
+}
+
+int chan_read_latest(struct channel *ch, void *data, struct ring_meta *meta)
+{
+	if (!data || !chan_valid(ch) || !ch->lv)
+		return -EINVAL;
+
+	uint64_t gen;
+	int res = nc_lv_read(ch->lv, meta, sizeof(struct ring_meta), data, &gen);
+	if (res < 0)
+		return res;
+
+	if (gen == ch->lv_gen && _chan_rearm(ch)) {
+		res = nc_lv_read(ch->lv, meta, sizeof(struct ring_meta), data, &gen);
+		if (res < 0)
+			return res;
+	}
+	if (gen == ch->lv_gen)
+		return 0;
+	ch->lv_gen = gen;
+	return 1;
+}
+
+int chan_set_overflow_policy(struct channel *ch, enum nc_overflow_policy policy)
+{
+	if (!ch || !ch->ring)
+		return -EINVAL;
+
+	switch (policy) {
+	case NC_DROP_NEWEST:
+	case NC_DROP_OLDEST:
+	case NC_OVERWRITE:
+		nc_ring_set_overflow(ch->ring, policy);
+		return 0;
+	}
+	return -EINVAL;
+}
+
+uint64_t chan_get_dropped(struct channel *ch)
+{
+	if (!ch)
+		return 0;
+	return nc_ring_dropped(ch->ring);
 }
 
 void * chan_get_payload(struct channel *ch)
@@ -770,6 +1410,8 @@ static unsigned int _get_link_speed_Mbps(struct nethandler *nh)
 	return (unsigned int)ethtool_cmd_speed(&data);
 }
 
+static void _nh_update_rx_filter(struct nethandler *nh);
+
 static int _nh_net_setup(struct nethandler *nh, const char *ifname)
 {
 	if (!nh || !ifname || strlen(ifname) < 1)
@@ -785,7 +1427,23 @@ static int _nh_net_setup(struct nethandler *nh, const char *ifname)
 		return -1;
 	}
 	nh->ifidx = req.ifr_ifindex;
-	nh->is_lo = strncmp(nh->ifname, "lo", 2) == 0;
+	nh->is_lo = strcmp(nh->ifname, "lo") == 0;
+	nh->numa_node = _nh_read_numa_node(nh->ifname);
+
+	nh->rx_flt_prog = nc_rx_filter_create(nh->hmap_sz, &nh->rx_flt_map);
+	if (nh->rx_flt_prog < 0) {
+		WARN(NULL, "%s(): eBPF Rx filter not available (%s), falling back to classic filter " \
+			"(accepts all AVTP frames beyond optmem_max)", __func__, strerror(-nh->rx_flt_prog));
+		nh->rx_flt_map = -1;
+	}
+	_nh_update_rx_filter(nh);
+
+	nh->rx_hwts = nc_enable_rx_hwts(nh->rx_sock, ifname);
+	if (nh->rx_hwts)
+		INFO(NULL, "%s(): using hardware Rx timestamps on %s", __func__, nh->ifname);
+	else
+		WARN(NULL, "%s(): %s has no hardware Rx timestamps, falling back to software " \
+			"timestamps (rx_ns includes driver and softirq delay)", __func__, nh->ifname);
 
 	/* Don't bother about MAC for lo */
 	if (!nh->is_lo) {
@@ -796,29 +1454,6 @@ static int _nh_net_setup(struct nethandler *nh, const char *ifname)
 		}
 		memcpy(nh->mac, req.ifr_hwaddr.sa_data, 6);
 	}
-	/*
-	 * Special case: "lo"
-	 *
-	 * The network-layer will drop incoming frames that originates
-	 * from here meaning if we send a frame to ourselves, it will be
-	 * dropped. Normally this makes sense, but in a testing-scenario
-	 * we may want to feed the system artificial frames to verify
-	 * response.
-	 *
-	 * if nic is indeed 'lo', assume that we are testing, so place
-	 * it in promiscuous mode.
-	 */
-	if (nh->is_lo) {
-		if (ioctl(nh->rx_sock, SIOCGIFFLAGS, &req) == 0) {
-			req.ifr_flags |= IFF_PROMISC;
-			if (ioctl(nh->rx_sock, SIOCSIFFLAGS, &req) == -1) {
-				WARN(NULL, "%s(): Failed placing lo in promiscuous " \
-					"mode, may not receive incoming data (tests may " \
-					"fail)", __func__);
-			}
-		}
-	}
-
 	/*
 	 * Query link speed (need this to ensure that any Tx-channels
 	 * associated with this NIC does not have too short periods)
@@ -831,17 +1466,49 @@ static int _nh_net_setup(struct nethandler *nh, const char *ifname)
 	return 0;
 }
 
+static int _nh_feed_pdu(struct nethandler *nh, struct avtpdu_cshdr *cshdr,
+			uint64_t rx_ns, uint64_t recv_ptp_ns, bool rx_hw);
 
-static void * nh_runner(void *data)
+int nh_feed_frame_ts(struct nethandler *nh, unsigned char *frame,
+		uint64_t rx_ns,
+		uint64_t recv_ptp_ns,
+		bool rx_hw)
 {
-	if (!data)
-		return NULL;
+	if (!nh || !frame)
+		return -EINVAL;
 
-	struct nethandler *nh = (struct nethandler *)data;
-	if (nh->rx_sock <= 0)
-		return NULL;
+	struct ethhdr *hdr = (struct ethhdr *)frame;
+	uint16_t proto = ntohs(hdr->h_proto);
+	unsigned char *next = frame + sizeof(*hdr);
+
+	/* Frames sent via XDP (or NICs without VLAN offload) carry the
+	 * 802.1Q tag inline, skip it.
+	 */
+	if (proto == ETH_P_8021Q) {
+		proto = ntohs(*(uint16_t *)(next + 2));
+		next += 4;
+	}
+	if (proto != ETH_P_TSN)
+		return -EINVAL;
+
+	struct avtpdu_cshdr *du = (struct avtpdu_cshdr *)next;
+	int res = _nh_feed_pdu(nh, du, rx_ns, recv_ptp_ns, rx_hw);
+	if (res == 0) {
+		/*
+		 * We have all the timestamps, so we can
+		 * safely log this /after/ the data has
+		 * been passed on.
+		 *
+		 * Only log for known StreamIDs
+		 */
+		log_rx(nh->logger, du, rx_ns, recv_ptp_ns, rx_hw);
+	}
+	return res;
+}
 
-	unsigned char buffer[1522] = {0};
+static int _nh_rx_recvmsg(struct nethandler *nh, int sock, bool nonblock)
+{
+	unsigned char buffer[1522];
 
 	struct sockaddr_in addr;
 	struct iovec entry = {0};
@@ -862,76 +1529,405 @@ static void * nh_runner(void *data)
 		.msg_controllen = sizeof(control),
 	};
 
-	bool running = true;
-	while (running) {
-
-		int n = recvmsg(nh->rx_sock, &msg, 0);
-		/* grab local timestamp now that we've received a msg */
-		uint64_t recv_ptp_ns = get_ptp_ts_ns(nh->ptp_fd);
-		uint64_t rx_hw_ns = 0;
-		running = nh->running;
-		if (n > 0) {
-			/* Read HW Rx time  */
-			struct cmsghdr *cmsg;
-			for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-				if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
-					struct timespec *stamp = (struct timespec *)CMSG_DATA(cmsg);
-					rx_hw_ns = stamp->tv_sec * 1e9 + stamp->tv_nsec;
-				}
-			}
+	int n = recvmsg(sock, &msg, nonblock ? MSG_DONTWAIT : 0);
+	if (n <= 0)
+		return 0;
 
-			/* parse data */
-			struct ethhdr *hdr = (struct ethhdr *)buffer;
-			struct avtpdu_cshdr *du = (struct avtpdu_cshdr *)((void *)buffer + sizeof(*hdr));
-			if (ntohs(hdr->h_proto) == 0x22f0) {
-				if (nh_feed_pdu_ts(nh, du, rx_hw_ns, recv_ptp_ns) == 0) {
-					/*
-					 * We have all the timestamps, so we can
-					 * safely log this /after/ the data has
-					 * been passed on.
-					 *
-					 * Only log for known StreamIDs
-					 */
-					log_rx(nh->logger, du, rx_hw_ns, recv_ptp_ns);
-				}
-			}
+	/* A raw hardware stamp is already PHC time, so there is no need
+	 * to read the PTP clock for every frame. Otherwise grab local
+	 * timestamp now that we've received a msg.
+	 */
+	bool rx_hw;
+	uint64_t rx_ns = nc_get_rx_ts(&msg, &rx_hw);
+	uint64_t recv_ptp_ns = rx_hw ? rx_ns : get_ptp_ts_ns(nh->ptp_fd);
+
+	nh_feed_frame_ts(nh, buffer, rx_ns, recv_ptp_ns, rx_hw);
+	return 1;
+}
+
+static inline struct tpacket_block_desc *_nh_rx_ring_block(struct nc_rx_ring *ring, unsigned int idx)
+{
+	return (struct tpacket_block_desc *)((uint8_t *)ring->map + (size_t)idx * ring->block_sz);
+}
+
+/*
+ * Walk all blocks the kernel has handed over and feed every frame
+ * straight from the ring. Once a block has been processed, it is
+ * returned to the kernel.
+ *
+ * Returns number of frames fed.
+ */
+static int _nh_rx_ring(struct nethandler *nh, int sock, struct nc_rx_ring *ring, bool nonblock)
+{
+	struct tpacket_block_desc *bd = _nh_rx_ring_block(ring, ring->cur);
+	int frames = 0;
+
+	if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+		if (nonblock)
+			return 0;
+		struct pollfd pfd = {
+			.fd = sock,
+			.events = POLLIN | POLLERR,
+		};
+		/* same timeout as SO_RCVTIMEO on the socket */
+		if (poll(&pfd, 1, 250) <= 0)
+			return 0;
+	}
+
+	while (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+		/* At most one PTP read for the entire block, and none if
+		 * all frames carry a hardware stamp.
+		 */
+		uint64_t block_ptp_ns = 0;
+
+		struct tpacket3_hdr *th = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+		for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+			bool rx_hw = th->tp_status & TP_STATUS_TS_RAW_HARDWARE;
+			uint64_t rx_ns = th->tp_sec * NS_IN_SEC + th->tp_nsec;
+			if (!rx_hw && !block_ptp_ns)
+				block_ptp_ns = get_ptp_ts_ns(nh->ptp_fd);
+			nh_feed_frame_ts(nh, (unsigned char *)th + th->tp_mac, rx_ns,
+					rx_hw ? rx_ns : block_ptp_ns, rx_hw);
+			th = (struct tpacket3_hdr *)((uint8_t *)th + th->tp_next_offset);
+		}
+		frames += bd->hdr.bh1.num_pkts;
+
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		ring->cur = (ring->cur + 1) % ring->block_nr;
+		bd = _nh_rx_ring_block(ring, ring->cur);
+	}
+	return frames;
+}
+
+/*
+ * Wait for frames on both the XSK and the regular Rx socket. Only
+ * registered streams arriving on the bound queue are redirected to the
+ * XSK, the rest still arrives on rx_sock.
+ */
+static int _nh_rx_xdp(struct nethandler *nh)
+{
+	int n = 0;
+	struct pollfd pfd[2] = {
+		{ .fd = nc_xdp_get_fd(nh->xdp), .events = POLLIN, },
+		{ .fd = nh->rx_sock, .events = POLLIN, },
+	};
+
+	/* poll() on the XSK drives the NAPI busy-poll */
+	if (poll(pfd, 2, nh->rx_busy_poll ? 0 : 250) <= 0)
+		return 0;
+
+	if (pfd[0].revents & POLLIN)
+		n += nc_xdp_rx(nh, 0);
+	if (pfd[1].revents & POLLIN) {
+		if (nh->use_rx_ring)
+			n += _nh_rx_ring(nh, nh->rx_sock, &nh->rx_ring, nh->rx_busy_poll);
+		else
+			n += _nh_rx_recvmsg(nh, nh->rx_sock, nh->rx_busy_poll);
+	}
+	return n;
+}
+
+static void * nh_runner(void *data)
+{
+	if (!data)
+		return NULL;
+
+	struct nethandler *nh = (struct nethandler *)data;
+	if (nh->rx_sock <= 0)
+		return NULL;
+
+	while (nh->running && nh->rx_active) {
+		int n;
+		if (nh->uring)
+			n = nc_uring_rx(nh, nh->rx_busy_poll ? 0 : 250);
+		else if (nh->xdp)
+			n = _nh_rx_xdp(nh);
+		else if (nh->use_rx_ring)
+			n = _nh_rx_ring(nh, nh->rx_sock, &nh->rx_ring, nh->rx_busy_poll);
+		else
+			n = _nh_rx_recvmsg(nh, nh->rx_sock, nh->rx_busy_poll);
+
+		nh->rx_spins++;
+		if (!n) {
+			nh->rx_idle++;
+			if (nh->rx_busy_poll)
+				nc_cpu_relax();
+		}
+	}
+	return NULL;
+}
+
+/* Fanout worker (socket index) for a stream class, -1 if unknown */
+static inline int _nh_rxw_idx(enum stream_class sc)
+{
+	switch (sc) {
+	case SC_TAS:
+		return 0;
+	case SC_CLASS_A:
+		return 1;
+	case SC_CLASS_B:
+		return 2;
+	}
+	return -1;
+}
+
+/* Frames not belonging to a known class go to the class B worker */
+#define NH_RXW_DEFAULT	2
+
+static void * _nh_rx_worker(void *data)
+{
+	struct nh_rx_worker *w = data;
+	struct nethandler *nh = w->nh;
+
+	while (nh->running && nh->rx_active) {
+		int n;
+		if (nh->use_rx_ring)
+			n = _nh_rx_ring(nh, w->sock, &w->ring, nh->rx_busy_poll);
+		else
+			n = _nh_rx_recvmsg(nh, w->sock, nh->rx_busy_poll);
+		w->frames += n;
+
+		w->spins++;
+		if (!n) {
+			w->idle++;
+			if (nh->rx_busy_poll)
+				nc_cpu_relax();
 		}
 	}
 	return NULL;
 }
 
 /*
- * nh_start_rx - start receiver thread
- *
- * This will filter out and grab all TSN ethertype frames coming in on
- * the socket. PDUs will known StreamIDs will be fed to registred
- * callbacks.
+ * Parse a sysfs cpulist (e.g. "0-3,8-11"), returns false if empty
+ */
+static bool _nh_parse_cpulist(const char *buf, cpu_set_t *cs)
+{
+	CPU_ZERO(cs);
+	const char *p = buf;
+	while (*p && *p != '\n') {
+		char *end;
+		long lo = strtol(p, &end, 10);
+		long hi = lo;
+		if (end == p)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+			CPU_SET(c, cs);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return CPU_COUNT(cs) > 0;
+}
+
+/* CPUs local to the NIC, from sysfs */
+static bool _nh_numa_cpus(struct nethandler *nh, cpu_set_t *cs)
+{
+	char path[128];
+	char buf[256] = {0};
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/local_cpulist", nh->ifname);
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+	bool res = fgets(buf, sizeof(buf), fp) != NULL;
+	fclose(fp);
+	return res && _nh_parse_cpulist(buf, cs);
+}
+
+/*
+ * CPUs a thread should run on, cpu if set, otherwise the NIC's local
+ * CPUs if NUMA placement is enabled. Returns false (and all CPUs in cs)
+ * if the thread is not restricted.
+ */
+static bool _nh_thread_cpus(struct nethandler *nh, int cpu, cpu_set_t *cs)
+{
+	CPU_ZERO(cs);
+	if (cpu >= 0) {
+		CPU_SET(cpu, cs);
+		return true;
+	}
+	if (nh->use_numa && _nh_numa_cpus(nh, cs))
+		return true;
+
+	for (int c = 0; c < CPU_SETSIZE; c++)
+		CPU_SET(c, cs);
+	return false;
+}
+
+int nh_create_thread(struct nethandler *nh, pthread_t *tid, void *(*fn)(void *), void *arg,
+		int sched_prio, int cpu)
+{
+	if (!nh || !tid || !fn)
+		return -EINVAL;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if (sched_prio > 0) {
+		struct sched_param sp = { .sched_priority = sched_prio };
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &sp);
+	}
+
+	cpu_set_t cs;
+	if (_nh_thread_cpus(nh, cpu, &cs))
+		pthread_attr_setaffinity_np(&attr, sizeof(cs), &cs);
+
+	int res = pthread_create(tid, &attr, fn, arg);
+	if (res == EPERM && sched_prio > 0) {
+		WARN(NULL, "%s(): not permitted to use SCHED_FIFO (prio %d), using default policy",
+			__func__, sched_prio);
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		res = pthread_create(tid, &attr, fn, arg);
+	}
+	pthread_attr_destroy(&attr);
+	return -res;
+}
+
+/*
+ * Change policy and affinity of a running thread
  *
- * @param nh nethandler container
- * @returns 0 on success, negative on error
+ * @returns 0 on success, negative errno on error
+ */
+static int _nh_place_thread(struct nethandler *nh, pthread_t tid, int sched_prio, int cpu)
+{
+	struct sched_param sp = { .sched_priority = sched_prio };
+	int res = pthread_setschedparam(tid, sched_prio > 0 ? SCHED_FIFO : SCHED_OTHER, &sp);
+	if (res)
+		return -res;
+
+	cpu_set_t cs;
+	_nh_thread_cpus(nh, cpu, &cs);
+	return -pthread_setaffinity_np(tid, sizeof(cs), &cs);
+}
+
+/* CPU of the Rx thread, busy-polling may move it (nh_set_rx_busy_poll()) */
+static int _nh_rx_thread_cpu(struct nethandler *nh)
+{
+	if (nh->rx_busy_poll && nh->rx_busy_cpu >= 0)
+		return nh->rx_busy_cpu;
+	return nh->rx_cpu;
+}
+
+static void _nh_join_rx(struct nethandler *nh);
+
+/* Add fd to the poll set, it may already be there after a restart */
+static int _nh_poll_add(struct nethandler *nh, int fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.fd = fd,
+	};
+	if (epoll_ctl(nh->poll_fd, EPOLL_CTL_ADD, fd, &ev) && errno != EEXIST) {
+		ERROR(NULL, "%s(): failed adding fd %d to poll set (%s)", __func__, fd, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * No Rx thread in poll mode, (re)build the poll set so that nh_poll()
+ * and the caller's own epoll see the current set of sockets.
  */
+static int _nh_start_poll(struct nethandler *nh)
+{
+	if (nh->use_rx_fanout) {
+		ERROR(NULL, "%s(): Rx fanout not available in poll mode", __func__);
+		return -1;
+	}
+
+	if (nh->poll_fd < 0) {
+		nh->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (nh->poll_fd < 0) {
+			ERROR(NULL, "%s(): failed creating poll fd (%s)", __func__, strerror(errno));
+			return -1;
+		}
+	}
+
+	/* io_uring takes over rx_sock, wait for its completions instead.
+	 * The receive is armed here, on the thread that will call
+	 * nh_poll().
+	 */
+	if (nh->uring) {
+		epoll_ctl(nh->poll_fd, EPOLL_CTL_DEL, nh->rx_sock, NULL);
+		if (_nh_poll_add(nh, nc_uring_get_fd(nh->uring)))
+			return -1;
+		nc_uring_rx(nh, 0);
+		return 0;
+	}
+
+	if (_nh_poll_add(nh, nh->rx_sock))
+		return -1;
+	if (nh->xdp && _nh_poll_add(nh, nc_xdp_get_fd(nh->xdp)))
+		return -1;
+	return 0;
+}
+
 static int _nh_start_rx(struct nethandler *nh)
 {
 	nh->running = true;
+	nh->rx_active = true;
+
+	if (nh->poll_mode) {
+		if (_nh_start_poll(nh)) {
+			nh->rx_active = false;
+			nh->running = false;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (nh->use_rx_fanout) {
+		for (int i = 0; i < NH_RX_WORKERS; i++) {
+			struct nh_rx_worker *w = &nh->rxw[i];
+			int res = nh_create_thread(nh, &w->tid, _nh_rx_worker, w, w->sched_prio, w->cpu);
+			if (res) {
+				ERROR(NULL, "%s(): failed starting Rx worker %d (%s)", __func__, i, strerror(-res));
+				w->tid = 0;
+				_nh_join_rx(nh);
+				nh->running = false;
+				return -1;
+			}
+		}
+		return 0;
+	}
 
-	if (pthread_create(&nh->tid, NULL, nh_runner, nh)) {
+	if (nh_create_thread(nh, &nh->tid, nh_runner, nh, nh->rx_sched_prio, _nh_rx_thread_cpu(nh))) {
 		nh->tid = 0;
+		nh->rx_active = false;
 		nh->running = false;
 		return -1;
 	}
 	return 0;
 }
 
-static void _nh_stop_rx(struct nethandler *nh)
+/*
+ * Stop and join the Rx thread, but leave the nethandler running so
+ * that the thread can be restarted with a different backend.
+ */
+static void _nh_join_rx(struct nethandler *nh)
 {
-	if (nh && nh->running) {
-		nh->running = false;
+	if (nh && nh->rx_active) {
+		nh->rx_active = false;
 		if (nh->tid > 0) {
 			/* once timeout expires, join */
 			pthread_join(nh->tid, NULL);
 			nh->tid = 0;
-			nh->rx_sock = -1;
 		}
+		for (int i = 0; i < NH_RX_WORKERS; i++) {
+			if (nh->rxw[i].tid > 0) {
+				pthread_join(nh->rxw[i].tid, NULL);
+				nh->rxw[i].tid = 0;
+			}
+		}
+	}
+}
+
+static void _nh_stop_rx(struct nethandler *nh)
+{
+	if (nh && nh->running) {
+		nh->running = false;
+		_nh_join_rx(nh);
 	}
 }
 
@@ -962,7 +1958,8 @@ static int _nh_enable_rt_measures(struct nethandler *nh)
 	return res;
 }
 
-struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const char *logfile)
+static struct nethandler * _nh_create(const char *ifname, size_t hmap_size, const char *logfile,
+				bool poll_mode, bool no_phc)
 {
 	if (!ifname || !hmap_size)
 		return NULL;
@@ -970,15 +1967,58 @@ struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const c
 	struct nethandler *nh = calloc(sizeof(*nh), 1);
 	if (!nh)
 		return NULL;
+	nh->rx_sock = -1;
+	nh->rx_flt_prog = -1;
+	nh->rx_flt_map = -1;
+	nh->poll_mode = poll_mode;
+	nh->poll_fd = -1;
+	/* Conservative seeds, both margins follow the observed latency
+	 * from the first wait/send (see _nh_wait_calibrate() and
+	 * nc_tx_guard_sent()). The overshoot average matches the seeded
+	 * margin so that the first samples do not collapse it.
+	 */
+	nh->wait_margin_ns = NH_WAIT_MARGIN_INIT_NS;
+	nh->wait_overshoot_ns = (NH_WAIT_MARGIN_INIT_NS - NH_WAIT_MARGIN_MIN_NS) / 2;
+	nh->tas_launch_ns = 5 * NH_GUARD_LAUNCH_MIN_NS;
 	nh->tx_tas_sock_prio = DEFAULT_TX_TAS_SOCKET_PRIO;
 	nh->tx_cbs_sock_prio = DEFAULT_TX_CBS_SOCKET_PRIO;
+	nh->promisc = true;
+	nh->rx_cpu = -1;
+	nh->rx_busy_cpu = -1;
+	nh->srp_cpu = -1;
+	for (int i = 0; i < NH_RX_WORKERS; i++) {
+		nh->rxw[i].nh = nh;
+		nh->rxw[i].sock = -1;
+		nh->rxw[i].cpu = -1;
+	}
+	/* Power of 2 number of buckets with room for 2x hmap_size
+	 * streams to keep probe sequences short.
+	 */
+	size_t buckets = 1;
+	while (buckets * NH_BUCKET_SLOTS < 2 * hmap_size)
+		buckets <<= 1;
 	nh->hmap_sz = hmap_size;
-	nh->hmap = calloc(sizeof(struct cb_entity), nh->hmap_sz);
-	if (!nh->hmap) {
+	nh->hmap_mask = buckets - 1;
+
+	/* Buckets, their callbacks and both small tables share one
+	 * anonymous mapping (zeroed, page aligned) so that nh_set_numa()
+	 * can move the hot Rx lookup data without dragging neighbouring
+	 * heap objects.
+	 */
+	size_t hmap_len = buckets * sizeof(struct nh_bucket);
+	size_t ent_len = buckets * NH_BUCKET_SLOTS * sizeof(struct cb_entity);
+	ent_len = (ent_len + __alignof__(struct nh_bucket) - 1) & ~(__alignof__(struct nh_bucket) - 1);
+	nh->hmap_map_sz = hmap_len + ent_len + 2 * sizeof(struct nh_small);
+	void *map = mmap(NULL, nh->hmap_map_sz, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
 		free(nh);
 		nh = NULL;
 		goto out;
 	}
+	nh->hmap = map;
+	nh->hm_ent = (struct cb_entity *)((uint8_t *)map + hmap_len);
+	nh->hm_small_buf = (struct nh_small *)((uint8_t *)map + hmap_len + ent_len);
 
 	if (_nh_net_setup(nh, ifname)) {
 		ERROR(NULL, "%s(): failed setting up network, aborting", __func__);
@@ -1018,40 +2058,445 @@ struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const c
 	 * knows their hardware?)
 	 */
 	nh->ptp_fd = get_ptp_fd(ifname);
-	if (nh->ptp_fd < 0 && !nh->is_lo) {
+	if (nh->ptp_fd < 0 && !nh->is_lo && !no_phc) {
 		ERROR(NULL, "%s(): failed getting FD for PTP on %s (%s), aborting.",
 			__func__, ifname, strerror(errno));
 		nh_destroy(&nh);
 		goto out;
 	}
+	if (nh->ptp_fd < 0 && !nh->is_lo)
+		WARN(NULL, "%s(): no PHC on %s, using CLOCK_TAI as PTP time", __func__, ifname);
 
 out:
 	return nh;
 }
 
+struct nethandler * nh_create_init(const char *ifname, size_t hmap_size, const char *logfile)
+{
+	return _nh_create(ifname, hmap_size, logfile, false, false);
+}
+
+struct nethandler * nh_create_init_poll(const char *ifname, size_t hmap_size, const char *logfile)
+{
+	return _nh_create(ifname, hmap_size, logfile, true, false);
+}
+
+struct nethandler * nh_create_init_nophc(const char *ifname, size_t hmap_size, const char *logfile)
+{
+	return _nh_create(ifname, hmap_size, logfile, false, true);
+}
+
+int nh_get_fd(struct nethandler *nh)
+{
+	if (!nh || !nh->poll_mode || nh->poll_fd < 0)
+		return -EINVAL;
+	return nh->poll_fd;
+}
+
+int nh_poll(struct nethandler *nh, int timeout_ms)
+{
+	if (!nh || !nh->poll_mode || nh->poll_fd < 0)
+		return -EINVAL;
+
+	struct epoll_event ev[2];
+	int nev = epoll_wait(nh->poll_fd, ev, 2, timeout_ms);
+	if (nev < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	/* Level triggered, whatever is left after the budget is
+	 * reported again on the next call.
+	 */
+	int n = 0;
+	for (int i = 0; i < nev; i++) {
+		int fd = ev[i].data.fd;
+		if (nh->xdp && fd == nc_xdp_get_fd(nh->xdp)) {
+			int res = nc_xdp_rx(nh, 0);
+			if (res > 0)
+				n += res;
+		} else if (nh->uring && fd == nc_uring_get_fd(nh->uring)) {
+			int res = nc_uring_rx(nh, 0);
+			if (res > 0)
+				n += res;
+		} else if (nh->use_rx_ring) {
+			n += _nh_rx_ring(nh, fd, &nh->rx_ring, true);
+		} else {
+			for (int b = 0; b < NH_POLL_BUDGET; b++) {
+				int res = _nh_rx_recvmsg(nh, fd, true);
+				if (!res)
+					break;
+				n += res;
+			}
+		}
+	}
+	return n;
+}
+
+/*
+ * 64 bit finalizer from MurmurHash3, StreamIDs are typically MAC +
+ * small index, so spread all bits before masking.
+ */
+static inline uint64_t _nh_mix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/*
+ * Compare sid against 8 keys at once.
+ *
+ * Returns index+1 of the matching key or 0 if no match. Keys are unique,
+ * so at most one lane is set and the lanes can be OR'ed together. A 0 in
+ * hi_idx masks the lane (the overflow word of a bucket).
+ */
+typedef uint64_t nh_v4u64 __attribute__((vector_size(32)));
+static inline int _nh_match(const uint64_t *keys, uint64_t sid, const nh_v4u64 *hi_idx)
+{
+	static const nh_v4u64 lo_idx = {1, 2, 3, 4};
+	nh_v4u64 lo, hi;
+	nh_v4u64 k = {sid, sid, sid, sid};
+
+	memcpy(&lo, keys, sizeof(lo));
+	memcpy(&hi, keys + 4, sizeof(hi));
+	nh_v4u64 m = ((nh_v4u64)(lo == k) & lo_idx) | ((nh_v4u64)(hi == k) & *hi_idx);
+	return (int)(m[0] | m[1] | m[2] | m[3]);
+}
+
+static inline int _nh_match_small(const struct nh_small *small, uint64_t sid)
+{
+	static const nh_v4u64 hi_idx = {5, 6, 7, 8};
+	return _nh_match(small->sid, sid, &hi_idx);
+}
+
+static inline int _nh_match_bucket(const struct nh_bucket *bkt, uint64_t sid)
+{
+	static const nh_v4u64 hi_idx = {5, 6, 7, 0};
+	return _nh_match(bkt->sid, sid, &hi_idx);
+}
+
+static inline struct cb_entity * _nh_ent(struct nethandler *nh, uint32_t b, int slot)
+{
+	return &nh->hm_ent[(size_t)b * NH_BUCKET_SLOTS + slot];
+}
+
+static struct cb_entity * _nh_lookup(struct nethandler *nh, uint64_t stream_id)
+{
+	if (!nh || !nh->hmap || !stream_id)
+		return NULL;
+
+	/* Few streams, skip hashing and compare against all */
+	struct nh_small *small = __atomic_load_n(&nh->hm_small, __ATOMIC_ACQUIRE);
+	if (small) {
+		int i = _nh_match_small(small, stream_id);
+		return i ? small->ent[i - 1] : NULL;
+	}
+
+	uint32_t b = _nh_mix64(stream_id) & nh->hmap_mask;
+	for (uint32_t i = 0; i <= nh->hmap_mask; i++) {
+		struct nh_bucket *bkt = &nh->hmap[b];
+		int slot = _nh_match_bucket(bkt, stream_id);
+		if (slot) {
+			/* pairs with release of sid in nh_reg_callback() */
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			return _nh_ent(nh, b, slot - 1);
+		}
+		if (!bkt->overflow)
+			break;
+		b = (b + 1) & nh->hmap_mask;
+	}
+	return NULL;
+}
+
+static inline uint32_t _nh_rx_enter(struct nethandler *nh)
+{
+	uint32_t e = __atomic_load_n(&nh->rx_epoch, __ATOMIC_RELAXED) & 1;
+	__atomic_fetch_add(&nh->rx_readers[e], 1, __ATOMIC_SEQ_CST);
+	return e;
+}
+
+static inline void _nh_rx_exit(struct nethandler *nh, uint32_t e)
+{
+	__atomic_fetch_sub(&nh->rx_readers[e], 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Wait until every Rx thread that may have looked up an entry before
+ * it was removed (or found an old copy of hm_small) has returned from
+ * the callback. New lookups use the other reader count after the flip
+ * and see the removal.
+ *
+ * Must not be called from an Rx callback.
+ */
+static void _nh_rx_synchronize(struct nethandler *nh)
+{
+	uint32_t e = __atomic_fetch_add(&nh->rx_epoch, 1, __ATOMIC_SEQ_CST) & 1;
+	while (__atomic_load_n(&nh->rx_readers[e], __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+/*
+ * Keep a dense copy of all StreamIDs as long as they fit in a single
+ * compare. The copy not published is rebuilt, once the Rx threads
+ * are done with it, and then swapped in.
+ */
+static void _nh_small_rebuild(struct nethandler *nh)
+{
+	if (!nh->hm_small_buf)
+		return;
+	if (nh->hmap_cnt > NH_SMALL_SLOTS) {
+		__atomic_store_n(&nh->hm_small, NULL, __ATOMIC_RELEASE);
+		return;
+	}
+
+	uint32_t idx = nh->hm_small_idx ^ 1;
+	struct nh_small *next = &nh->hm_small_buf[idx];
+	_nh_rx_synchronize(nh);
+
+	memset(next, 0, sizeof(*next));
+	for (uint32_t b = 0; b <= nh->hmap_mask; b++) {
+		for (int i = 0; i < NH_BUCKET_SLOTS; i++) {
+			if (!nh->hmap[b].sid[i])
+				continue;
+			next->sid[next->n] = nh->hmap[b].sid[i];
+			next->ent[next->n] = _nh_ent(nh, b, i);
+			next->n++;
+		}
+	}
+	__atomic_store_n(&nh->hm_small, next->n ? next : NULL, __ATOMIC_RELEASE);
+	nh->hm_small_idx = idx;
+}
+
+/*
+ * Regenerate the fanout program, mapping either the StreamID of each Rx
+ * channel or the PCP of each stream class to the worker for that class.
+ */
+static int _nh_update_fanout(struct nethandler *nh)
+{
+	int sock = nh->rxw[0].sock;
+
+	if (nh->fanout_key == NH_FANOUT_PCP) {
+		if (!nh->srp)
+			return -EINVAL;
+		uint8_t pcp_worker[8];
+		for (int p = 0; p < 8; p++)
+			pcp_worker[p] = NH_RXW_DEFAULT;
+		pcp_worker[nh->srp->prio_tas & 0x7] = _nh_rxw_idx(SC_TAS);
+		pcp_worker[nh->srp->prio_a & 0x7] = _nh_rxw_idx(SC_CLASS_A);
+		pcp_worker[nh->srp->prio_b & 0x7] = _nh_rxw_idx(SC_CLASS_B);
+		return nc_set_fanout_pcp(sock, pcp_worker, NH_RXW_DEFAULT);
+	}
+
+	int n = nh_get_num_rx(nh);
+	uint64_t *sids = calloc(n ? n : 1, sizeof(uint64_t));
+	uint8_t *worker = calloc(n ? n : 1, sizeof(uint8_t));
+	int res = -ENOMEM;
+	if (sids && worker) {
+		int i = 0;
+		for (struct channel *ch = nh->du_rx_head; ch && i < n; ch = ch->next, i++) {
+			int w = _nh_rxw_idx(ch->sc);
+			sids[i] = ch->sidw.s64;
+			worker[i] = w < 0 ? NH_RXW_DEFAULT : w;
+		}
+		res = nc_set_fanout_sid(sock, sids, worker, i, NH_RXW_DEFAULT);
+	}
+	free(sids);
+	free(worker);
+	return res;
+}
+
+static void _nh_refresh_fanout(struct nethandler *nh)
+{
+	if (!nh->use_rx_fanout)
+		return;
+	int res = _nh_update_fanout(nh);
+	if (res)
+		WARN(NULL, "%s(): failed updating fanout program (%s), frames may be handled by wrong worker",
+			__func__, strerror(-res));
+}
+
+/*
+ * Can frames for stream_id be handed to fanout worker w?
+ *
+ * Channels go to the worker of their class, both by StreamID and by
+ * PCP. Callbacks without a channel go to the default worker by
+ * StreamID, but their PCP is unknown so by PCP any worker may see them.
+ */
+static bool _nh_sid_on_worker(struct nethandler *nh, uint64_t stream_id, int w)
+{
+	for (struct channel *ch = nh->du_rx_head; ch; ch = ch->next) {
+		if (ch->sidw.s64 == stream_id) {
+			int cw = _nh_rxw_idx(ch->sc);
+			return (cw < 0 ? NH_RXW_DEFAULT : cw) == w;
+		}
+	}
+	return nh->fanout_key == NH_FANOUT_PCP || w == NH_RXW_DEFAULT;
+}
+
+/*
+ * Attach the eBPF filter to rx_sock and the fanout workers, or, without
+ * it, regenerate the classic filter from the dispatch table so that
+ * only frames for registered streams are copied to userspace.
+ */
+static void _nh_update_rx_filter(struct nethandler *nh)
+{
+	if (nh->rx_sock < 0)
+		return;
+
+	int res;
+	if (nh->rx_flt_prog >= 0) {
+		/* With fanout, the workers receive everything and
+		 * rx_sock is only kept for control */
+		if (nh->use_rx_fanout)
+			res = nc_set_rx_filter(nh->rx_sock, NULL, 0);
+		else
+			res = nc_rx_filter_attach(nh->rx_sock, nh->rx_flt_prog);
+		if (res)
+			WARN(NULL, "%s(): failed updating Rx filter (%s)", __func__, strerror(-res));
+		for (int i = 0; nh->use_rx_fanout && i < NH_RX_WORKERS; i++) {
+			res = nc_rx_filter_attach(nh->rxw[i].sock, nh->rx_flt_prog);
+			if (res)
+				WARN(NULL, "%s(): failed updating Rx filter for worker %d (%s)",
+					__func__, i, strerror(-res));
+		}
+		_nh_refresh_fanout(nh);
+		return;
+	}
+
+	uint64_t *sids = calloc(nh->hmap_cnt ? nh->hmap_cnt : 1, sizeof(uint64_t));
+	if (!sids)
+		return;
+
+	int n = 0;
+	for (uint32_t b = 0; b <= nh->hmap_mask; b++) {
+		for (int i = 0; i < NH_BUCKET_SLOTS; i++) {
+			if (nh->hmap[b].sid[i])
+				sids[n++] = nh->hmap[b].sid[i];
+		}
+	}
+
+	res = nc_set_rx_filter(nh->rx_sock, sids, nh->use_rx_fanout ? 0 : n);
+	if (res)
+		WARN(NULL, "%s(): failed updating Rx filter (%s)", __func__, strerror(-res));
+
+	/* Each worker only lists the streams fanout hands to it */
+	uint64_t *wsids = nh->use_rx_fanout ? calloc(n ? n : 1, sizeof(uint64_t)) : NULL;
+	for (int w = 0; wsids && w < NH_RX_WORKERS; w++) {
+		int wn = 0;
+		for (int i = 0; i < n; i++) {
+			if (_nh_sid_on_worker(nh, sids[i], w))
+				wsids[wn++] = sids[i];
+		}
+		res = nc_set_rx_filter(nh->rxw[w].sock, wsids, wn);
+		if (res)
+			WARN(NULL, "%s(): failed updating Rx filter for worker %d (%s)",
+				__func__, w, strerror(-res));
+	}
+	_nh_refresh_fanout(nh);
+	free(wsids);
+	free(sids);
+}
+
+/*
+ * Add or remove a single stream from the Rx filter. With the eBPF
+ * filter this is one map update, the program stays attached.
+ */
+static void _nh_rx_filter_sid(struct nethandler *nh, uint64_t stream_id, bool add)
+{
+	if (nh->rx_flt_map < 0) {
+		_nh_update_rx_filter(nh);
+		return;
+	}
+
+	int res = add ? nc_rx_filter_add(nh->rx_flt_map, stream_id) :
+		nc_rx_filter_del(nh->rx_flt_map, stream_id);
+	if (res)
+		WARN(NULL, "%s(): failed %s 0x%016"PRIx64" in Rx filter (%s)",
+			__func__, add ? "adding" : "removing", stream_id, strerror(-res));
+	_nh_refresh_fanout(nh);
+}
+
 int nh_reg_callback(struct nethandler *nh,
 		uint64_t stream_id,
 		void *priv_data,
 		int (*cb)(void *priv_data, struct avtpdu_cshdr *du))
 {
-	if (!nh || !nh->hmap_sz || !cb)
+	if (!nh || !nh->hmap || !cb || !stream_id)
 		return -EINVAL;
 
-	int idx = stream_id % nh->hmap_sz;
-
-	for (int i = 0; i < nh->hmap_sz && nh->hmap[idx].cb; i++)
-		idx = (idx + 1) % nh->hmap_sz;
+	if (_nh_lookup(nh, stream_id))
+		return -EEXIST;
 
 	/* Hashmap is full */
-	if (nh->hmap[idx].cb)
+	if (nh->hmap_cnt >= nh->hmap_sz)
 		return -ENOMEM;
 
-	nh->hmap[idx].stream_id = stream_id;
-	nh->hmap[idx].priv_data = priv_data;
-	nh->hmap[idx].cb = cb;
+	/* Table is sized to 2x hmap_sz, a free slot is guaranteed */
+	uint32_t b = _nh_mix64(stream_id) & nh->hmap_mask;
+	for (;;) {
+		struct nh_bucket *bkt = &nh->hmap[b];
+		int slot = 0;
+		while (slot < NH_BUCKET_SLOTS && bkt->sid[slot])
+			slot++;
+		if (slot < NH_BUCKET_SLOTS) {
+			struct cb_entity *ent = _nh_ent(nh, b, slot);
+			__atomic_store_n(&ent->priv_data, priv_data, __ATOMIC_RELAXED);
+			__atomic_store_n(&ent->cb, cb, __ATOMIC_RELAXED);
+			__atomic_store_n(&bkt->sid[slot], stream_id, __ATOMIC_RELEASE);
+			break;
+		}
+		bkt->overflow++;
+		b = (b + 1) & nh->hmap_mask;
+	}
+	nh->hmap_cnt++;
+	_nh_small_rebuild(nh);
+	_nh_rx_filter_sid(nh, stream_id, true);
+
+	if (nh->xdp && nc_xdp_add_stream(nh->xdp, stream_id))
+		WARN(NULL, "%s(): failed adding 0x%016"PRIx64" to XDP filter, frames will arrive via Rx socket",
+			__func__, stream_id);
 	return 0;
 }
 
+int nh_unreg_callback(struct nethandler *nh, uint64_t stream_id)
+{
+	if (!nh || !nh->hmap || !stream_id)
+		return -EINVAL;
+
+	uint32_t home = _nh_mix64(stream_id) & nh->hmap_mask;
+	uint32_t b = home;
+	for (uint32_t i = 0; i <= nh->hmap_mask; i++) {
+		struct nh_bucket *bkt = &nh->hmap[b];
+		int slot = _nh_match_bucket(bkt, stream_id);
+		if (slot) {
+			struct cb_entity *ent = _nh_ent(nh, b, slot - 1);
+			__atomic_store_n(&bkt->sid[slot - 1], 0, __ATOMIC_RELEASE);
+			__atomic_store_n(&ent->cb, NULL, __ATOMIC_RELAXED);
+			__atomic_store_n(&ent->priv_data, NULL, __ATOMIC_RELAXED);
+
+			/* Undo the overflow marks left when inserting */
+			for (uint32_t j = home; j != b; j = (j + 1) & nh->hmap_mask)
+				nh->hmap[j].overflow--;
+
+			nh->hmap_cnt--;
+			_nh_small_rebuild(nh);
+			_nh_rx_filter_sid(nh, stream_id, false);
+			if (nh->xdp)
+				nc_xdp_del_stream(nh->xdp, stream_id);
+
+			/* Caller may free priv_data when we return */
+			_nh_rx_synchronize(nh);
+			return 0;
+		}
+		if (!bkt->overflow)
+			break;
+		b = (b + 1) & nh->hmap_mask;
+	}
+	return -ENOENT;
+}
+
 /*
  * we arrive here from nh_feed_pdu_ts()
  */
@@ -1061,66 +2506,85 @@ int nh_std_cb(void *priv, struct avtpdu_cshdr *du)
 		return -EINVAL;
 
 	struct cb_priv *cbp = (struct cb_priv *)priv;
-	if (cbp->fd <= 0)
+	if (!cbp->ring)
 		return -EINVAL;
 
-	/* copy payload in du into payload in pipe_meta */
+	/* Never block the Rx thread on a slow reader, the ring's
+	 * overflow policy decides what to discard (and counts it).
+	 */
+	struct ring_meta *slot = nc_ring_reserve(cbp->ring);
+	if (!slot)
+		return -ENOSPC;
+
+	/* copy metadata and payload in du directly into the slot */
 	void *payload = (void *)du + sizeof(*du);
-	memcpy(&cbp->meta.payload, payload, cbp->sz);
+	memcpy(slot, &cbp->meta, sizeof(*slot));
+	memcpy(&slot->payload, payload, cbp->sz);
 
 	/*
 	 * Egress-point: Publish data to awaiting listener
 	 */
-	int wsz = write(cbp->fd, (void *)&cbp->meta, sizeof(struct pipe_meta) + cbp->sz);
-	if (wsz == -1) {
-		perror("Failed writing to fifo");
-		return -EINVAL;
-	}
+	nc_ring_commit(cbp->ring);
+	_chan_signal(cbp);
 
 	return 0;
 }
 
 
-static int get_hm_idx(struct nethandler *nh, uint64_t stream_id)
+int nh_lv_cb(void *priv, struct avtpdu_cshdr *du)
 {
-	if (!nh)
-		return -ENOMEM;
-
-	int idx = stream_id % nh->hmap_sz;
-	for (int i = 0; i < nh->hmap_sz; i++) {
-		if (nh->hmap[idx].stream_id == stream_id && nh->hmap[idx].cb)
-			return idx;
+	if (!priv || !du)
+		return -EINVAL;
 
-		idx = (idx + 1) % nh->hmap_sz;
-	}
-	return -1;
-}
+	struct cb_priv *cbp = (struct cb_priv *)priv;
+	if (!cbp->lv)
+		return -EINVAL;
 
+	struct ring_meta *latest = nc_lv_begin(cbp->lv);
+	memcpy(latest, &cbp->meta, sizeof(*latest));
+	memcpy(&latest->payload, (void *)du + sizeof(*du), cbp->sz);
+	nc_lv_publish(cbp->lv);
+	_chan_signal(cbp);
 
-int nh_feed_pdu_ts(struct nethandler *nh, struct avtpdu_cshdr *cshdr,
-		uint64_t rx_hw_ns,
-		uint64_t recv_ptp_ns)
+	return 0;
+}
+
+static int _nh_feed_pdu(struct nethandler *nh, struct avtpdu_cshdr *cshdr,
+			uint64_t rx_ns, uint64_t recv_ptp_ns, bool rx_hw)
 {
 	if (!nh || !cshdr)
 		return -EINVAL;
-	int idx = get_hm_idx(nh, be64toh(cshdr->stream_id));
 
-	tb_tag(nh->tb, "feed_pdu_ts, feed to hmapidx=%d", idx);
+	/* Entry and priv_data stay valid until _nh_rx_exit() */
+	uint32_t e = _nh_rx_enter(nh);
+	struct cb_entity *ent = _nh_lookup(nh, be64toh(cshdr->stream_id));
+	struct cb_priv *cbp = ent ? __atomic_load_n(&ent->priv_data, __ATOMIC_ACQUIRE) : NULL;
+	int (*cb)(void *, struct avtpdu_cshdr *) = ent ? __atomic_load_n(&ent->cb, __ATOMIC_ACQUIRE) : NULL;
+
+	tb_tag(nh->tb, "feed_pdu_ts, feed to %s callback", cbp && cb ? "registered" : "no");
 
-	if (idx >= 0) {
-		struct cb_priv *cbp = nh->hmap[idx].priv_data;
-		cbp->meta.ts_rx_ns = rx_hw_ns;
+	/* no callback registred, though not exactly an FD-error */
+	int res = -EBADFD;
+	if (cbp && cb) {
+		cbp->meta.ts_rx_ns = rx_ns;
 		cbp->meta.ts_recv_ptp_ns = recv_ptp_ns;
 		cbp->meta.avtp_timestamp = ntohl(cshdr->avtp_timestamp);
+		cbp->meta.ts_rx_hw = rx_hw;
 
 		/* Unless otherwise configured, standard callback
 		 * (nh_std_cb) is used
 		 */
-		return nh->hmap[idx].cb(cbp, cshdr);
+		res = cb(cbp, cshdr);
 	}
+	_nh_rx_exit(nh, e);
+	return res;
+}
 
-	/* no callback registred, though not exactly an FD-error */
-	return -EBADFD;
+int nh_feed_pdu_ts(struct nethandler *nh, struct avtpdu_cshdr *cshdr,
+		uint64_t rx_hw_ns,
+		uint64_t recv_ptp_ns)
+{
+	return _nh_feed_pdu(nh, cshdr, rx_hw_ns, recv_ptp_ns, false);
 }
 
 int nh_feed_pdu(struct nethandler *nh, struct avtpdu_cshdr *cshdr)
@@ -1253,7 +2717,7 @@ struct channel *get_rx_chan_from_sid(struct nethandler *nh, union stream_id_wrap
 	 * for the pipe), but it's the fastes way to determine if its a
 	 * known stream.
 	 */
-	if (get_hm_idx(nh, stream.s64) < 0 || !nh)
+	if (!_nh_lookup(nh, stream.s64))
 		return NULL;
 
 	struct channel *ch = nh->du_rx_head;
@@ -1345,6 +2809,565 @@ void nh_set_srp(struct nethandler *nh, bool use_srp)
 
 }
 
+static bool _nh_sock_promisc(struct nethandler *nh, int sock, bool enable)
+{
+	struct packet_mreq mr;
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = nh->ifidx;
+	mr.mr_type = PACKET_MR_PROMISC;
+	if (setsockopt(sock, SOL_PACKET,
+			enable ? PACKET_ADD_MEMBERSHIP : PACKET_DROP_MEMBERSHIP,
+			&mr, sizeof(mr)) == -1) {
+		ERROR(NULL, "%s(): failed %s promiscuous mode (%s)",
+			__func__, enable ? "entering" : "leaving", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool nh_set_promisc(struct nethandler *nh, bool enable)
+{
+	if (!nh || nh->rx_sock < 0)
+		return false;
+	if (nh->promisc == enable)
+		return true;
+
+	/* The device stays promiscuous as long as one socket holds a
+	 * membership, so the fanout workers must follow rx_sock.
+	 */
+	if (!_nh_sock_promisc(nh, nh->rx_sock, enable))
+		return false;
+	for (int i = 0; nh->use_rx_fanout && i < NH_RX_WORKERS; i++)
+		_nh_sock_promisc(nh, nh->rxw[i].sock, enable);
+	nh->promisc = enable;
+	INFO(NULL, "%s(): Rx socket %s promiscuous mode", __func__, enable ? "in" : "not in");
+	return true;
+}
+
+bool nh_set_rx_affinity(struct nethandler *nh, int cpu)
+{
+	if (!nh || cpu < -1 || cpu >= CPU_SETSIZE)
+		return false;
+
+	nh->rx_cpu = cpu;
+	if (nh->rx_active && nh->tid > 0) {
+		int res = _nh_place_thread(nh, nh->tid, nh->rx_sched_prio, _nh_rx_thread_cpu(nh));
+		if (res) {
+			ERROR(NULL, "%s(): failed pinning Rx thread to CPU %d (%s)", __func__, cpu, strerror(-res));
+			return false;
+		}
+	}
+	return true;
+}
+
+bool nh_set_rx_sched(struct nethandler *nh, int sched_prio)
+{
+	if (!nh || sched_prio < 0 || sched_prio > sched_get_priority_max(SCHED_FIFO))
+		return false;
+
+	if (nh->rx_active && nh->tid > 0) {
+		int res = _nh_place_thread(nh, nh->tid, sched_prio, _nh_rx_thread_cpu(nh));
+		if (res) {
+			ERROR(NULL, "%s(): failed setting Rx thread priority %d (%s)",
+				__func__, sched_prio, strerror(-res));
+			return false;
+		}
+	}
+	nh->rx_sched_prio = sched_prio;
+	return true;
+}
+
+bool nh_set_srp_sched(struct nethandler *nh, int sched_prio, int cpu)
+{
+	if (!nh || sched_prio < 0 || sched_prio > sched_get_priority_max(SCHED_FIFO) ||
+		cpu < -1 || cpu >= CPU_SETSIZE)
+		return false;
+
+	int res = 0;
+	if (nh->srp && nh->srp->tid > 0)
+		res = _nh_place_thread(nh, nh->srp->tid, sched_prio, cpu);
+	if (!res && nh->srp && nh->srp->announcer > 0)
+		res = _nh_place_thread(nh, nh->srp->announcer, sched_prio, cpu);
+	if (res) {
+		ERROR(NULL, "%s(): failed placing SRP threads (%s)", __func__, strerror(-res));
+		return false;
+	}
+	nh->srp_sched_prio = sched_prio;
+	nh->srp_cpu = cpu;
+	return true;
+}
+
+int nh_get_numa_node(struct nethandler *nh)
+{
+	return nh ? nh->numa_node : -1;
+}
+
+bool nh_set_numa(struct nethandler *nh, bool enable)
+{
+	if (!nh)
+		return false;
+	if (enable && nh->numa_node < 0) {
+		WARN(NULL, "%s(): NUMA node of %s not known", __func__, nh->ifname);
+		return false;
+	}
+	nh->use_numa = enable;
+	int node = enable ? nh->numa_node : -1;
+
+	int res = _nh_numa_bind(nh->hmap, nh->hmap_map_sz, node);
+	if (res)
+		WARN(NULL, "%s(): failed binding dispatch table to node %d (%s)", __func__, node, strerror(-res));
+	for (struct channel *ch = nh->du_rx_head; ch; ch = ch->next)
+		_nh_numa_bind_chan(ch, node);
+
+	/* Re-place running threads without an explicit CPU */
+	if (nh->rx_active) {
+		if (nh->tid > 0)
+			_nh_place_thread(nh, nh->tid, nh->rx_sched_prio, _nh_rx_thread_cpu(nh));
+		for (int i = 0; i < NH_RX_WORKERS; i++) {
+			if (nh->rxw[i].tid > 0)
+				_nh_place_thread(nh, nh->rxw[i].tid, nh->rxw[i].sched_prio, nh->rxw[i].cpu);
+		}
+	}
+	if (nh->srp && nh->srp->tid > 0)
+		_nh_place_thread(nh, nh->srp->tid, nh->srp_sched_prio, nh->srp_cpu);
+	if (nh->srp && nh->srp->announcer > 0)
+		_nh_place_thread(nh, nh->srp->announcer, nh->srp_sched_prio, nh->srp_cpu);
+
+	INFO(NULL, "%s(): %s placement on NUMA node %d", __func__, enable ? "using" : "not using", nh->numa_node);
+	return true;
+}
+
+/* Time the kernel may busy-poll the device queue per read */
+#define NH_BUSY_POLL_US	50
+
+/*
+ * Set (or clear) SO_BUSY_POLL on all Rx sockets. Not fatal if it fails,
+ * the Rx thread still spins in userspace, it only means the kernel will
+ * not poll the driver on our behalf.
+ */
+static void _nh_apply_busy_poll(struct nethandler *nh)
+{
+	int usec = nh->rx_busy_poll ? NH_BUSY_POLL_US : 0;
+	int res = nc_set_busy_poll(nh->rx_sock, usec);
+	for (int i = 0; nh->use_rx_fanout && i < NH_RX_WORKERS; i++)
+		res = res ? res : nc_set_busy_poll(nh->rxw[i].sock, usec);
+	if (nh->xdp)
+		res = res ? res : nc_set_busy_poll(nc_xdp_get_fd(nh->xdp), usec);
+
+	if (res && nh->rx_busy_poll)
+		WARN(NULL, "%s(): failed setting SO_BUSY_POLL (%s), spinning in userspace only",
+			__func__, strerror(-res));
+}
+
+bool nh_set_rx_busy_poll(struct nethandler *nh, bool enable, int cpu)
+{
+	if (!nh || nh->rx_sock < 0 || cpu < -1 || cpu >= CPU_SETSIZE)
+		return false;
+
+	bool restart = nh->rx_active;
+	_nh_join_rx(nh);
+
+	/* rx_cpu (nh_set_rx_affinity()) applies again once disabled */
+	nh->rx_busy_poll = enable;
+	nh->rx_busy_cpu = enable ? cpu : -1;
+	_nh_apply_busy_poll(nh);
+	if (enable && _nh_rx_thread_cpu(nh) < 0)
+		WARN(NULL, "%s(): busy-polling without pinning Rx thread to an isolated CPU", __func__);
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		return false;
+	}
+
+	INFO(NULL, "%s(): Rx %s (cpu %d)", __func__, enable ? "busy-polling" : "blocking", _nh_rx_thread_cpu(nh));
+	return true;
+}
+
+int nh_get_rx_spin_stats(struct nethandler *nh, uint64_t *spins, uint64_t *idle)
+{
+	if (!nh)
+		return -EINVAL;
+
+	uint64_t s = __atomic_load_n(&nh->rx_spins, __ATOMIC_RELAXED);
+	uint64_t i = __atomic_load_n(&nh->rx_idle, __ATOMIC_RELAXED);
+	for (int w = 0; w < NH_RX_WORKERS; w++) {
+		s += __atomic_load_n(&nh->rxw[w].spins, __ATOMIC_RELAXED);
+		i += __atomic_load_n(&nh->rxw[w].idle, __ATOMIC_RELAXED);
+	}
+	if (spins)
+		*spins = s;
+	if (idle)
+		*idle = i;
+	return 0;
+}
+
+bool nh_set_rx_ring(struct nethandler *nh, bool enable)
+{
+	if (!nh || nh->rx_sock < 0)
+		return false;
+	if (nh->use_rx_ring == enable)
+		return true;
+	if (enable && nh->uring) {
+		ERROR(NULL, "%s(): TPACKET_V3 ring not available with io_uring", __func__);
+		return false;
+	}
+
+	/* The ring cannot be added or removed while the Rx thread is
+	 * using the socket, stop it and restart with the new backend.
+	 */
+	bool restart = nh->rx_active;
+	_nh_join_rx(nh);
+
+	bool res = true;
+	if (enable) {
+		res = nc_setup_rx_ring(nh->rx_sock, &nh->rx_ring);
+		for (int i = 0; res && nh->use_rx_fanout && i < NH_RX_WORKERS; i++)
+			res = nc_setup_rx_ring(nh->rxw[i].sock, &nh->rxw[i].ring);
+	}
+	if (enable && res) {
+		nh->use_rx_ring = true;
+	} else {
+		nc_teardown_rx_ring(nh->rx_sock, &nh->rx_ring);
+		for (int i = 0; nh->use_rx_fanout && i < NH_RX_WORKERS; i++)
+			nc_teardown_rx_ring(nh->rxw[i].sock, &nh->rxw[i].ring);
+		nh->use_rx_ring = false;
+	}
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		if (nh->use_rx_ring) {
+			nc_teardown_rx_ring(nh->rx_sock, &nh->rx_ring);
+			for (int i = 0; nh->use_rx_fanout && i < NH_RX_WORKERS; i++)
+				nc_teardown_rx_ring(nh->rxw[i].sock, &nh->rxw[i].ring);
+			nh->use_rx_ring = false;
+		}
+		return false;
+	}
+
+	INFO(NULL, "%s(): Rx %s TPACKET_V3 ring", __func__, nh->use_rx_ring ? "using" : "not using");
+	return res;
+}
+
+bool nh_enable_xdp(struct nethandler *nh, int queue_id)
+{
+	if (!nh || nh->rx_sock < 0)
+		return false;
+	if (nh->xdp)
+		return true;
+	if (nh->use_rx_fanout) {
+		ERROR(NULL, "%s(): AF_XDP not available with Rx fanout", __func__);
+		return false;
+	}
+	if (nh->uring) {
+		ERROR(NULL, "%s(): AF_XDP not available with io_uring", __func__);
+		return false;
+	}
+
+	bool restart = nh->rx_active;
+	_nh_join_rx(nh);
+
+	nh->xdp = nc_xdp_create(nh, queue_id);
+	if (nh->xdp) {
+		if (nh->rx_busy_poll)
+			_nh_apply_busy_poll(nh);
+
+		/* Streams registered before XDP was enabled */
+		for (uint32_t b = 0; b <= nh->hmap_mask; b++) {
+			for (int i = 0; i < NH_BUCKET_SLOTS; i++) {
+				if (nh->hmap[b].sid[i])
+					nc_xdp_add_stream(nh->xdp, nh->hmap[b].sid[i]);
+			}
+		}
+	}
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		return false;
+	}
+
+	if (!nh->xdp) {
+		ERROR(NULL, "%s(): failed enabling AF_XDP on %s", __func__, nh->ifname);
+		return false;
+	}
+	INFO(NULL, "%s(): Rx/Tx using AF_XDP on %s queue %d", __func__, nh->ifname, queue_id);
+	return true;
+}
+
+bool nh_set_tx_ring(struct nethandler *nh, bool enable, bool qdisc_bypass)
+{
+	if (!nh)
+		return false;
+	if (enable && nh->uring) {
+		ERROR(NULL, "%s(): Tx ring not available with io_uring", __func__);
+		return false;
+	}
+
+	nh->use_tx_ring = enable;
+	nh->tx_qdisc_bypass = enable && qdisc_bypass;
+	INFO(NULL, "%s(): new Tx channels %s TPACKET_V2 ring%s", __func__,
+		enable ? "using" : "not using",
+		nh->tx_qdisc_bypass ? " (Qdisc bypass)" : "");
+	return true;
+}
+
+bool nh_enable_io_uring(struct nethandler *nh, bool batch_tx)
+{
+	if (!nh || nh->rx_sock < 0)
+		return false;
+	if (nh->uring)
+		return true;
+	if (nh->xdp || nh->use_rx_fanout || nh->use_rx_ring || nh->use_tx_ring) {
+		ERROR(NULL, "%s(): io_uring not available with AF_XDP, Rx fanout or Rx/Tx ring", __func__);
+		return false;
+	}
+
+	bool restart = nh->rx_active;
+	_nh_join_rx(nh);
+
+	nh->uring = nc_uring_create(nh, batch_tx);
+	if (nh->uring) {
+		/* Tx channels created before io_uring was enabled */
+		for (struct channel *ch = nh->du_tx_head; ch; ch = ch->next) {
+			if (ch->tx_ring.map)
+				continue;
+			if (nc_uring_add_tx(nh->uring, ch))
+				WARN(ch, "%s(): failed adding Tx channel, using regular socket", __func__);
+		}
+	}
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		return false;
+	}
+
+	if (!nh->uring) {
+		ERROR(NULL, "%s(): failed enabling io_uring", __func__);
+		return false;
+	}
+	INFO(NULL, "%s(): Rx/Tx using io_uring (%s Tx)", __func__, batch_tx ? "batched" : "immediate");
+	return true;
+}
+
+/*
+ * Create the error queue collector if needed and (re-)add all Tx
+ * sockets, optionally requesting Tx timestamps.
+ */
+static bool _nh_start_txts(struct nethandler *nh, bool stamps)
+{
+	if (!nh->txts)
+		nh->txts = nc_txts_create(nh);
+	if (!nh->txts) {
+		ERROR(NULL, "%s(): failed creating Tx error queue collector", __func__);
+		return false;
+	}
+	if (stamps) {
+		nc_txts_enable_stamps(nh->txts);
+		nh->tx_timestamps = true;
+	}
+
+	/* Tx channels created before the collector was enabled */
+	for (struct channel *ch = nh->du_tx_head; ch; ch = ch->next) {
+		if (nc_txts_add(nh->txts, ch->tx_sock))
+			WARN(ch, "%s(): failed adding channel to collector", __func__);
+	}
+	return true;
+}
+
+bool nh_enable_tx_timestamps(struct nethandler *nh)
+{
+	if (!nh)
+		return false;
+	if (nh->tx_timestamps)
+		return true;
+
+	if (!_nh_start_txts(nh, true))
+		return false;
+	if (!nh->logger)
+		WARN(NULL, "%s(): no logger, Tx timestamps are collected but not recorded", __func__);
+
+	INFO(NULL, "%s(): collecting qdisc and wire Tx timestamps", __func__);
+	return true;
+}
+
+bool nh_enable_txtime_stats(struct nethandler *nh)
+{
+	if (!nh)
+		return false;
+	if (!_nh_start_txts(nh, false))
+		return false;
+	INFO(NULL, "%s(): counting frames dropped by ETF", __func__);
+	return true;
+}
+
+int chan_get_txtime_stats(struct channel *ch, struct chan_txtime_stats *stats)
+{
+	if (!ch || !ch->nh || ch->tx_sock < 0 || !ch->nh->txts)
+		return -EINVAL;
+	return nc_txts_get_stats(ch->nh->txts, ch->sidw.s64, stats);
+}
+
+bool nh_enable_pacer(struct nethandler *nh, int sched_prio, int cpu)
+{
+	if (!nh)
+		return false;
+	if (nh->pacer)
+		return true;
+
+	nh->pacer = nc_pacer_create(nh, sched_prio, cpu);
+	if (!nh->pacer) {
+		ERROR(NULL, "%s(): failed creating Tx pacer", __func__);
+		return false;
+	}
+	INFO(NULL, "%s(): paced channels are sent from a single thread", __func__);
+	return true;
+}
+
+int chan_pace(struct channel *ch)
+{
+	if (!chan_valid(ch) || !ch->nh || !ch->nh->pacer)
+		return -EINVAL;
+	return nc_pacer_add(ch->nh->pacer, ch);
+}
+
+int chan_post(struct channel *ch, uint64_t ts, const void *data)
+{
+	if (!ch)
+		return -EINVAL;
+	return nc_pacer_post(ch, ts, data);
+}
+
+int chan_get_pace_stats(struct channel *ch, struct chan_pace_stats *stats)
+{
+	if (!ch || !ch->nh)
+		return -EINVAL;
+	return nc_pacer_get_stats(ch->nh->pacer, ch, stats);
+}
+
+int nh_flush_tx(struct nethandler *nh)
+{
+	if (!nh || !nh->uring)
+		return -EINVAL;
+	return nc_uring_flush(nh->uring);
+}
+
+static void _nh_teardown_fanout(struct nethandler *nh)
+{
+	for (int i = 0; i < NH_RX_WORKERS; i++) {
+		struct nh_rx_worker *w = &nh->rxw[i];
+		if (w->sock < 0)
+			continue;
+		nc_teardown_rx_ring(w->sock, &w->ring);
+		close(w->sock);
+		w->sock = -1;
+	}
+	nh->use_rx_fanout = false;
+}
+
+/*
+ * Open one Rx socket per worker and join them to the same fanout group,
+ * in worker order as the fanout program returns the index of the
+ * socket in the group.
+ */
+static int _nh_setup_fanout(struct nethandler *nh)
+{
+	nh->fanout_id = -1;
+	for (int i = 0; i < NH_RX_WORKERS; i++) {
+		struct nh_rx_worker *w = &nh->rxw[i];
+		w->frames = 0;
+		w->sock = nc_create_rx_sock(nh->ifname);
+		if (w->sock < 0)
+			goto err;
+
+		if (!nh->promisc)
+			_nh_sock_promisc(nh, w->sock, false);
+
+		int res = nc_join_rx_fanout(w->sock, &nh->fanout_id);
+		if (res) {
+			ERROR(NULL, "%s(): failed joining fanout group (%s)", __func__, strerror(-res));
+			goto err;
+		}
+
+		if (nh->use_rx_ring && !nc_setup_rx_ring(w->sock, &w->ring))
+			goto err;
+	}
+	nh->use_rx_fanout = true;
+	return 0;
+err:
+	_nh_teardown_fanout(nh);
+	return -1;
+}
+
+bool nh_set_rx_fanout(struct nethandler *nh, bool enable, enum nh_fanout_key key)
+{
+	if (!nh || nh->rx_sock < 0)
+		return false;
+	if (enable && nh->xdp) {
+		ERROR(NULL, "%s(): Rx fanout not available with AF_XDP", __func__);
+		return false;
+	}
+	if (enable && nh->poll_mode) {
+		ERROR(NULL, "%s(): Rx fanout not available in poll mode", __func__);
+		return false;
+	}
+	if (enable && nh->uring) {
+		ERROR(NULL, "%s(): Rx fanout not available with io_uring", __func__);
+		return false;
+	}
+
+	/* Workers already running, only the program has to change */
+	if (enable && nh->use_rx_fanout) {
+		nh->fanout_key = key;
+		_nh_update_rx_filter(nh);
+		return true;
+	}
+	if (!enable && !nh->use_rx_fanout)
+		return true;
+
+	bool restart = nh->rx_active;
+	_nh_join_rx(nh);
+
+	bool res = true;
+	nh->fanout_key = key;
+	if (enable)
+		res = _nh_setup_fanout(nh) == 0;
+	else
+		_nh_teardown_fanout(nh);
+	_nh_update_rx_filter(nh);
+	if (nh->rx_busy_poll)
+		_nh_apply_busy_poll(nh);
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		return false;
+	}
+
+	INFO(NULL, "%s(): Rx %s fanout workers (%s)", __func__,
+		nh->use_rx_fanout ? "using" : "not using",
+		nh->fanout_key == NH_FANOUT_PCP ? "by PCP" : "by StreamID");
+	return res;
+}
+
+bool nh_set_rx_worker(struct nethandler *nh, enum stream_class sc, int sched_prio, int cpu)
+{
+	int idx = _nh_rxw_idx(sc);
+	if (!nh || idx < 0 || cpu < -1 || sched_prio < 0 ||
+		sched_prio > sched_get_priority_max(SCHED_FIFO))
+		return false;
+
+	bool restart = nh->rx_active && nh->use_rx_fanout;
+	if (restart)
+		_nh_join_rx(nh);
+
+	nh->rxw[idx].sched_prio = sched_prio;
+	nh->rxw[idx].cpu = cpu;
+
+	if (restart && _nh_start_rx(nh)) {
+		ERROR(NULL, "%s(): failed restarting Rx-handler", __func__);
+		return false;
+	}
+	return true;
+}
+
 void nh_enable_ftrace(struct nethandler *nh)
 {
 	if (!nh || nh->tb)
@@ -1415,6 +3438,26 @@ void nh_destroy(struct nethandler **nh)
 		 */
 		_nh_stop_rx(*nh);
 
+		/* Pacer sends on Tx channels, stop it before they go away */
+		nc_pacer_destroy(&(*nh)->pacer);
+
+		/* Collector writes to logger, stop it before logger is flushed */
+		nc_txts_destroy(&(*nh)->txts);
+
+		_nh_teardown_fanout(*nh);
+		if ((*nh)->use_rx_ring)
+			nc_teardown_rx_ring((*nh)->rx_sock, &(*nh)->rx_ring);
+		if ((*nh)->rx_sock >= 0) {
+			close((*nh)->rx_sock);
+			(*nh)->rx_sock = -1;
+		}
+		if ((*nh)->rx_flt_prog >= 0)
+			close((*nh)->rx_flt_prog);
+		if ((*nh)->rx_flt_map >= 0)
+			close((*nh)->rx_flt_map);
+		if ((*nh)->poll_fd >= 0)
+			close((*nh)->poll_fd);
+
 		if ((*nh)->tb)
 			tb_close((*nh)->tb);
 		if ((*nh)->dma_lat_fd > 0)
@@ -1428,7 +3471,11 @@ void nh_destroy(struct nethandler **nh)
 
 		/* close down and exit safely */
 		if ((*nh)->hmap != NULL)
-			free((*nh)->hmap);
+			munmap((*nh)->hmap, (*nh)->hmap_map_sz);
+		(*nh)->hmap = NULL;
+		(*nh)->hm_ent = NULL;
+		(*nh)->hm_small = NULL;
+		(*nh)->hm_small_buf = NULL;
 
 		/* clean up TX PDUs */
 		while ((*nh)->du_tx_head) {
@@ -1447,6 +3494,10 @@ void nh_destroy(struct nethandler **nh)
 		if ((*nh)->use_srp)
 			nc_srp_teardown((*nh));
 
+		/* Tx channels are gone, safe to remove XSK and rings */
+		nc_xdp_destroy(&(*nh)->xdp);
+		nc_uring_destroy(&(*nh)->uring);
+
 		/* Free memory */
 		free(*nh);
 	}
@@ -38,6 +38,15 @@ error_t parser(int key, char *arg, struct argp_state *state)
       case 'P':
 	      nc_tx_sock_prio(atoi(arg), SC_TAS);
 	      break;
+      case 'r':
+	      nc_use_rx_ring();
+	      break;
+      case 'x':
+	      nc_use_xdp(atoi(arg));
+	      break;
+      case 'n':
+	      nc_no_promisc();
+	      break;
        }
 
        return 0;
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <netchan_lv.h>
+
+#define NC_CACHELINE	64
+
+/*
+ * seq is odd while the writer is filling the buffer, gen is the
+ * generation of the value currently stored.
+ */
+struct lv_buf {
+	uint32_t seq;
+	uint64_t gen;
+	uint8_t data[] __attribute__((aligned(NC_CACHELINE)));
+};
+
+/*
+ * latest is the index of the most recently published buffer, only
+ * written by the writer. Each buffer is padded to a full number of
+ * cachelines so that the writer filling one buffer does not disturb a
+ * reader copying the other.
+ */
+struct nc_lv {
+	uint32_t latest __attribute__((aligned(NC_CACHELINE)));
+	uint64_t gen;
+
+	/* Constant after creation */
+	size_t elem_sz __attribute__((aligned(NC_CACHELINE)));
+	size_t buf_sz;
+	size_t map_sz;
+
+	uint8_t bufs[] __attribute__((aligned(NC_CACHELINE)));
+};
+
+static inline struct lv_buf * _lv_buf(struct nc_lv *lv, uint32_t idx)
+{
+	return (struct lv_buf *)(lv->bufs + (idx & 1) * lv->buf_sz);
+}
+
+struct nc_lv * nc_lv_create(size_t elem_sz)
+{
+	if (!elem_sz)
+		return NULL;
+
+	size_t buf_sz = (sizeof(struct lv_buf) + elem_sz + NC_CACHELINE - 1) & ~((size_t)NC_CACHELINE - 1);
+	size_t map_sz = sizeof(struct nc_lv) + 2 * buf_sz;
+
+	/* Shared mapping, like nc_ring, so it survives fork() */
+	struct nc_lv *lv = mmap(NULL, map_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (lv == MAP_FAILED)
+		return NULL;
+
+	lv->elem_sz = elem_sz;
+	lv->buf_sz = buf_sz;
+	lv->map_sz = map_sz;
+	return lv;
+}
+
+void nc_lv_destroy(struct nc_lv **lv)
+{
+	if (!lv || !*lv)
+		return;
+	munmap(*lv, (*lv)->map_sz);
+	*lv = NULL;
+}
+
+size_t nc_lv_map_size(struct nc_lv *lv)
+{
+	return lv ? lv->map_sz : 0;
+}
+
+void * nc_lv_begin(struct nc_lv *lv)
+{
+	struct lv_buf *buf = _lv_buf(lv, lv->latest + 1);
+
+	/* Mark buffer as being written before touching data */
+	__atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return buf->data;
+}
+
+void nc_lv_publish(struct nc_lv *lv)
+{
+	uint32_t idx = (lv->latest + 1) & 1;
+	struct lv_buf *buf = _lv_buf(lv, idx);
+
+	buf->gen = ++lv->gen;
+	__atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&lv->latest, idx, __ATOMIC_RELEASE);
+}
+
+int nc_lv_read(struct nc_lv *lv, void *hdr, size_t hdr_sz, void *dst, uint64_t *gen)
+{
+	if (!lv || !dst || hdr_sz > lv->elem_sz)
+		return -EINVAL;
+
+	for (;;) {
+		struct lv_buf *buf = _lv_buf(lv, __atomic_load_n(&lv->latest, __ATOMIC_ACQUIRE));
+		uint32_t seq = __atomic_load_n(&buf->seq, __ATOMIC_ACQUIRE);
+
+		/* latest only points to an unwritten buffer before the
+		 * first publish */
+		if (seq == 0)
+			return -EAGAIN;
+
+		/* Writer has wrapped around to this buffer, try again */
+		if (seq & 1)
+			continue;
+
+		if (hdr)
+			memcpy(hdr, buf->data, hdr_sz);
+		memcpy(dst, buf->data + hdr_sz, lv->elem_sz - hdr_sz);
+		uint64_t g = buf->gen;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&buf->seq, __ATOMIC_RELAXED) == seq) {
+			if (gen)
+				*gen = g;
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include <netchan_pacer.h>
+#include <netchan_uring.h>
+#include <netchan_utils.h>
+
+/* Wheel resolution and size (power of 2), one revolution is 32 ms,
+ * slots further out stay in their bucket until the wheel comes around.
+ */
+#define PACER_TICK_NS		(125 * NS_IN_US)
+#define PACER_SLOTS		256
+
+/* Longest sleep without looking at the wheel, bounds how late a
+ * channel added while the pacer sleeps is noticed.
+ */
+#define PACER_IDLE_NS		(1 * NS_IN_MS)
+
+/* First slot of a newly paced channel, beyond any tick the pacer may
+ * already be waiting for (idle sleep + launch guard + a tick)
+ */
+#define PACER_START_NS		(4 * NS_IN_MS)
+
+struct nc_pace {
+	struct channel *ch;
+	struct nc_pace *next;
+	uint64_t due_ns;
+
+	/* Mailbox, seqlock: odd while the writer copies, seq/2 is the
+	 * number of samples posted
+	 */
+	uint64_t seq;
+	uint64_t mb_ts;
+	unsigned char *mb;
+
+	/* Pacer only, last sample sent */
+	uint64_t sent_seq;
+	uint64_t buf_ts;
+	unsigned char *buf;
+
+	struct chan_pace_stats st;
+};
+
+struct nc_pacer {
+	struct nethandler *nh;
+
+	/* Serializes the wheel (sending) with add/del and stats queries */
+	pthread_mutex_t lock;
+	pthread_t tid;
+	bool running;
+
+	/* Next tick to process */
+	uint64_t cur_tick;
+
+	/* Bucket is tick % PACER_SLOTS, sorted on due_ns */
+	struct nc_pace *wheel[PACER_SLOTS];
+};
+
+static void _wheel_insert(struct nc_pacer *p, struct nc_pace *pace)
+{
+	uint64_t tick = pace->due_ns / PACER_TICK_NS;
+	if (tick < p->cur_tick)
+		tick = p->cur_tick;
+
+	struct nc_pace **pp = &p->wheel[tick & (PACER_SLOTS - 1)];
+	while (*pp && (*pp)->due_ns <= pace->due_ns)
+		pp = &(*pp)->next;
+	pace->next = *pp;
+	*pp = pace;
+}
+
+static bool _wheel_remove(struct nc_pacer *p, struct nc_pace *pace)
+{
+	for (int i = 0; i < PACER_SLOTS; i++) {
+		for (struct nc_pace **pp = &p->wheel[i]; *pp; pp = &(*pp)->next) {
+			if (*pp == pace) {
+				*pp = pace->next;
+				pace->next = NULL;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* First tick from cur_tick with a slot in it, cur_tick + PACER_SLOTS if
+ * nothing is due within a revolution.
+ */
+static uint64_t _wheel_next(struct nc_pacer *p)
+{
+	for (uint64_t t = p->cur_tick; t < p->cur_tick + PACER_SLOTS; t++) {
+		struct nc_pace *head = p->wheel[t & (PACER_SLOTS - 1)];
+		if (head && head->due_ns < (t + 1) * PACER_TICK_NS)
+			return t;
+	}
+	return p->cur_tick + PACER_SLOTS;
+}
+
+/*
+ * Copy the newest sample from the mailbox, false if nothing has been
+ * posted yet. Retries if the writer was copying at the same time.
+ */
+static bool _pace_fetch(struct nc_pace *pace)
+{
+	uint64_t s1, s2 = 0;
+	do {
+		s1 = __atomic_load_n(&pace->seq, __ATOMIC_ACQUIRE);
+		if (s1 == pace->sent_seq) {
+			if (s1)
+				pace->st.duplicates++;
+			return s1 != 0;
+		}
+		if (s1 & 1) {
+			nc_cpu_relax();
+			continue;
+		}
+		memcpy(pace->buf, pace->mb, pace->ch->payload_size);
+		pace->buf_ts = pace->mb_ts;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&pace->seq, __ATOMIC_RELAXED);
+	} while (s1 & 1 || s1 != s2);
+
+	pace->st.coalesced += (s1 - pace->sent_seq) / 2 - 1;
+	pace->sent_seq = s1;
+	return true;
+}
+
+/*
+ * Send the channel's slot (or skip slots that can no longer be met)
+ * and move it to its next slot. Launch time channels (send_schedule)
+ * must leave the launch guard before the slot, others are late once the
+ * slot is entirely in the past.
+ */
+static bool _pace_fire(struct nc_pacer *p, struct nc_pace *pace, uint64_t tick_end)
+{
+	struct channel *ch = pace->ch;
+	bool launch = ch->ops->send_schedule != NULL;
+	bool sent = false;
+
+	uint64_t now = tai_get_ns();
+	if (launch)
+		now += __atomic_load_n(&p->nh->tas_launch_ns, __ATOMIC_RELAXED);
+	else
+		now -= ch->interval_ns;
+
+	while (pace->due_ns < now) {
+		pace->st.late++;
+		pace->due_ns += ch->interval_ns;
+	}
+
+	if (pace->due_ns < tick_end && _pace_fetch(pace)) {
+		uint64_t tx_ns = pace->due_ns;
+		chan_update(ch, pace->buf_ts, pace->buf);
+		if (ch->ops->send_at(ch, &tx_ns) >= 0) {
+			pace->st.sent++;
+			sent = true;
+		}
+	}
+	if (pace->due_ns < tick_end)
+		pace->due_ns += ch->interval_ns;
+	return sent;
+}
+
+/*
+ * Send everything due in tick, launch time channels first as they
+ * are sent ahead of their slot, the rest wait for theirs. A channel
+ * with an interval shorter than a tick is put back in the same bucket
+ * and fired again.
+ */
+static void _pacer_tick(struct nc_pacer *p, uint64_t tick)
+{
+	uint64_t tick_end = (tick + 1) * PACER_TICK_NS;
+	struct nc_pace **bucket = &p->wheel[tick & (PACER_SLOTS - 1)];
+	bool flush = false;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (;;) {
+			struct nc_pace **pp = bucket;
+			while (*pp && (*pp)->due_ns < tick_end &&
+				((*pp)->ch->ops->send_schedule != NULL) != (pass == 0))
+				pp = &(*pp)->next;
+			if (!*pp || (*pp)->due_ns >= tick_end)
+				break;
+
+			struct nc_pace *pace = *pp;
+			*pp = pace->next;
+			flush |= _pace_fire(p, pace, tick_end);
+			_wheel_insert(p, pace);
+		}
+	}
+	if (flush && p->nh->uring)
+		nc_uring_flush(p->nh->uring);
+}
+
+static void * _pacer_runner(void *data)
+{
+	struct nc_pacer *p = (struct nc_pacer *)data;
+
+	pthread_mutex_lock(&p->lock);
+	while (__atomic_load_n(&p->running, __ATOMIC_ACQUIRE)) {
+		uint64_t now = tai_get_ns();
+		uint64_t tick = _wheel_next(p);
+		uint64_t lead = __atomic_load_n(&p->nh->tas_launch_ns, __ATOMIC_RELAXED) + PACER_TICK_NS;
+		uint64_t wake = tick * PACER_TICK_NS - lead;
+
+		if (wake > now + PACER_IDLE_NS) {
+			/* Nothing due before tick, safe to move up to now */
+			uint64_t now_tick = now / PACER_TICK_NS;
+			if (now_tick > p->cur_tick)
+				p->cur_tick = now_tick < tick ? now_tick : tick;
+			pthread_mutex_unlock(&p->lock);
+
+			struct timespec ts = { .tv_sec = 0, .tv_nsec = PACER_IDLE_NS };
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+			pthread_mutex_lock(&p->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&p->lock);
+		nc_wait_tai(p->nh, wake);
+		pthread_mutex_lock(&p->lock);
+
+		p->cur_tick = tick;
+		_pacer_tick(p, tick);
+		p->cur_tick = tick + 1;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+struct nc_pacer * nc_pacer_create(struct nethandler *nh, int sched_prio, int cpu)
+{
+	if (!nh)
+		return NULL;
+
+	struct nc_pacer *p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	p->nh = nh;
+	p->cur_tick = tai_get_ns() / PACER_TICK_NS;
+	pthread_mutex_init(&p->lock, NULL);
+
+	p->running = true;
+	int res = nh_create_thread(nh, &p->tid, _pacer_runner, p, sched_prio, cpu);
+	if (res) {
+		ERROR(NULL, "%s(): failed creating pacer thread (%s)", __func__, strerror(-res));
+		pthread_mutex_destroy(&p->lock);
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+static void _pace_free(struct nc_pace *pace)
+{
+	pace->ch->pace = NULL;
+	free(pace->mb);
+	free(pace->buf);
+	free(pace);
+}
+
+void nc_pacer_destroy(struct nc_pacer **pacer)
+{
+	if (!pacer || !*pacer)
+		return;
+
+	struct nc_pacer *p = *pacer;
+	__atomic_store_n(&p->running, false, __ATOMIC_RELEASE);
+	pthread_join(p->tid, NULL);
+
+	for (int i = 0; i < PACER_SLOTS; i++) {
+		while (p->wheel[i]) {
+			struct nc_pace *pace = p->wheel[i];
+			p->wheel[i] = pace->next;
+			_pace_free(pace);
+		}
+	}
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+	*pacer = NULL;
+}
+
+int nc_pacer_add(struct nc_pacer *p, struct channel *ch)
+{
+	if (!p || !ch || ch->tx_sock < 0 || !ch->ops || !ch->interval_ns)
+		return -EINVAL;
+	if (ch->pace)
+		return -EEXIST;
+
+	struct nc_pace *pace = calloc(1, sizeof(*pace));
+	if (!pace)
+		return -ENOMEM;
+	pace->mb = calloc(1, ch->payload_size);
+	pace->buf = calloc(1, ch->payload_size);
+	if (!pace->mb || !pace->buf) {
+		free(pace->mb);
+		free(pace->buf);
+		free(pace);
+		return -ENOMEM;
+	}
+	pace->ch = ch;
+
+	uint64_t start = tai_get_ns() + PACER_START_NS;
+	pace->due_ns = ch->next_tx_ns;
+	while (pace->due_ns < start)
+		pace->due_ns += ch->interval_ns;
+
+	pthread_mutex_lock(&p->lock);
+	ch->pace = pace;
+	_wheel_insert(p, pace);
+	pthread_mutex_unlock(&p->lock);
+	return 0;
+}
+
+void nc_pacer_del(struct nc_pacer *p, struct channel *ch)
+{
+	if (!p || !ch || !ch->pace)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	struct nc_pace *pace = ch->pace;
+	if (_wheel_remove(p, pace))
+		_pace_free(pace);
+	pthread_mutex_unlock(&p->lock);
+}
+
+int nc_pacer_post(struct channel *ch, uint64_t ts, const void *data)
+{
+	if (!ch || !ch->pace || !data)
+		return -EINVAL;
+
+	struct nc_pace *pace = ch->pace;
+	uint64_t seq = pace->seq;
+	__atomic_store_n(&pace->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(pace->mb, data, ch->payload_size);
+	pace->mb_ts = ts;
+
+	__atomic_store_n(&pace->seq, seq + 2, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int nc_pacer_get_stats(struct nc_pacer *p, struct channel *ch, struct chan_pace_stats *stats)
+{
+	if (!p || !ch || !ch->pace || !stats)
+		return -EINVAL;
+
+	pthread_mutex_lock(&p->lock);
+	*stats = ch->pace->st;
+	pthread_mutex_unlock(&p->lock);
+	return 0;
+}
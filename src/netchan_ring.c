@@ -0,0 +1,262 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <netchan_ring.h>
+#include <netchan_utils.h>
+
+#define NC_CACHELINE		64
+#define NC_RING_HORIZON_NS	NS_IN_SEC
+#define NC_RING_MIN_SLOTS	8
+#define NC_RING_MAX_SLOTS	4096
+#define NC_RING_MAX_BYTES	(1 << 20)
+#define NC_RING_HELD		((uint64_t)1 << 32)
+
+/*
+ * head is only written by the producer. tail is normally advanced by the
+ * consumer, but with NC_DROP_OLDEST/NC_OVERWRITE the producer may also
+ * move it past unread slots, so both sides update it with CAS. Keep them
+ * on separate cachelines to avoid false sharing.
+ *
+ * held is the slot the consumer is currently reading (NC_RING_HELD | idx)
+ * or 0. The producer never writes into that slot, even when dropping.
+ *
+ * seq is the futex word. It is bumped whenever a sleeping consumer must
+ * re-evaluate the ring (new data or closed).
+ */
+struct nc_ring {
+	uint32_t head __attribute__((aligned(NC_CACHELINE)));
+	uint32_t policy;
+	uint64_t dropped;
+
+	uint32_t tail __attribute__((aligned(NC_CACHELINE)));
+	uint32_t waiting;
+	uint64_t held;
+
+	uint32_t seq __attribute__((aligned(NC_CACHELINE)));
+	uint32_t closed;
+
+	/* Constant after creation */
+	uint32_t mask __attribute__((aligned(NC_CACHELINE)));
+	uint32_t slot_sz;
+	size_t map_sz;
+
+	uint8_t slots[] __attribute__((aligned(NC_CACHELINE)));
+};
+
+static long _futex(uint32_t *uaddr, int op, uint32_t val)
+{
+	/* Not FUTEX_PRIVATE_FLAG, the ring may be shared between processes */
+	return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+static uint32_t _ring_slots(size_t slot_sz, uint64_t interval_ns)
+{
+	uint64_t want = interval_ns ? NC_RING_HORIZON_NS / interval_ns : NC_RING_MAX_SLOTS;
+	if (want > NC_RING_MAX_SLOTS)
+		want = NC_RING_MAX_SLOTS;
+
+	uint32_t slots = NC_RING_MIN_SLOTS;
+	while (slots < want)
+		slots <<= 1;
+	while (slots > NC_RING_MIN_SLOTS && slots * slot_sz > NC_RING_MAX_BYTES)
+		slots >>= 1;
+	return slots;
+}
+
+struct nc_ring * nc_ring_create(size_t elem_sz, uint64_t interval_ns)
+{
+	if (!elem_sz)
+		return NULL;
+
+	size_t slot_sz = (elem_sz + NC_CACHELINE - 1) & ~((size_t)NC_CACHELINE - 1);
+	uint32_t slots = _ring_slots(slot_sz, interval_ns);
+	size_t map_sz = sizeof(struct nc_ring) + slots * slot_sz;
+
+	struct nc_ring *ring = mmap(NULL, map_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	/* Anonymous mappings are zeroed, only set the constants */
+	ring->mask = slots - 1;
+	ring->slot_sz = slot_sz;
+	ring->map_sz = map_sz;
+	return ring;
+}
+
+void nc_ring_destroy(struct nc_ring **ring)
+{
+	if (!ring || !*ring)
+		return;
+	munmap(*ring, (*ring)->map_sz);
+	*ring = NULL;
+}
+
+size_t nc_ring_map_size(struct nc_ring *ring)
+{
+	return ring ? ring->map_sz : 0;
+}
+
+uint32_t nc_ring_capacity(struct nc_ring *ring)
+{
+	return ring ? ring->mask + 1 : 0;
+}
+
+static inline void * _ring_slot(struct nc_ring *ring, uint32_t idx)
+{
+	return ring->slots + (size_t)(idx & ring->mask) * ring->slot_sz;
+}
+
+void nc_ring_set_overflow(struct nc_ring *ring, enum nc_overflow_policy policy)
+{
+	if (!ring)
+		return;
+	__atomic_store_n(&ring->policy, policy, __ATOMIC_RELAXED);
+}
+
+enum nc_overflow_policy nc_ring_get_overflow(struct nc_ring *ring)
+{
+	if (!ring)
+		return NC_DROP_NEWEST;
+	return __atomic_load_n(&ring->policy, __ATOMIC_RELAXED);
+}
+
+uint64_t nc_ring_dropped(struct nc_ring *ring)
+{
+	if (!ring)
+		return 0;
+	return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
+
+static inline void _ring_drop(struct nc_ring *ring, uint32_t cnt)
+{
+	__atomic_add_fetch(&ring->dropped, cnt, __ATOMIC_RELAXED);
+}
+
+/*
+ * Move tail up to new_tail, discarding unread slots. The consumer may
+ * claim a slot concurrently, only count what we actually discarded.
+ */
+static void _ring_discard(struct nc_ring *ring, uint32_t new_tail)
+{
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+	while ((int32_t)(new_tail - tail) > 0) {
+		if (__atomic_compare_exchange_n(&ring->tail, &tail, new_tail, false,
+							__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			_ring_drop(ring, new_tail - tail);
+			return;
+		}
+	}
+}
+
+void * nc_ring_reserve(struct nc_ring *ring)
+{
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	enum nc_overflow_policy policy = __atomic_load_n(&ring->policy, __ATOMIC_RELAXED);
+
+	if (policy == NC_OVERWRITE) {
+		_ring_discard(ring, head);
+	} else if (head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) > ring->mask) {
+		if (policy != NC_DROP_OLDEST) {
+			_ring_drop(ring, 1);
+			return NULL;
+		}
+		_ring_discard(ring, head - ring->mask);
+	}
+
+	/* Slot may still be held by the reader if it has been sitting on
+	 * it for a full lap, in that case the newest must go.
+	 */
+	uint64_t held = __atomic_load_n(&ring->held, __ATOMIC_SEQ_CST);
+	if (held && head - (uint32_t)held > ring->mask) {
+		_ring_drop(ring, 1);
+		return NULL;
+	}
+	return _ring_slot(ring, head);
+}
+
+void nc_ring_commit(struct nc_ring *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence in nc_ring_wait(), either the consumer
+	 * sees the new head, or we see that it is about to sleep.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&ring->seq, 1, __ATOMIC_RELEASE);
+		_futex(&ring->seq, FUTEX_WAKE, INT_MAX);
+	}
+}
+
+static inline bool _ring_empty(struct nc_ring *ring)
+{
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail;
+}
+
+void * nc_ring_acquire(struct nc_ring *ring)
+{
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+	for (;;) {
+		if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+			/* producer may have discarded what we tried to claim */
+			__atomic_store_n(&ring->held, 0, __ATOMIC_RELEASE);
+			return NULL;
+		}
+
+		/* Announce the slot before claiming it, so that a producer
+		 * that sees the new tail also sees that the slot is held.
+		 */
+		__atomic_store_n(&ring->held, NC_RING_HELD | tail, __ATOMIC_SEQ_CST);
+		if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, false,
+							__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			return _ring_slot(ring, tail);
+	}
+}
+
+void nc_ring_release(struct nc_ring *ring)
+{
+	__atomic_store_n(&ring->held, 0, __ATOMIC_RELEASE);
+}
+
+int nc_ring_wait(struct nc_ring *ring)
+{
+	if (!ring)
+		return -EINVAL;
+
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&ring->seq, __ATOMIC_ACQUIRE);
+		if (!_ring_empty(ring))
+			return 0;
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+			return -EPIPE;
+
+		__atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (_ring_empty(ring) && !__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+			_futex(&ring->seq, FUTEX_WAIT, seq);
+		__atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+	}
+}
+
+void nc_ring_close(struct nc_ring *ring)
+{
+	if (!ring)
+		return;
+	__atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->seq, 1, __ATOMIC_SEQ_CST);
+	_futex(&ring->seq, FUTEX_WAKE, INT_MAX);
+}
@@ -5,16 +5,369 @@
 #include <netinet/ether.h>
 #include <arpa/inet.h>
 #include <linux/errqueue.h>
+#include <linux/sockios.h>
 #include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
 
 #include <netchan.h>
+#include <netchan_uring.h>
 #include <logger.h>
 #include <tracebuffer.h>
 
+/*
+ * Classic BPF filter for the Rx socket
+ *
+ * Accepts AVTP frames (optionally 802.1Q tagged inline, VLAN offload
+ * strips the tag before the filter runs) with a registered StreamID,
+ * anything else is dropped in the kernel, before it is copied to
+ * userspace.
+ *
+ *	X = 0
+ *	A = eth.h_proto
+ *	if (A == 0x8100) { X = 4; A = vlan.h_proto }
+ *	if (A != 0x22f0) drop
+ *	for each sid:
+ *		if (sid_hi == [X+18] && sid_lo == [X+22]) accept
+ *	drop
+ *
+ * Each stream gets its own accept and drop is repeated so that all
+ * jumps are short (cBPF jump offsets are 8 bit).
+ */
+#define RX_FLT_HDR_LEN		7
+#define RX_FLT_SID_LEN		5
+#define RX_FLT_SID_OFS		(ETH_HLEN + offsetof(struct avtpdu_cshdr, stream_id))
+#define RX_FLT_MAX_SIDS		((BPF_MAXINSNS - RX_FLT_HDR_LEN - 2) / RX_FLT_SID_LEN)
+
+static int _rx_filter_attach(int sock, const uint64_t *sids, int n, bool all_sids)
+{
+	int len = RX_FLT_HDR_LEN + (all_sids ? 1 : n * RX_FLT_SID_LEN) + 1;
+	struct sock_filter *f = calloc(len, sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+
+	int i = 0;
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 0);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct ethhdr, h_proto));
+	f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_8021Q, 0, 2);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 4);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct ethhdr, h_proto) + 4);
+	f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_TSN, 1, 0);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	if (all_sids) {
+		f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, UINT32_MAX);
+	} else {
+		for (int s = 0; s < n; s++) {
+			f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_IND, RX_FLT_SID_OFS);
+			f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(sids[s] >> 32), 0, 3);
+			f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_IND, RX_FLT_SID_OFS + 4);
+			f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)sids[s], 0, 1);
+			f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, UINT32_MAX);
+		}
+	}
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+	/* Attaching replaces any previous filter atomically */
+	struct sock_fprog prog = { .len = i, .filter = f };
+	int res = 0;
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+		res = -errno;
+	free(f);
+	return res;
+}
+
+int nc_set_rx_filter(int sock, const uint64_t *sids, int n)
+{
+	if (sock < 0 || n < 0 || (n > 0 && !sids))
+		return -EINVAL;
+
+	/* Too many streams to list, fall back to ethertype only */
+	if (n > RX_FLT_MAX_SIDS)
+		return _rx_filter_attach(sock, sids, n, true);
+
+	/*
+	 * The program is copied into socket option memory (optmem_max,
+	 * 20kB by default, i.e. room for ~500 streams), which runs out
+	 * long before BPF_MAXINSNS. A failed attach leaves the previous
+	 * filter in place, dropping every stream added since, so accept
+	 * all AVTP frames instead and let the Rx thread discard unknown
+	 * streams. Raise net.core.optmem_max (or use the eBPF filter,
+	 * nc_rx_filter_create()) to avoid this.
+	 */
+	int res = _rx_filter_attach(sock, sids, n, false);
+	if (res) {
+		WARN(NULL, "%s(): filter for %d streams rejected (%s), accepting all AVTP frames, "
+			"raise net.core.optmem_max to filter in kernel", __func__, n, strerror(-res));
+		res = _rx_filter_attach(sock, sids, n, true);
+	}
+	return res;
+}
+
+int nc_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+int nc_bpf_map_create(int type, int key_sz, int val_sz, int entries)
+{
+	union bpf_attr attr = {
+		.map_type = type,
+		.key_size = key_sz,
+		.value_size = val_sz,
+		.max_entries = entries,
+	};
+	return nc_bpf(BPF_MAP_CREATE, &attr);
+}
+
+int nc_bpf_map_update(int map_fd, void *key, void *val)
+{
+	union bpf_attr attr = {
+		.map_fd = map_fd,
+		.key = (uint64_t)(uintptr_t)key,
+		.value = (uint64_t)(uintptr_t)val,
+		.flags = BPF_ANY,
+	};
+	return nc_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+int nc_bpf_map_delete(int map_fd, void *key)
+{
+	union bpf_attr attr = {
+		.map_fd = map_fd,
+		.key = (uint64_t)(uintptr_t)key,
+	};
+	return nc_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+/*
+ * eBPF Rx filter
+ *
+ * Same checks as the classic filter, but registered StreamIDs are kept
+ * in a hash map. The program has a fixed size no matter how many
+ * streams are registered (so optmem_max is not a concern), adding or
+ * removing a stream is a single map update and one program can be
+ * attached to any number of sockets (rx_sock and all fanout workers).
+ *
+ *	X = 0
+ *	A = eth.h_proto
+ *	if (A == 0x8100) { X = 4; A = vlan.h_proto }
+ *	if (A != 0x22f0) drop
+ *	if (!map_lookup(sid_map, [X+18] << 32 | [X+22])) drop
+ *	accept
+ *
+ * Legacy packet loads (LD_ABS/LD_IND) return host order and drop the
+ * frame if it is too short, so the key is the StreamID in host order.
+ */
+int nc_rx_filter_create(int max_sids, int *map_fd)
+{
+	if (max_sids <= 0 || !map_fd)
+		return -EINVAL;
+
+	int map = nc_bpf_map_create(BPF_MAP_TYPE_HASH, sizeof(uint64_t), sizeof(uint32_t), max_sids);
+	if (map < 0)
+		return -errno;
+
+	struct bpf_insn prog[] = {
+		/* 0 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+		/* 1 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_7, 0, 0, 0),
+		/* 2 */  NC_INSN(BPF_LD | BPF_H | BPF_ABS, 0, 0, 0, offsetof(struct ethhdr, h_proto)),
+		/* 3 */  NC_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 2, ETH_P_8021Q),	/* -> 6 */
+		/* 4 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_7, 0, 0, 4),
+		/* 5 */  NC_INSN(BPF_LD | BPF_H | BPF_IND, 0, BPF_REG_7, 0, offsetof(struct ethhdr, h_proto)),
+		/* 6 */  NC_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 14, ETH_P_TSN),	/* -> 21 */
+		/* 7 */  NC_INSN(BPF_LD | BPF_W | BPF_IND, 0, BPF_REG_7, 0, RX_FLT_SID_OFS),
+		/* 8 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_8, BPF_REG_0, 0, 0),
+		/* 9 */  NC_INSN(BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_8, 0, 0, 32),
+		/* 10 */ NC_INSN(BPF_LD | BPF_W | BPF_IND, 0, BPF_REG_7, 0, RX_FLT_SID_OFS + 4),
+		/* 11 */ NC_INSN(BPF_ALU64 | BPF_OR | BPF_X, BPF_REG_8, BPF_REG_0, 0, 0),
+		/* 12 */ NC_INSN(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_8, -8, 0),
+		/* 13 */ NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0),
+		/* 14 */ NC_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -8),
+		/* 15 */ NC_LD_MAP_FD(BPF_REG_1, map),
+		/* 17 */ NC_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		/* 18 */ NC_INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 2, 0),		/* -> 21 */
+		/* 19 */ NC_INSN(BPF_ALU | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, -1),
+		/* 20 */ NC_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* 21 */ NC_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0),
+		/* 22 */ NC_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+
+	char log[4096] = {0};
+	union bpf_attr attr = {
+		.prog_type = BPF_PROG_TYPE_SOCKET_FILTER,
+		.insns = (uint64_t)(uintptr_t)prog,
+		.insn_cnt = sizeof(prog) / sizeof(prog[0]),
+		.license = (uint64_t)(uintptr_t)"Dual MPL/GPL",
+		.log_buf = (uint64_t)(uintptr_t)log,
+		.log_size = sizeof(log),
+		.log_level = 1,
+	};
+	int fd = nc_bpf(BPF_PROG_LOAD, &attr);
+	if (fd < 0) {
+		int err = errno;
+		DEBUG(NULL, "%s(): failed loading Rx filter (%d, %s)\n%s",
+			__func__, err, strerror(err), log);
+		close(map);
+		return -err;
+	}
+	*map_fd = map;
+	return fd;
+}
+
+int nc_rx_filter_attach(int sock, int prog_fd)
+{
+	if (sock < 0 || prog_fd < 0)
+		return -EINVAL;
+
+	/* Replaces any previous (classic or eBPF) filter atomically */
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd)) < 0)
+		return -errno;
+	return 0;
+}
+
+int nc_rx_filter_add(int map_fd, uint64_t sid)
+{
+	uint32_t val = 1;
+	if (map_fd < 0)
+		return -EINVAL;
+	return nc_bpf_map_update(map_fd, &sid, &val) ? -errno : 0;
+}
+
+int nc_rx_filter_del(int map_fd, uint64_t sid)
+{
+	if (map_fd < 0)
+		return -EINVAL;
+	return nc_bpf_map_delete(map_fd, &sid) ? -errno : 0;
+}
+
+int nc_join_rx_fanout(int sock, int *fanout_id)
+{
+	if (sock < 0 || !fanout_id)
+		return -EINVAL;
+
+	/* First socket asks the kernel for an unused group id, the rest
+	 * join that group. Sockets are indexed in the order they join.
+	 */
+	uint32_t arg = PACKET_FANOUT_CBPF << 16;
+	if (*fanout_id < 0)
+		arg |= PACKET_FANOUT_FLAG_UNIQUEID << 16;
+	else
+		arg |= *fanout_id & 0xffff;
+
+	if (setsockopt(sock, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+		return -errno;
+
+	if (*fanout_id < 0) {
+		socklen_t len = sizeof(arg);
+		if (getsockopt(sock, SOL_PACKET, PACKET_FANOUT, &arg, &len) < 0)
+			return -errno;
+		*fanout_id = arg & 0xffff;
+	}
+	return 0;
+}
+
+/*
+ * Fanout programs run before the frame is handed to a socket, the
+ * 802.1Q tag (if any) has already been moved to skb metadata and the
+ * data starts at the AVTPDU. The return value is the index of the
+ * socket in the group.
+ */
+#define FO_HDR_LEN		3
+#define FO_SID_LEN		5
+#define FO_SID_OFS		(SKF_NET_OFF + (int)offsetof(struct avtpdu_cshdr, stream_id))
+#define FO_MAX_SIDS		((BPF_MAXINSNS - FO_HDR_LEN - 1) / FO_SID_LEN)
+
+static int _nc_set_fanout_prog(int sock, struct sock_filter *f, int len)
+{
+	struct sock_fprog prog = { .len = len, .filter = f };
+	if (setsockopt(sock, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog)) < 0)
+		return -errno;
+	return 0;
+}
+
+int nc_set_fanout_sid(int sock, const uint64_t *sids, const uint8_t *worker, int n, uint8_t def)
+{
+	if (sock < 0 || n < 0 || (n > 0 && (!sids || !worker)))
+		return -EINVAL;
+
+	/* Streams for the default worker need no entry */
+	int m = 0;
+	for (int s = 0; s < n; s++)
+		m += worker[s] != def;
+	if (m > FO_MAX_SIDS)
+		return -E2BIG;
+
+	struct sock_filter *f = calloc(FO_HDR_LEN + m * FO_SID_LEN + 1, sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+
+	int i = 0;
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL);
+	f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_TSN, 1, 0);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, def);
+	for (int s = 0; s < n; s++) {
+		if (worker[s] == def)
+			continue;
+		f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, FO_SID_OFS);
+		f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(sids[s] >> 32), 0, 3);
+		f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, FO_SID_OFS + 4);
+		f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)sids[s], 0, 1);
+		f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, worker[s]);
+	}
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, def);
+
+	int res = _nc_set_fanout_prog(sock, f, i);
+	free(f);
+	return res;
+}
+
+int nc_set_fanout_pcp(int sock, const uint8_t pcp_worker[8], uint8_t def)
+{
+	if (sock < 0 || !pcp_worker)
+		return -EINVAL;
+
+	struct sock_filter f[4 + 8 * 2 + 1];
+	int i = 0;
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT);
+	f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 2 * 8 + 2, 0);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG);
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 13);
+	for (int p = 0; p < 8; p++) {
+		f[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, p, 0, 1);
+		f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, pcp_worker[p]);
+	}
+	/* untagged */
+	f[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, def);
+
+	return _nc_set_fanout_prog(sock, f, i);
+}
+
+int nc_set_busy_poll(int sock, int usec)
+{
+	if (sock < 0 || usec < 0)
+		return -EINVAL;
+
+	/* Raising SO_BUSY_POLL above net.core.busy_read needs
+	 * CAP_NET_ADMIN. Prefer busy polling over interrupts and softirq
+	 * processing for as long as we keep polling.
+	 */
+	int prefer = usec > 0;
+	int budget = 64;
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+		return -errno;
+	if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0)
+		return -errno;
+	if (prefer && setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget)) < 0)
+		return -errno;
+	return 0;
+}
+
 int nc_create_rx_sock(const char *ifname)
 {
 	/* Can only get promiscous to work reliably for raw sockets  */
@@ -38,14 +391,28 @@ int nc_create_rx_sock(const char *ifname)
 		return -1;
 	}
 
-	int enable_ts = 1;
-	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable_ts, sizeof(enable_ts)) < 0) {
-		ERROR(NULL, "%s(): failed enabling SO_TIMESTAMPNS on Rx socket (%d, %s)",
+	/* Ask for both, raw hardware (PHC) stamps are only delivered once
+	 * the NIC has been configured, see nc_enable_rx_hwts(). Software
+	 * stamps are always present as a fallback.
+	 */
+	int ts_flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+		SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags)) < 0) {
+		ERROR(NULL, "%s(): failed enabling SO_TIMESTAMPING on Rx socket (%d, %s)",
 			__func__, errno, strerror(errno));
 		close(sock);
 		return -1;
 	}
 
+	/* Drop everything until streams are registered (nh_reg_callback()
+	 * updates the filter), attach before bind so that nothing
+	 * unfiltered is queued.
+	 */
+	int res = nc_set_rx_filter(sock, NULL, 0);
+	if (res)
+		WARN(NULL, "%s(): could not attach Rx filter (%s), all frames will be copied to userspace",
+			__func__, strerror(-res));
+
 	/* Bind to device and open in promiscous mode */
 	struct ifreq ifr = {0};
 	strncpy((char *)ifr.ifr_name, ifname, IFNAMSIZ);
@@ -79,6 +446,305 @@ int nc_create_rx_sock(const char *ifname)
 	return sock;
 }
 
+bool nc_enable_rx_hwts(int sock, const char *ifname)
+{
+	if (sock < 0 || !ifname)
+		return false;
+
+	struct hwtstamp_config cfg = {0};
+	struct ifreq ifr = {0};
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	ifr.ifr_data = (void *)&cfg;
+
+	/* Keep tx_type as is, it is likely owned by ptp4l */
+	if (ioctl(sock, SIOCGHWTSTAMP, &ifr) < 0) {
+		DEBUG(NULL, "%s(): %s cannot report hw timestamp config (%s)",
+			__func__, ifname, strerror(errno));
+		return false;
+	}
+	if (cfg.rx_filter == HWTSTAMP_FILTER_ALL)
+		return true;
+
+	cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+	if (ioctl(sock, SIOCSHWTSTAMP, &ifr) < 0) {
+		DEBUG(NULL, "%s(): %s refused timestamping all Rx frames (%s)",
+			__func__, ifname, strerror(errno));
+		return false;
+	}
+
+	/* Driver may downgrade the filter (e.g. PTP only) */
+	return cfg.rx_filter == HWTSTAMP_FILTER_ALL;
+}
+
+uint64_t nc_get_rx_ts(struct msghdr *msg, bool *hw)
+{
+	struct cmsghdr *cmsg;
+	*hw = false;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING)
+			continue;
+
+		/* ts[0] software, ts[2] raw hardware */
+		struct scm_timestamping *tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+		if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec) {
+			*hw = true;
+			return tss->ts[2].tv_sec * NS_IN_SEC + tss->ts[2].tv_nsec;
+		}
+		return tss->ts[0].tv_sec * NS_IN_SEC + tss->ts[0].tv_nsec;
+	}
+	return 0;
+}
+
+/*
+ * TPACKET_V3 Rx ring geometry
+ *
+ * 64 blocks of 64 kB gives a 4 MB ring, room for ~2000 full-sized
+ * frames. Blocks are retired after 1ms (the smallest timeout the
+ * kernel supports) to bound the added latency at low frame rates.
+ */
+#define RX_RING_BLOCK_SZ	(1 << 16)
+#define RX_RING_BLOCK_NR	64
+#define RX_RING_FRAME_SZ	(1 << 11)
+#define RX_RING_BLOCK_TOV_MS	1
+
+bool nc_setup_rx_ring(int sock, struct nc_rx_ring *ring)
+{
+	if (sock < 0 || !ring)
+		return false;
+
+	int version = TPACKET_V3;
+	if (setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		ERROR(NULL, "%s(): failed setting TPACKET_V3 (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	/* Stamp frames in the ring with PHC time when the NIC provides
+	 * it, tp_status tells which one we got.
+	 */
+	int ts_src = SOF_TIMESTAMPING_RAW_HARDWARE;
+	if (setsockopt(sock, SOL_PACKET, PACKET_TIMESTAMP, &ts_src, sizeof(ts_src)) < 0)
+		WARN(NULL, "%s(): failed requesting hw timestamps in Rx ring (%d, %s)",
+			__func__, errno, strerror(errno));
+
+	struct tpacket_req3 req = {
+		.tp_block_size = RX_RING_BLOCK_SZ,
+		.tp_block_nr = RX_RING_BLOCK_NR,
+		.tp_frame_size = RX_RING_FRAME_SZ,
+		.tp_frame_nr = (RX_RING_BLOCK_SZ / RX_RING_FRAME_SZ) * RX_RING_BLOCK_NR,
+		.tp_retire_blk_tov = RX_RING_BLOCK_TOV_MS,
+	};
+	if (setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		ERROR(NULL, "%s(): failed creating PACKET_RX_RING (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	ring->map_sz = (size_t)req.tp_block_size * req.tp_block_nr;
+	ring->map = mmap(NULL, ring->map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_LOCKED, sock, 0);
+	if (ring->map == MAP_FAILED) {
+		ERROR(NULL, "%s(): failed mapping Rx ring (%d, %s)",
+			__func__, errno, strerror(errno));
+		ring->map = NULL;
+		nc_teardown_rx_ring(sock, ring);
+		return false;
+	}
+	ring->block_sz = req.tp_block_size;
+	ring->block_nr = req.tp_block_nr;
+	ring->frame_sz = req.tp_frame_size;
+	ring->cur = 0;
+
+	return true;
+}
+
+void nc_teardown_rx_ring(int sock, struct nc_rx_ring *ring)
+{
+	if (!ring)
+		return;
+
+	if (ring->map)
+		munmap(ring->map, ring->map_sz);
+
+	/* A zeroed request releases the ring in the kernel, after which
+	 * the socket can be used with plain recvmsg() again.
+	 */
+	if (sock >= 0) {
+		struct tpacket_req3 req = {0};
+		setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+	}
+	memset(ring, 0, sizeof(*ring));
+}
+
+/*
+ * Tx ring geometry
+ *
+ * A slot is not available again until the kernel has freed the skb
+ * (i.e. the frame has left the NIC or ETF), so there must be room for
+ * all frames a channel may have queued in ETF.
+ */
+#define TX_RING_FRAME_SZ	(1 << 11)
+#define TX_RING_FRAME_NR	16
+#define TX_RING_BLOCK_SZ	(1 << 12)
+#define TX_RING_HDR_SZ		(sizeof(struct ethhdr) + 4)
+
+/* Start of the frame in a Tx ring slot */
+static inline uint8_t * _tx_ring_frame(struct nc_tx_ring *ring, unsigned int idx)
+{
+	return (uint8_t *)ring->map + (size_t)idx * ring->frame_sz +
+		TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+}
+
+uint16_t nc_chan_vlan_tci(struct channel *ch)
+{
+	uint16_t vid = 0;
+	struct srp *srp = ch->nh->srp;
+	if (ch->nh->use_srp && srp)
+		vid = ch->sc == SC_CLASS_B ? srp->vid_b : srp->vid_a;
+
+	return ((ch->pcp_prio & 0x7) << 13) | (vid & 0xfff);
+}
+
+bool nc_setup_tx_ring(struct channel *ch, bool qdisc_bypass)
+{
+	if (!ch || !ch->nh || ch->tx_sock < 0)
+		return false;
+
+	/* Protocol 0, the socket is only used for Tx */
+	int sock = socket(AF_PACKET, SOCK_RAW, 0);
+	if (sock < 0) {
+		ERROR(ch, "%s(): Failed creating raw Tx-socket: %s", __func__, strerror(errno));
+		return false;
+	}
+
+	int version = TPACKET_V2;
+	int bypass = 1;
+	struct tpacket_req req = {
+		.tp_block_size = TX_RING_BLOCK_SZ,
+		.tp_block_nr = TX_RING_FRAME_NR * TX_RING_FRAME_SZ / TX_RING_BLOCK_SZ,
+		.tp_frame_size = TX_RING_FRAME_SZ,
+		.tp_frame_nr = TX_RING_FRAME_NR,
+	};
+	struct sockaddr_ll addr = {
+		.sll_family = AF_PACKET,
+		.sll_ifindex = ch->nh->ifidx,
+	};
+	if (setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &ch->tx_sock_prio, sizeof(ch->tx_sock_prio)) < 0 ||
+		(ch->sc == SC_TAS && setsockopt(sock, SOL_SOCKET, SO_TXTIME, &ch->txtime, sizeof(ch->txtime)) < 0) ||
+		setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+		(qdisc_bypass && setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof(bypass)) < 0) ||
+		setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0 ||
+		bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ERROR(ch, "%s(): failed configuring Tx ring socket (%d, %s)",
+			__func__, errno, strerror(errno));
+		close(sock);
+		return false;
+	}
+
+	struct nc_tx_ring *ring = &ch->tx_ring;
+	ring->map_sz = (size_t)req.tp_block_size * req.tp_block_nr;
+	ring->map = mmap(NULL, ring->map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_LOCKED, sock, 0);
+	if (ring->map == MAP_FAILED) {
+		ERROR(ch, "%s(): failed mapping Tx ring (%d, %s)",
+			__func__, errno, strerror(errno));
+		memset(ring, 0, sizeof(*ring));
+		close(sock);
+		return false;
+	}
+	ring->frame_sz = req.tp_frame_size;
+	ring->frame_nr = req.tp_frame_nr;
+	ring->cur = 0;
+
+	/* Prebuild header in all slots, only the TCI is refreshed on
+	 * Tx (SRP may learn the VID after the channel is created).
+	 */
+	for (unsigned int i = 0; i < ring->frame_nr; i++) {
+		uint8_t *frame = _tx_ring_frame(ring, i);
+		struct ethhdr *eth = (struct ethhdr *)frame;
+		memcpy(eth->h_dest, ch->dst, ETH_ALEN);
+		memcpy(eth->h_source, ch->nh->mac, ETH_ALEN);
+		eth->h_proto = htons(ETH_P_8021Q);
+		uint16_t *vlan = (uint16_t *)(frame + sizeof(*eth));
+		vlan[0] = htons(nc_chan_vlan_tci(ch));
+		vlan[1] = htons(ETH_P_TSN);
+	}
+
+	close(ch->tx_sock);
+	ch->tx_sock = sock;
+	return true;
+}
+
+void nc_teardown_tx_ring(struct channel *ch)
+{
+	if (!ch || !ch->tx_ring.map)
+		return;
+	munmap(ch->tx_ring.map, ch->tx_ring.map_sz);
+	memset(&ch->tx_ring, 0, sizeof(ch->tx_ring));
+}
+
+/*
+ * Copy the AVTPDU into the next slot behind the prebuilt header and
+ * kick the socket. The control messages of msg (SCM_TXTIME) apply to
+ * all frames sent by the kick, so kicks cannot be batched across
+ * frames with different launch times.
+ *
+ * If the kick fails and the kernel did not pick up the frame, the slot
+ * is handed back and the error returned. Once picked up, the frame is
+ * queued whatever the kick returns.
+ *
+ * Returns bytes of AVTPDU sent, as sendmsg() on the DGRAM socket would.
+ */
+static int _tx_ring_send(struct channel *ch, struct msghdr *msg)
+{
+	struct nc_tx_ring *ring = &ch->tx_ring;
+	struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)((uint8_t *)ring->map + (size_t)ring->cur * ring->frame_sz);
+
+	if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	size_t sz = 0;
+	for (size_t i = 0; i < msg->msg_iovlen; i++)
+		sz += msg->msg_iov[i].iov_len;
+	if (TX_RING_HDR_SZ + sz > ring->frame_sz - (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	uint8_t *frame = _tx_ring_frame(ring, ring->cur);
+	uint16_t *vlan = (uint16_t *)(frame + sizeof(struct ethhdr));
+	vlan[0] = htons(nc_chan_vlan_tci(ch));
+
+	uint8_t *dst = frame + TX_RING_HDR_SZ;
+	for (size_t i = 0; i < msg->msg_iovlen; i++) {
+		memcpy(dst, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+		dst += msg->msg_iov[i].iov_len;
+	}
+	hdr->tp_len = TX_RING_HDR_SZ + sz;
+	__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+	struct msghdr kick = {
+		.msg_control = msg->msg_control,
+		.msg_controllen = msg->msg_controllen,
+	};
+	if (sendmsg(ch->tx_sock, &kick, MSG_DONTWAIT) < 0) {
+		/* The ring is only walked from sendmsg(), nothing else
+		 * can take the slot while we look at it */
+		uint32_t req = TP_STATUS_SEND_REQUEST;
+		int err = errno;
+		if (__atomic_compare_exchange_n(&hdr->tp_status, &req, TP_STATUS_AVAILABLE,
+							false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			errno = err;
+			return -1;
+		}
+	}
+	ring->cur = (ring->cur + 1) % ring->frame_nr;
+	return sz;
+}
+
 static int _nc_create_tx_sock(struct channel *ch)
 {
 	int sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_TSN));
@@ -108,7 +774,25 @@ static int _nc_create_tx_sock(struct channel *ch)
 	return sock;
 }
 
-static int _tas_send_at(struct channel *ch, uint64_t *tx_ns)
+/*
+ * Hand frame to the kernel, either directly or queued on the
+ * nethandler's io_uring. flags only apply to the plain socket, io_uring
+ * and the Tx ring never block.
+ */
+static int _nc_sendmsg(struct channel *ch, struct msghdr *msg, int flags)
+{
+	if (ch->uring_idx >= 0)
+		return nc_uring_sendmsg(ch, msg);
+	if (ch->tx_ring.map)
+		return _tx_ring_send(ch, msg);
+	return sendmsg(ch->tx_sock, msg, flags);
+}
+
+/*
+ * Find launch time for next TAS frame and move the channel's next Tx
+ * slot forward.
+ */
+static uint64_t _tas_txtime(struct channel *ch, uint64_t *tx_ns)
 {
 	/*
 	 * Look at next planned Tx.
@@ -118,9 +802,10 @@ static int _tas_send_at(struct channel *ch, uint64_t *tx_ns)
 	 *	   o Increment next_tx until next_tx is larger than tai
 	 *
 	 * txtime must be a bit into the future, otherwise it will be
-	 * rejected by the qdisc ETF scheduler
+	 * rejected by the qdisc ETF scheduler (launch guard, see
+	 * nh_get_tx_guard())
 	 */
-	uint64_t tai_now = tai_get_ns() + 50 * NS_IN_US;
+	uint64_t tai_now = tai_get_ns() + __atomic_load_n(&ch->nh->tas_launch_ns, __ATOMIC_RELAXED);
 	uint64_t txtime = tai_now > ch->next_tx_ns ? tai_now : ch->next_tx_ns;
 	if (tx_ns && *tx_ns > tai_now && *tx_ns < (tai_now + ch->next_tx_ns))
 		txtime = *tx_ns;
@@ -129,41 +814,51 @@ static int _tas_send_at(struct channel *ch, uint64_t *tx_ns)
 		ch->next_tx_ns = txtime + ch->interval_ns;
 	} while (ch->next_tx_ns < tai_now);
 
+	return txtime;
+}
+
+static void _set_txtime_cmsg(struct msghdr *msg, uint64_t txtime)
+{
+	struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_TXTIME;
+	cm->cmsg_len = CMSG_LEN(sizeof(__u64));
+	*((__u64 *) CMSG_DATA(cm)) = txtime;
+}
+
+static int _tas_send_at(struct channel *ch, uint64_t *tx_ns)
+{
+	uint64_t ts_start = tai_get_ns();
+	uint64_t txtime = _tas_txtime(ch, tx_ns);
+
 	/* Add control msg with txtime  */
 	struct msghdr msg = {0};
-	struct iovec iov  = {0};
+	struct iovec iov[1 + CHAN_IOV_MAX];
 
 	/* payload and destination */
-	iov.iov_base = &ch->pdu;
-	iov.iov_len = sizeof(struct avtpdu_cshdr) + ch->payload_size;
-
 	memset(&msg, 0, sizeof(msg));
 	msg.msg_name = (struct sockaddr *)&ch->sk_addr;
 	msg.msg_namelen = sizeof(ch->sk_addr);
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = nc_chan_pdu_iov(ch, iov);
 
 	/* Set TxTime in socket */
 	char control[(CMSG_SPACE(sizeof(uint64_t)))] = {0};
 	msg.msg_control = &control;
 	msg.msg_controllen = sizeof(control);
-
-	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
-	cm->cmsg_level = SOL_SOCKET;
-	cm->cmsg_type = SCM_TXTIME;
-	cm->cmsg_len = CMSG_LEN(sizeof(__u64));
-	*((__u64 *) CMSG_DATA(cm)) = txtime;
+	_set_txtime_cmsg(&msg, txtime);
 
 	if (tx_ns)
 		*tx_ns = txtime;
 
-	int txsz = sendmsg(ch->tx_sock, &msg, 0);
+	int txsz = _nc_sendmsg(ch, &msg, 0);
 	if (txsz < 1) {
 		tb_tag(ch->nh->tb, "[0x%08lx] Failed sending msg (%d)", ch->sidw.s64, errno);
 		if (nc_handle_sock_err(ch->tx_sock, ch->nh->ptp_fd) < 0)
 			return -1;
 	} else {
-		log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, txtime, txtime);
+		nc_tx_guard_sent(ch->nh, tai_get_ns() - ts_start);
+		log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, txtime, ch->nh->tx_timestamps ? 0 : txtime);
 	}
 
 	/* Report the size of the payload to the usesr, the AVTPDU
@@ -174,14 +869,16 @@ static int _tas_send_at(struct channel *ch, uint64_t *tx_ns)
 }
 static int _tas_send_at_wait(struct channel *ch, uint64_t *tx_ns)
 {
+	uint64_t ts = 0;
+	if (!tx_ns)
+		tx_ns = &ts;
 	int res = _tas_send_at(ch, tx_ns);
 	if (res < 0)
-		goto out;
-	*tx_ns += get_class_delay_bound_ns(ch);
+		return res;
 
-	while(chan_delay(ch, *tx_ns) > 50*NS_IN_US) ;
+	*tx_ns += get_class_delay_bound_ns(ch);
+	nc_wait_tai(ch->nh, *tx_ns);
 
-out:
 	return res;
 }
 
@@ -207,47 +904,148 @@ static int _tas_send_now_wait(struct channel *ch, void *data)
 	return _tas_send_at_wait(ch, NULL);
 }
 
+static int _tas_send_schedule(struct channel *ch, const struct chan_sample *samples, int n)
+{
+	struct iovec iov = {
+		.iov_base = &ch->pdu,
+		.iov_len = sizeof(struct avtpdu_cshdr) + ch->payload_size,
+	};
+	char control[(CMSG_SPACE(sizeof(uint64_t)))] = {0};
+	struct msghdr msg = {
+		.msg_name = (struct sockaddr *)&ch->sk_addr,
+		.msg_namelen = sizeof(ch->sk_addr),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = &control,
+		.msg_controllen = sizeof(control),
+	};
+
+	int queued = 0, res = 0;
+	uint64_t earliest = tai_get_ns() + __atomic_load_n(&ch->nh->tas_launch_ns, __ATOMIC_RELAXED);
+	for (int i = 0; i < n; i++) {
+		uint64_t txtime = samples[i].tx_ns;
+		uint64_t slot = ch->next_tx_ns > earliest ? ch->next_tx_ns : earliest;
+		if (!txtime) {
+			txtime = slot;
+		} else if (txtime < slot) {
+			res = -EINVAL;
+			break;
+		}
+
+		/* sendmsg() copies the frame, so the PDU can be reused */
+		res = chan_update(ch, samples[i].ts, samples[i].data);
+		if (res)
+			break;
+		_set_txtime_cmsg(&msg, txtime);
+
+		/* Never wait for room in the qdisc, leave the rest of
+		 * the schedule to the caller */
+		if (_nc_sendmsg(ch, &msg, MSG_DONTWAIT) < 1) {
+			res = errno == EWOULDBLOCK || errno == ENOBUFS ? -EAGAIN : -errno;
+			tb_tag(ch->nh->tb, "[0x%08lx] schedule stopped at %d/%d (%d)",
+				ch->sidw.s64, i, n, errno);
+			break;
+		}
+		ch->next_tx_ns = txtime + ch->interval_ns;
+		log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, txtime, ch->nh->tx_timestamps ? 0 : txtime);
+		queued++;
+	}
+
+	if (ch->uring_idx >= 0)
+		nc_uring_flush(ch->nh->uring);
+
+	return queued ? queued : res;
+}
+
+/*
+ * Token bucket on next_tx_ns (the time the bucket is full again): a
+ * frame fits if it is no more than burst-1 intervals (plus slack for
+ * wakeup jitter) ahead of it. Returns 0 if the frame is to be sent now
+ * and negative errno if dropped. Unless may_block, NC_BUDGET_BLOCK drops.
+ */
+static int _cbs_budget(struct channel *ch, uint64_t *ts_now, bool may_block)
+{
+	uint32_t burst = ch->tx_burst ? ch->tx_burst : 1;
+	uint64_t tol = (burst - 1) * ch->interval_ns + ch->interval_ns / 8;
+	uint64_t earliest = ch->next_tx_ns > tol ? ch->next_tx_ns - tol : 0;
+
+	if (*ts_now < earliest) {
+		ch->budget.over_budget++;
+		enum nc_tx_budget policy = ch->tx_budget;
+		if (policy == NC_BUDGET_BLOCK && !may_block)
+			policy = NC_BUDGET_DROP;
+
+		switch (policy) {
+		case NC_BUDGET_OFF:
+			break;
+		case NC_BUDGET_BLOCK:
+			ch->budget.blocked++;
+			nc_wait_tai(ch->nh, earliest);
+			uint64_t ts = tai_get_ns();
+			ch->budget.blocked_ns += ts - *ts_now;
+			*ts_now = ts;
+			break;
+		case NC_BUDGET_DROP:
+			/* Never sent, next update reuses the seqnr */
+			ch->budget.dropped++;
+			ch->pdu.seqnr--;
+			return -EAGAIN;
+		}
+	}
+
+	ch->next_tx_ns = (ch->next_tx_ns > *ts_now ? ch->next_tx_ns : *ts_now) + ch->interval_ns;
+	return 0;
+}
+
 static int _cbs_send_at(struct channel *ch, uint64_t *tx_ns)
 {
 	uint64_t ts_now = tai_get_ns();
 
-	/* If tx_ns is set and is far enough into the future, sleep. */
-	if (tx_ns && (*tx_ns-(100 * NS_IN_US)) > ts_now) {
-		struct timespec ts_cpu = {
-			.tv_sec = 0,
-			.tv_nsec = *tx_ns - 100 * NS_IN_US,
-		};
+	/* If tx_ns is set and into the future, wait for it (no launch
+	 * time for CBS, the frame is sent when we wake up).
+	 */
+	if (tx_ns && *tx_ns > ts_now) {
+		nc_wait_tai(ch->nh, *tx_ns);
+		ts_now = tai_get_ns();
+	}
 
-		ts_normalize(&ts_cpu);
-		if (clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts_cpu, NULL) == -1) {
-			WARN(ch, "%s() Failed waiting before Tx! (%d : %s)\n",
-				__func__, errno, strerror(errno));
-		}
-		*tx_ns = real_get_ns();
-		ts_now = *tx_ns;
-	}
-	int txsz =  sendto(ch->tx_sock,
-			&ch->pdu,
-			sizeof(struct avtpdu_cshdr) + ch->payload_size,
-			0,
-			(struct sockaddr *) &ch->sk_addr,
-			sizeof(ch->sk_addr));
+	/* The pacer sends for all channels, it must not wait */
+	int res = _cbs_budget(ch, &ts_now, !ch->pace);
+	if (res)
+		return res;
+	if (tx_ns)
+		*tx_ns = ts_now;
+
+	struct iovec iov[1 + CHAN_IOV_MAX];
+	struct msghdr msg = {
+		.msg_name = (struct sockaddr *)&ch->sk_addr,
+		.msg_namelen = sizeof(ch->sk_addr),
+		.msg_iov = iov,
+		.msg_iovlen = nc_chan_pdu_iov(ch, iov),
+	};
+	int txsz = _nc_sendmsg(ch, &msg, 0);
 	if (txsz < 0) {
 		tb_tag(ch->nh->tb, "[0x%08lx] Failed sending CBS msg (%d)", ch->sidw.s64, errno);
 	} else {
-		log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, ts_now, ts_now);
+		log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, ts_now, ch->nh->tx_timestamps ? 0 : ts_now);
 	}
 	return txsz - sizeof(struct avtpdu_cshdr);
 }
 
 static int _cbs_send_at_wait(struct channel *ch, uint64_t *tx_ns)
 {
+	/* Without tx_ns, _cbs_send_at() sends immediately */
+	uint64_t ts = 0;
+	if (!tx_ns) {
+		ts = tai_get_ns();
+		tx_ns = &ts;
+	}
 	int res = _cbs_send_at(ch, tx_ns);
 	if (res < 0)
 		return res;
 
 	*tx_ns += get_class_delay_bound_ns(ch);
-	while(chan_delay(ch, *tx_ns) > 50*NS_IN_US) ;
+	nc_wait_tai(ch->nh, *tx_ns);
 
 	return res;
 }
@@ -279,6 +1077,7 @@ static struct chan_send_ops tas_ops = {
 	.send_at_wait  = _tas_send_at_wait,
 	.send_now      = _tas_send_now,
 	.send_now_wait = _tas_send_now_wait,
+	.send_schedule = _tas_send_schedule,
 };
 
 
@@ -328,6 +1127,136 @@ bool nc_create_tas_tx_sock(struct channel *ch)
 	return true;
 }
 
+int nc_create_group_tx_sock(struct nethandler *nh, bool tas)
+{
+	if (!nh)
+		return -EINVAL;
+
+	int prio = tas ? nh->tx_tas_sock_prio : nh->tx_cbs_sock_prio;
+	int sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_TSN));
+	if (sock < 0) {
+		ERROR(NULL, "%s(): Failed creating Tx-socket: %s", __func__, strerror(errno));
+		return -errno;
+	}
+	if (setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &prio, sizeof(prio)) < 0) {
+		ERROR(NULL, "%s(): failed setting socket priority (%d, %s)",
+			__func__, errno, strerror(errno));
+		close(sock);
+		return -EINVAL;
+	}
+
+	/* Same ETF setup as nc_create_tas_tx_sock() */
+	struct sock_txtime txtime = {
+		.clockid = CLOCK_TAI,
+		.flags = SOF_TXTIME_REPORT_ERRORS,
+	};
+	if (tas && setsockopt(sock, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime))) {
+		ERROR(NULL, "%s(): failed setting SO_TXTIME (%d, %s)",
+			__func__, errno, strerror(errno));
+		close(sock);
+		return -EINVAL;
+	}
+	return sock;
+}
+
+/*
+ * sendmmsg() one class of the group. A message the kernel refuses is
+ * skipped so that it does not hold back the remaining members.
+ */
+static int _group_sendmmsg(struct chan_group *grp, int sock, int first, int nr)
+{
+	int sent = 0;
+	int i = 0;
+	while (i < nr) {
+		int res = sendmmsg(sock, &grp->msgs[first + i], nr - i, 0);
+		if (res < 0) {
+			struct channel *ch = grp->ch[first + i];
+			tb_tag(grp->nh->tb, "[0x%08lx] Failed sending group msg (%d)", ch->sidw.s64, errno);
+			nc_handle_sock_err(sock, grp->nh->ptp_fd);
+			grp->msgs[first + i].msg_len = 0;
+			i++;
+			continue;
+		}
+		sent += res;
+		i += res;
+	}
+	return sent;
+}
+
+int nc_group_send(struct chan_group *grp, uint64_t *tx_ns)
+{
+	if (!grp)
+		return -EINVAL;
+
+	const size_t ctrl_sz = CMSG_SPACE(sizeof(uint64_t));
+	uint64_t now = tai_get_ns();
+	bool use_uring = grp->nh->uring != NULL;
+
+	for (int i = 0; i < grp->nr; i++) {
+		struct channel *ch = grp->ch[i];
+		struct msghdr *msg = &grp->msgs[i].msg_hdr;
+
+		struct iovec *iov = &grp->iov[i * (1 + CHAN_IOV_MAX)];
+		memset(msg, 0, sizeof(*msg));
+		msg->msg_name = (struct sockaddr *)&ch->sk_addr;
+		msg->msg_namelen = sizeof(ch->sk_addr);
+		msg->msg_iov = iov;
+		msg->msg_iovlen = nc_chan_pdu_iov(ch, iov);
+		grp->msgs[i].msg_len = 0;
+
+		if (i < grp->nr_tas) {
+			grp->txtime[i] = _tas_txtime(ch, tx_ns);
+			msg->msg_control = grp->control + i * ctrl_sz;
+			msg->msg_controllen = ctrl_sz;
+			_set_txtime_cmsg(msg, grp->txtime[i]);
+		} else {
+			/* One member must not hold up the rest, txtime 0
+			 * marks it as dropped
+			 */
+			uint64_t ts = now;
+			grp->txtime[i] = _cbs_budget(ch, &ts, false) ? 0 : now;
+		}
+		if (ch->uring_idx < 0)
+			use_uring = false;
+	}
+
+	int sent = 0;
+	if (use_uring) {
+		for (int i = 0; i < grp->nr; i++) {
+			if (!grp->txtime[i])
+				continue;
+			int res = nc_uring_sendmsg(grp->ch[i], &grp->msgs[i].msg_hdr);
+			grp->msgs[i].msg_len = res > 0 ? res : 0;
+			sent += res > 0;
+		}
+		nc_uring_flush(grp->nh->uring);
+	} else {
+		if (grp->nr_tas)
+			sent += _group_sendmmsg(grp, grp->tas_sock, 0, grp->nr_tas);
+
+		/* CBS members in runs between the dropped ones */
+		int first = grp->nr_tas;
+		while (first < grp->nr) {
+			int end = first;
+			while (end < grp->nr && grp->txtime[end])
+				end++;
+			if (end > first)
+				sent += _group_sendmmsg(grp, grp->cbs_sock, first, end - first);
+			first = end + 1;
+		}
+	}
+
+	for (int i = 0; i < grp->nr; i++) {
+		if (grp->msgs[i].msg_len > 0)
+			log_tx(grp->nh->logger, &grp->ch[i]->pdu, grp->ch[i]->sample_ns,
+				grp->txtime[i], grp->nh->tx_timestamps ? 0 : grp->txtime[i]);
+	}
+
+	if (tx_ns && grp->nr_tas)
+		*tx_ns = grp->txtime[0];
+	return sent;
+}
+
 int nc_handle_sock_err(int sock, int ptp_fd)
 {
 	struct pollfd p_fd = {
@@ -349,37 +1278,44 @@ int nc_handle_sock_err(int sock, int ptp_fd)
 			.msg_control = msg_control,
 			.msg_controllen = sizeof(msg_control)
 		};
-		int64_t tai_ns = tai_get_ns();
 		if (recvmsg(sock, &msg, MSG_ERRQUEUE) != -1) {
 			struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
 			while (cmsg != NULL) {
 				struct sock_extended_err *serr = (void *) CMSG_DATA(cmsg);
-				if (serr->ee_origin == SO_EE_ORIGIN_TXTIME) {
-					/* The scheduled TxTime */
-					uint64_t txtime_ns = ((uint64_t) serr->ee_data << 32) + serr->ee_info;
-					double ptp_ts_ns = (double)get_ptp_ts_ns(ptp_fd);
-					const char *reason;
-
-					switch(serr->ee_code) {
-					case SO_EE_CODE_TXTIME_INVALID_PARAM:
-						reason = "invalid params";
-						break;
-					case SO_EE_CODE_TXTIME_MISSED:
-						reason = "missed deadline";
-						break;
-					default:
-						return -1;
-					}
-					ERROR(NULL, "[%"PRId64"] dropped, %s. TX to TAI: %.6f, PTP to TAI: %.6f",
-						txtime_ns,
-						reason,
-						((double)txtime_ns - tai_ns)/1e9,
-						(ptp_ts_ns - tai_ns)/1e9);
-
-				}
+				if (nc_report_txtime_err(serr, ptp_fd) < 0)
+					return -1;
 				cmsg = CMSG_NXTHDR(&msg, cmsg);
 			}
 		}
 	}
 	return 0;
 }
+
+int nc_report_txtime_err(struct sock_extended_err *serr, int ptp_fd)
+{
+	if (!serr || serr->ee_origin != SO_EE_ORIGIN_TXTIME)
+		return 0;
+
+	/* The scheduled TxTime */
+	int64_t tai_ns = tai_get_ns();
+	uint64_t txtime_ns = ((uint64_t) serr->ee_data << 32) + serr->ee_info;
+	double ptp_ts_ns = (double)get_ptp_ts_ns(ptp_fd);
+	const char *reason;
+
+	switch(serr->ee_code) {
+	case SO_EE_CODE_TXTIME_INVALID_PARAM:
+		reason = "invalid params";
+		break;
+	case SO_EE_CODE_TXTIME_MISSED:
+		reason = "missed deadline";
+		break;
+	default:
+		return -1;
+	}
+	ERROR(NULL, "[%"PRId64"] dropped, %s. TX to TAI: %.6f, PTP to TAI: %.6f",
+		txtime_ns,
+		reason,
+		((double)txtime_ns - tai_ns)/1e9,
+		(ptp_ts_ns - tai_ns)/1e9);
+	return 1;
+}
@@ -143,7 +143,7 @@ bool nc_srp_setup(struct nethandler *nh)
 
 	/* Start monitor thread to start processing messages.
 	 */
-	if (pthread_create(&srp->tid, NULL, nc_srp_monitor, (void *)nh)) {
+	if (nh_create_thread(nh, &srp->tid, nc_srp_monitor, (void *)nh, nh->srp_sched_prio, nh->srp_cpu)) {
 		ERROR(NULL, "%s(): FAILED creating monitor thread", __func__);
 		goto err_out;
 	}
@@ -169,7 +169,8 @@ bool nc_srp_setup(struct nethandler *nh)
 		goto err_out;
 	}
 
-	if (pthread_create(&srp->announcer, NULL, nc_srp_talker_announce, (void *)nh)) {
+	if (nh_create_thread(nh, &srp->announcer, nc_srp_talker_announce, (void *)nh,
+				nh->srp_sched_prio, nh->srp_cpu)) {
 		ERROR(NULL, "Failed starting SRP Talker announcer");
 		goto err_out;
 	}
@@ -3,6 +3,9 @@ static struct nethandler *_nh;
 static bool verbose = false;
 static bool do_srp = false;
 static bool use_tracebuffer = false;
+static bool use_rx_ring = false;
+static int xdp_queue = -1;
+static bool no_promisc = false;
 static int break_us = -1;
 static char nc_nic[IFNAMSIZ] = {0};
 static char nc_logfile[129] = {0};
@@ -30,6 +33,19 @@ void nc_use_ftrace(void)
 {
 	use_tracebuffer = true;
 }
+void nc_use_rx_ring(void)
+{
+	use_rx_ring = true;
+}
+void nc_use_xdp(int queue)
+{
+	if (queue >= 0)
+		xdp_queue = queue;
+}
+void nc_no_promisc(void)
+{
+	no_promisc = true;
+}
 void nc_breakval(int b_us)
 {
 	if (b_us > 0 && b_us < 1000000)
@@ -87,7 +103,7 @@ int nc_rx_create(char *name, struct channel_attrs *attrs, int sz)
 	if (!chan)
 		return -1;
 
-	return chan->fd_r;
+	return 0;
 }
 
 
@@ -102,6 +118,12 @@ int nh_create_init_standalone(void)
 		nh_set_verbose(_nh, verbose);
 		nh_set_srp(_nh, do_srp);
 		nh_set_trace_breakval(_nh, break_us);
+		if (use_rx_ring && !nh_set_rx_ring(_nh, true))
+			return -1;
+		if (xdp_queue >= 0 && !nh_enable_xdp(_nh, xdp_queue))
+			return -1;
+		if (no_promisc && !nh_set_promisc(_nh, false))
+			return -1;
 
 		if (!nh_set_tx_prio(_nh, SC_TAS, tx_tas_sock_prio))
 			return -1;
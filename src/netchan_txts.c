@@ -0,0 +1,338 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+
+#include <netchan_txts.h>
+#include <logger.h>
+#include <tracebuffer.h>
+
+#define TXTS_EVENTS		16
+#define TXTS_TIMEOUT_MS		100
+
+/* Room for Ethernet, 802.1Q and AVTPDU header, the rest is truncated */
+#define TXTS_DATA_SZ		64
+#define TXTS_CTRL_SZ		512
+
+/* Initial room for streams with TXTIME stats, doubled when full */
+#define TXTS_STREAMS		16
+
+struct nc_txts_stream {
+	uint64_t sid;
+	struct chan_txtime_stats st;
+};
+
+struct nc_txts {
+	struct nethandler *nh;
+	int epfd;
+	bool stamps;
+
+	/* Serializes draining with removal of sockets and stats queries */
+	pthread_mutex_t lock;
+	pthread_t tid;
+	bool running;
+
+	/* Streams that have reported errors, unordered. Only searched
+	 * when an error is reported or stats are queried, an entry is
+	 * removed with its channel (nc_txts_del()).
+	 */
+	struct nc_txts_stream *streams;
+	int nr_streams;
+	int sz_streams;
+};
+
+static struct chan_txtime_stats * _txts_stats(struct nc_txts *txts, uint64_t sid, bool create)
+{
+	for (int i = 0; i < txts->nr_streams; i++) {
+		if (txts->streams[i].sid == sid)
+			return &txts->streams[i].st;
+	}
+	if (!create)
+		return NULL;
+
+	if (txts->nr_streams == txts->sz_streams) {
+		int sz = txts->sz_streams ? 2 * txts->sz_streams : TXTS_STREAMS;
+		struct nc_txts_stream *streams = realloc(txts->streams, sz * sizeof(*streams));
+		if (!streams)
+			return NULL;
+		txts->streams = streams;
+		txts->sz_streams = sz;
+	}
+	struct nc_txts_stream *s = &txts->streams[txts->nr_streams++];
+	memset(s, 0, sizeof(*s));
+	s->sid = sid;
+	return &s->st;
+}
+
+static void _txts_forget(struct nc_txts *txts, uint64_t sid)
+{
+	for (int i = 0; i < txts->nr_streams; i++) {
+		if (txts->streams[i].sid == sid) {
+			txts->streams[i] = txts->streams[--txts->nr_streams];
+			return;
+		}
+	}
+}
+
+static void _txts_account(struct chan_txtime_stats *st, uint8_t code, uint64_t late_ns)
+{
+	switch (code) {
+	case SO_EE_CODE_TXTIME_MISSED:
+		st->missed++;
+		break;
+	case SO_EE_CODE_TXTIME_INVALID_PARAM:
+		st->invalid++;
+		break;
+	default:
+		return;
+	}
+
+	uint64_t late_us = late_ns / NS_IN_US;
+	int bin = late_us ? 64 - __builtin_clzll(late_us) : 0;
+	st->hist[bin < CHAN_TXTIME_HIST_BINS ? bin : CHAN_TXTIME_HIST_BINS - 1]++;
+	if (late_ns > st->max_late_ns)
+		st->max_late_ns = late_ns;
+}
+
+/*
+ * ETF clones the frame into the error queue, so the stream is known
+ * unless the frame is too short.
+ */
+static void _txts_txtime_err(struct nc_txts *txts, struct sock_extended_err *serr,
+			struct avtpdu_cshdr *du)
+{
+	uint64_t txtime_ns = ((uint64_t) serr->ee_data << 32) + serr->ee_info;
+	uint64_t now = tai_get_ns();
+	uint64_t late_ns = now > txtime_ns ? now - txtime_ns : 0;
+	uint64_t sid = du ? be64toh(du->stream_id) : 0;
+
+	/* Launch guard was too tight (or the system too slow) */
+	nc_tx_guard_missed(txts->nh, late_ns);
+
+	struct chan_txtime_stats *st = du ? _txts_stats(txts, sid, true) : NULL;
+	if (st)
+		_txts_account(st, serr->ee_code, late_ns);
+	else
+		tb_tag(txts->nh->tb, "TXTIME error (%u) for unknown stream, txtime %lu",
+			serr->ee_code, txtime_ns);
+
+	log_txtime_err(txts->nh->logger, sid, du ? du->seqnr : 0, txtime_ns, late_ns, serr->ee_code);
+}
+
+/*
+ * Find the AVTPDU in a looped Tx frame, the frame starts with the
+ * Ethernet header (the skb is cloned after the header is added).
+ */
+static struct avtpdu_cshdr * _txts_pdu(uint8_t *data, ssize_t sz)
+{
+	size_t off = sizeof(struct ethhdr);
+	if (sz < (ssize_t)(off + sizeof(struct avtpdu_cshdr)))
+		return NULL;
+
+	uint16_t proto = ((struct ethhdr *)data)->h_proto;
+	if (proto == htons(ETH_P_8021Q)) {
+		proto = *(uint16_t *)(data + off + 2);
+		off += 4;
+	}
+	if (proto != htons(ETH_P_TSN) || sz < (ssize_t)(off + sizeof(struct avtpdu_cshdr)))
+		return NULL;
+	return (struct avtpdu_cshdr *)(data + off);
+}
+
+/*
+ * Read everything queued on the socket's error queue
+ *
+ * @returns number of reports handled
+ */
+static int _txts_drain(struct nc_txts *txts, int sock)
+{
+	uint8_t data[TXTS_DATA_SZ];
+	uint8_t control[TXTS_CTRL_SZ];
+	int n = 0;
+
+	for (;;) {
+		struct iovec iov = {
+			.iov_base = data,
+			.iov_len = sizeof(data),
+		};
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		ssize_t sz = recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (sz < 0)
+			break;
+
+		struct sock_extended_err *serr = NULL;
+		struct scm_timestamping *tss = NULL;
+		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+				tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+			else if (cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_TX_TIMESTAMP)
+				serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+		}
+		if (!serr)
+			continue;
+		n++;
+
+		struct avtpdu_cshdr *du = _txts_pdu(data, sz);
+		if (serr->ee_origin == SO_EE_ORIGIN_TXTIME) {
+			_txts_txtime_err(txts, serr, du);
+			continue;
+		}
+		if (serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING || !tss || !du)
+			continue;
+
+		/* ts[0] software, ts[2] raw hardware */
+		bool hw = tss->ts[2].tv_sec || tss->ts[2].tv_nsec;
+		struct timespec *ts = hw ? &tss->ts[2] : &tss->ts[0];
+		uint64_t ts_ns = ts->tv_sec * NS_IN_SEC + ts->tv_nsec;
+
+		switch (serr->ee_info) {
+		case SCM_TSTAMP_SCHED:
+			log_tx_ts(txts->nh->logger, be64toh(du->stream_id), du->seqnr, ts_ns, 0, false);
+			break;
+		case SCM_TSTAMP_SND:
+			log_tx_ts(txts->nh->logger, be64toh(du->stream_id), du->seqnr, 0, ts_ns, hw);
+			break;
+		}
+	}
+	return n;
+}
+
+static void * _txts_runner(void *data)
+{
+	struct nc_txts *txts = data;
+	struct epoll_event ev[TXTS_EVENTS];
+
+	while (__atomic_load_n(&txts->running, __ATOMIC_ACQUIRE)) {
+		int n = epoll_wait(txts->epfd, ev, TXTS_EVENTS, TXTS_TIMEOUT_MS);
+		for (int i = 0; i < n; i++) {
+			pthread_mutex_lock(&txts->lock);
+			_txts_drain(txts, ev[i].data.fd);
+			pthread_mutex_unlock(&txts->lock);
+		}
+	}
+	return NULL;
+}
+
+struct nc_txts * nc_txts_create(struct nethandler *nh)
+{
+	if (!nh)
+		return NULL;
+
+	struct nc_txts *txts = calloc(1, sizeof(*txts));
+	if (!txts)
+		return NULL;
+	txts->nh = nh;
+	pthread_mutex_init(&txts->lock, NULL);
+
+	txts->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (txts->epfd < 0) {
+		ERROR(NULL, "%s(): failed creating epoll fd (%s)", __func__, strerror(errno));
+		free(txts);
+		return NULL;
+	}
+
+	/* Housekeeping, not time critical, runs with default policy */
+	txts->running = true;
+	int res = nh_create_thread(nh, &txts->tid, _txts_runner, txts, 0, -1);
+	if (res) {
+		ERROR(NULL, "%s(): failed creating collector thread (%s)", __func__, strerror(-res));
+		close(txts->epfd);
+		free(txts);
+		return NULL;
+	}
+	return txts;
+}
+
+void nc_txts_destroy(struct nc_txts **txts)
+{
+	if (!txts || !*txts)
+		return;
+
+	__atomic_store_n(&(*txts)->running, false, __ATOMIC_RELEASE);
+	pthread_join((*txts)->tid, NULL);
+	close((*txts)->epfd);
+	pthread_mutex_destroy(&(*txts)->lock);
+	free((*txts)->streams);
+	free(*txts);
+	*txts = NULL;
+}
+
+void nc_txts_enable_stamps(struct nc_txts *txts)
+{
+	if (txts)
+		txts->stamps = true;
+}
+
+int nc_txts_add(struct nc_txts *txts, int sock)
+{
+	if (!txts || sock < 0)
+		return -EINVAL;
+
+	/* The frame is looped back with the timestamp (no OPT_TSONLY),
+	 * that is what identifies the stream and seqnr. OPT_TX_SWHW keeps
+	 * the software stamp if the NIC also stamps in hardware.
+	 */
+	int ts_flags = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE |
+		SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_SOFTWARE |
+		SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_TX_SWHW;
+	if (txts->stamps &&
+		setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags)) < 0) {
+		ERROR(NULL, "%s(): failed enabling Tx timestamps (%d, %s)",
+			__func__, errno, strerror(errno));
+		return -errno;
+	}
+
+	/* EPOLLERR is always reported, nothing else is of interest */
+	struct epoll_event ev = {
+		.events = 0,
+		.data.fd = sock,
+	};
+	if (epoll_ctl(txts->epfd, EPOLL_CTL_ADD, sock, &ev) < 0 && errno != EEXIST) {
+		ERROR(NULL, "%s(): failed adding socket to collector (%d, %s)",
+			__func__, errno, strerror(errno));
+		return -errno;
+	}
+	return 0;
+}
+
+void nc_txts_del(struct nc_txts *txts, int sock, uint64_t sid)
+{
+	if (!txts || sock < 0)
+		return;
+
+	pthread_mutex_lock(&txts->lock);
+	epoll_ctl(txts->epfd, EPOLL_CTL_DEL, sock, NULL);
+	if (sid)
+		_txts_forget(txts, sid);
+	pthread_mutex_unlock(&txts->lock);
+}
+
+int nc_txts_get_stats(struct nc_txts *txts, uint64_t sid, struct chan_txtime_stats *stats)
+{
+	if (!txts || !stats)
+		return -EINVAL;
+
+	pthread_mutex_lock(&txts->lock);
+	struct chan_txtime_stats *st = _txts_stats(txts, sid, false);
+	if (st)
+		*stats = *st;
+	else
+		memset(stats, 0, sizeof(*stats));
+	pthread_mutex_unlock(&txts->lock);
+	return 0;
+}
@@ -0,0 +1,575 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/if_packet.h>
+#include <linux/io_uring.h>
+
+#include <netchan_uring.h>
+#include <logger.h>
+#include <tracebuffer.h>
+
+/*
+ * Ring geometry
+ *
+ * The Tx ring has one slot per SQE, a slot is not reused until its
+ * completion has been reaped so the SQ can never overflow. Rx buffers
+ * hold the recvmsg header, sockaddr_ll, control messages (timestamps)
+ * and a full frame.
+ */
+#define URING_TX_ENTRIES	256
+#define URING_TX_FILES		1024
+#define URING_FRAME_SZ		1522
+#define URING_RX_ENTRIES	64
+#define URING_RX_BUFS		256
+#define URING_RX_BUF_SZ		2048
+#define URING_RX_CTRL_SZ	128
+#define URING_RX_BGID		0
+#define URING_RX_UDATA		(~0ULL)
+
+/*
+ * nc_uring_q - userspace view of one io_uring (SQ, CQ and SQEs)
+ */
+struct nc_uring_q {
+	int fd;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	struct io_uring_sqe *sqes;
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* SQEs added since last io_uring_enter() */
+	uint32_t pending;
+
+	void *map;
+	size_t map_sz;
+	size_t sqes_sz;
+};
+
+/*
+ * One outgoing frame. Everything sendmsg() needs lives in the slot so
+ * that the caller's msghdr and the channel's PDU can be reused while
+ * the frame is queued.
+ */
+struct nc_uring_tx {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_ll addr;
+	uint8_t control[CMSG_SPACE(sizeof(uint64_t))];
+	int sock;
+	uint64_t sid;
+	uint8_t frame[URING_FRAME_SZ];
+};
+
+struct nc_uring {
+	struct nethandler *nh;
+
+	/* Tx, serialized by tx_lock as multiple Tx channels share the ring */
+	struct nc_uring_q tx;
+	pthread_mutex_t tx_lock;
+	bool batch_tx;
+	struct nc_uring_tx *slots;
+	uint16_t tx_free[URING_TX_ENTRIES];
+	int tx_free_nr;
+	int files[URING_TX_FILES];
+	uint64_t tx_errors;
+
+	/* Rx, only touched by the Rx thread (or nh_poll() caller) */
+	struct nc_uring_q rx;
+	struct io_uring_buf_ring *br;
+	size_t br_sz;
+	uint8_t *rx_bufs;
+	size_t rx_bufs_sz;
+	struct msghdr rx_msg;
+	bool rx_armed;
+};
+
+static int _uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+			unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int _uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static bool _uring_q_init(struct nc_uring_q *q, unsigned int entries)
+{
+	struct io_uring_params p = {
+		.flags = IORING_SETUP_CLAMP,
+	};
+	q->fd = _uring_setup(entries, &p);
+	if (q->fd < 0) {
+		ERROR(NULL, "%s(): io_uring_setup failed (%d, %s)", __func__, errno, strerror(errno));
+		return false;
+	}
+
+	/* SQ and CQ share one mapping, the SQ array is identity-mapped
+	 * once so that SQEs can be used in order.
+	 */
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+		ERROR(NULL, "%s(): io_uring too old (features 0x%x)", __func__, p.features);
+		return false;
+	}
+	size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	q->map_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+	q->map = mmap(NULL, q->map_sz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQ_RING);
+	if (q->map == MAP_FAILED) {
+		q->map = NULL;
+		return false;
+	}
+	q->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	q->sqes = mmap(NULL, q->sqes_sz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQES);
+	if (q->sqes == MAP_FAILED) {
+		q->sqes = NULL;
+		return false;
+	}
+
+	uint8_t *m = q->map;
+	q->sq_head = (uint32_t *)(m + p.sq_off.head);
+	q->sq_tail = (uint32_t *)(m + p.sq_off.tail);
+	q->sq_mask = *(uint32_t *)(m + p.sq_off.ring_mask);
+	q->sq_entries = p.sq_entries;
+	q->cq_head = (uint32_t *)(m + p.cq_off.head);
+	q->cq_tail = (uint32_t *)(m + p.cq_off.tail);
+	q->cq_mask = *(uint32_t *)(m + p.cq_off.ring_mask);
+	q->cqes = (struct io_uring_cqe *)(m + p.cq_off.cqes);
+
+	uint32_t *array = (uint32_t *)(m + p.sq_off.array);
+	for (uint32_t i = 0; i < p.sq_entries; i++)
+		array[i] = i;
+	return true;
+}
+
+static void _uring_q_destroy(struct nc_uring_q *q)
+{
+	if (q->sqes)
+		munmap(q->sqes, q->sqes_sz);
+	if (q->map)
+		munmap(q->map, q->map_sz);
+	if (q->fd >= 0)
+		close(q->fd);
+	q->fd = -1;
+}
+
+/* Next free SQE (zeroed), caller makes sure there is room */
+static struct io_uring_sqe * _uring_get_sqe(struct nc_uring_q *q)
+{
+	uint32_t tail = *q->sq_tail;
+	struct io_uring_sqe *sqe = &q->sqes[tail & q->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static void _uring_push_sqe(struct nc_uring_q *q)
+{
+	__atomic_store_n(q->sq_tail, *q->sq_tail + 1, __ATOMIC_RELEASE);
+	q->pending++;
+}
+
+/* Submit pending SQEs and optionally wait for min_complete CQEs */
+static int _uring_submit(struct nc_uring_q *q, unsigned int min_complete, int timeout_ms)
+{
+	struct __kernel_timespec ts = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_nsec = (timeout_ms % 1000) * NS_IN_MS,
+	};
+	struct io_uring_getevents_arg arg = {
+		.ts = (uint64_t)(uintptr_t)&ts,
+	};
+	unsigned int flags = min_complete ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+
+	if (!q->pending && !min_complete)
+		return 0;
+
+	int res = _uring_enter(q->fd, q->pending, min_complete, flags,
+			min_complete ? &arg : NULL, min_complete ? sizeof(arg) : 0);
+	if (res < 0)
+		return -errno;
+	q->pending -= res;
+	return res;
+}
+
+/* Return completed Tx slots to the free-stack, tx_lock held */
+static void _uring_reap_tx(struct nc_uring *u)
+{
+	struct nc_uring_q *q = &u->tx;
+	uint32_t head = *q->cq_head;
+	uint32_t tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &q->cqes[head & q->cq_mask];
+		struct nc_uring_tx *slot = &u->slots[cqe->user_data];
+		if (cqe->res < 0) {
+			u->tx_errors++;
+			tb_tag(u->nh->tb, "[0x%08lx] Failed sending msg (%d)", slot->sid, -cqe->res);
+			nc_handle_sock_err(slot->sock, u->nh->ptp_fd);
+		}
+		u->tx_free[u->tx_free_nr++] = cqe->user_data;
+	}
+	__atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static bool _uring_setup_tx(struct nc_uring *u)
+{
+	if (!_uring_q_init(&u->tx, URING_TX_ENTRIES))
+		return false;
+
+	/* Sparse table, Tx sockets are added as channels are created */
+	for (int i = 0; i < URING_TX_FILES; i++)
+		u->files[i] = -1;
+	if (_uring_register(u->tx.fd, IORING_REGISTER_FILES, u->files, URING_TX_FILES)) {
+		ERROR(NULL, "%s(): failed registering file table (%d, %s)", __func__, errno, strerror(errno));
+		return false;
+	}
+
+	u->slots = calloc(u->tx.sq_entries, sizeof(*u->slots));
+	if (!u->slots)
+		return false;
+	for (uint32_t i = 0; i < u->tx.sq_entries; i++)
+		u->tx_free[u->tx_free_nr++] = i;
+	return true;
+}
+
+static void _uring_recycle_buf(struct nc_uring *u, uint16_t bid, uint16_t *tail)
+{
+	struct io_uring_buf *buf = &u->br->bufs[*tail & (URING_RX_BUFS - 1)];
+	buf->addr = (uint64_t)(uintptr_t)(u->rx_bufs + (size_t)bid * URING_RX_BUF_SZ);
+	buf->len = URING_RX_BUF_SZ;
+	buf->bid = bid;
+	(*tail)++;
+}
+
+static bool _uring_setup_rx(struct nc_uring *u)
+{
+	if (!_uring_q_init(&u->rx, URING_RX_ENTRIES))
+		return false;
+
+	int fd = u->nh->rx_sock;
+	if (_uring_register(u->rx.fd, IORING_REGISTER_FILES, &fd, 1)) {
+		ERROR(NULL, "%s(): failed registering rx_sock (%d, %s)", __func__, errno, strerror(errno));
+		return false;
+	}
+
+	u->br_sz = URING_RX_BUFS * sizeof(struct io_uring_buf);
+	u->br = mmap(NULL, u->br_sz, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	u->rx_bufs_sz = (size_t)URING_RX_BUFS * URING_RX_BUF_SZ;
+	u->rx_bufs = mmap(NULL, u->rx_bufs_sz, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (u->br == MAP_FAILED || u->rx_bufs == MAP_FAILED) {
+		u->br = u->br == MAP_FAILED ? NULL : u->br;
+		u->rx_bufs = u->rx_bufs == MAP_FAILED ? NULL : u->rx_bufs;
+		ERROR(NULL, "%s(): failed allocating Rx buffers (%d, %s)", __func__, errno, strerror(errno));
+		return false;
+	}
+
+	struct io_uring_buf_reg reg = {
+		.ring_addr = (uint64_t)(uintptr_t)u->br,
+		.ring_entries = URING_RX_BUFS,
+		.bgid = URING_RX_BGID,
+	};
+	if (_uring_register(u->rx.fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+		ERROR(NULL, "%s(): failed registering buffer ring (%d, %s)", __func__, errno, strerror(errno));
+		return false;
+	}
+
+	/* Hand all buffers to the kernel up front */
+	uint16_t tail = 0;
+	for (uint16_t i = 0; i < URING_RX_BUFS; i++)
+		_uring_recycle_buf(u, i, &tail);
+	__atomic_store_n(&u->br->tail, tail, __ATOMIC_RELEASE);
+
+	/* Only the lengths are used by multishot recvmsg, they fix the
+	 * layout of every buffer.
+	 */
+	u->rx_msg.msg_namelen = sizeof(struct sockaddr_ll);
+	u->rx_msg.msg_controllen = URING_RX_CTRL_SZ;
+	return true;
+}
+
+struct nc_uring * nc_uring_create(struct nethandler *nh, bool batch_tx)
+{
+	if (!nh || nh->rx_sock < 0)
+		return NULL;
+
+	struct nc_uring *u = calloc(1, sizeof(*u));
+	if (!u)
+		return NULL;
+	u->nh = nh;
+	u->batch_tx = batch_tx;
+	u->tx.fd = -1;
+	u->rx.fd = -1;
+
+	pthread_mutexattr_t mtx_attr;
+	pthread_mutexattr_init(&mtx_attr);
+	pthread_mutexattr_setprotocol(&mtx_attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&u->tx_lock, &mtx_attr);
+
+	if (!_uring_setup_tx(u) || !_uring_setup_rx(u)) {
+		nc_uring_destroy(&u);
+		return NULL;
+	}
+	return u;
+}
+
+void nc_uring_destroy(struct nc_uring **uring)
+{
+	if (!uring || !*uring)
+		return;
+	struct nc_uring *u = *uring;
+
+	/* Closing the rings cancels the multishot receive and releases
+	 * the registered files and buffer ring.
+	 */
+	_uring_q_destroy(&u->rx);
+	_uring_q_destroy(&u->tx);
+	if (u->br)
+		munmap(u->br, u->br_sz);
+	if (u->rx_bufs)
+		munmap(u->rx_bufs, u->rx_bufs_sz);
+	free(u->slots);
+
+	pthread_mutex_destroy(&u->tx_lock);
+	free(u);
+	*uring = NULL;
+}
+
+int nc_uring_get_fd(struct nc_uring *uring)
+{
+	return uring ? uring->rx.fd : -EINVAL;
+}
+
+static int _uring_update_file(struct nc_uring *u, int idx, int fd)
+{
+	struct io_uring_files_update up = {
+		.offset = idx,
+		.fds = (uint64_t)(uintptr_t)&fd,
+	};
+	int res = _uring_register(u->tx.fd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+	return res < 0 ? -errno : 0;
+}
+
+int nc_uring_add_tx(struct nc_uring *uring, struct channel *ch)
+{
+	if (!uring || !ch || ch->tx_sock < 0)
+		return -EINVAL;
+
+	int res = -ENOSPC;
+	pthread_mutex_lock(&uring->tx_lock);
+	for (int i = 0; i < URING_TX_FILES; i++) {
+		if (uring->files[i] >= 0)
+			continue;
+		res = _uring_update_file(uring, i, ch->tx_sock);
+		if (!res) {
+			uring->files[i] = ch->tx_sock;
+			ch->uring_idx = i;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&uring->tx_lock);
+	return res;
+}
+
+void nc_uring_del_tx(struct nc_uring *uring, struct channel *ch)
+{
+	if (!uring || !ch || ch->uring_idx < 0)
+		return;
+
+	/* Frames in flight hold their own ref to the file, only queued
+	 * SQEs refer to the slot in the table.
+	 */
+	pthread_mutex_lock(&uring->tx_lock);
+	_uring_submit(&uring->tx, 0, 0);
+	_uring_update_file(uring, ch->uring_idx, -1);
+	uring->files[ch->uring_idx] = -1;
+	ch->uring_idx = -1;
+	pthread_mutex_unlock(&uring->tx_lock);
+}
+
+int nc_uring_sendmsg(struct channel *ch, struct msghdr *msg)
+{
+	if (!ch || !ch->nh || !ch->nh->uring || ch->uring_idx < 0 || !msg) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct nc_uring *u = ch->nh->uring;
+
+	size_t sz = 0;
+	for (size_t i = 0; i < msg->msg_iovlen; i++)
+		sz += msg->msg_iov[i].iov_len;
+	if (sz > URING_FRAME_SZ || msg->msg_namelen > sizeof(struct sockaddr_ll) ||
+		msg->msg_controllen > sizeof(((struct nc_uring_tx *)0)->control)) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	pthread_mutex_lock(&u->tx_lock);
+	_uring_reap_tx(u);
+	if (!u->tx_free_nr) {
+		/* All slots queued or in flight, push them out and wait
+		 * for the first to complete.
+		 */
+		_uring_submit(&u->tx, 1, 1000);
+		_uring_reap_tx(u);
+		if (!u->tx_free_nr) {
+			pthread_mutex_unlock(&u->tx_lock);
+			errno = ENOBUFS;
+			return -1;
+		}
+	}
+	uint16_t idx = u->tx_free[--u->tx_free_nr];
+	struct nc_uring_tx *slot = &u->slots[idx];
+
+	uint8_t *dst = slot->frame;
+	for (size_t i = 0; i < msg->msg_iovlen; i++) {
+		memcpy(dst, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+		dst += msg->msg_iov[i].iov_len;
+	}
+	slot->iov.iov_base = slot->frame;
+	slot->iov.iov_len = sz;
+	memcpy(&slot->addr, msg->msg_name, msg->msg_namelen);
+	memcpy(slot->control, msg->msg_control, msg->msg_controllen);
+	slot->msg = (struct msghdr) {
+		.msg_name = &slot->addr,
+		.msg_namelen = msg->msg_namelen,
+		.msg_iov = &slot->iov,
+		.msg_iovlen = 1,
+		.msg_control = msg->msg_controllen ? slot->control : NULL,
+		.msg_controllen = msg->msg_controllen,
+	};
+	slot->sock = ch->tx_sock;
+	slot->sid = ch->sidw.s64;
+
+	struct io_uring_sqe *sqe = _uring_get_sqe(&u->tx);
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = ch->uring_idx;
+	sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+	sqe->len = 1;
+	sqe->user_data = idx;
+	_uring_push_sqe(&u->tx);
+
+	if (!u->batch_tx)
+		_uring_submit(&u->tx, 0, 0);
+	pthread_mutex_unlock(&u->tx_lock);
+
+	return sz;
+}
+
+int nc_uring_flush(struct nc_uring *uring)
+{
+	if (!uring)
+		return -EINVAL;
+
+	pthread_mutex_lock(&uring->tx_lock);
+	int res = _uring_submit(&uring->tx, 0, 0);
+	_uring_reap_tx(uring);
+	pthread_mutex_unlock(&uring->tx_lock);
+	return res;
+}
+
+static void _uring_arm_rx(struct nc_uring *u)
+{
+	struct io_uring_sqe *sqe = _uring_get_sqe(&u->rx);
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->fd = 0;
+	sqe->addr = (uint64_t)(uintptr_t)&u->rx_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->buf_group = URING_RX_BGID;
+	sqe->user_data = URING_RX_UDATA;
+	_uring_push_sqe(&u->rx);
+	u->rx_armed = true;
+}
+
+int nc_uring_rx(struct nethandler *nh, int timeout_ms)
+{
+	if (!nh || !nh->uring)
+		return -EINVAL;
+	struct nc_uring *u = nh->uring;
+	struct nc_uring_q *q = &u->rx;
+
+	if (!u->rx_armed)
+		_uring_arm_rx(u);
+
+	uint32_t head = *q->cq_head;
+	uint32_t tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+	if (head == tail || q->pending) {
+		int res = _uring_submit(q, timeout_ms ? 1 : 0, timeout_ms);
+		if (res < 0 && res != -ETIME && res != -EINTR)
+			WARN(NULL, "%s(): io_uring_enter failed (%d, %s)", __func__, -res, strerror(-res));
+		tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	/* At most one PTP read for the batch, and none if all frames
+	 * carry a hardware stamp.
+	 */
+	uint64_t batch_ptp_ns = 0;
+	uint16_t br_tail = u->br->tail;
+	int n = 0;
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &q->cqes[head & q->cq_mask];
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			u->rx_armed = false;
+		if (cqe->res < 0) {
+			/* Out of buffers (re-armed on next call) or the
+			 * thread that armed the receive has exited.
+			 */
+			if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+				WARN(NULL, "%s(): recvmsg failed (%d, %s)", __func__, -cqe->res, strerror(-cqe->res));
+			continue;
+		}
+		if (!(cqe->flags & IORING_CQE_F_BUFFER))
+			continue;
+
+		uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		uint8_t *buf = u->rx_bufs + (size_t)bid * URING_RX_BUF_SZ;
+		struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+		uint8_t *control = buf + sizeof(*out) + u->rx_msg.msg_namelen;
+		uint8_t *payload = control + u->rx_msg.msg_controllen;
+
+		if (!(out->flags & MSG_TRUNC) && out->payloadlen > 0) {
+			struct msghdr msg = {
+				.msg_control = control,
+				.msg_controllen = out->controllen,
+			};
+			bool rx_hw;
+			uint64_t rx_ns = nc_get_rx_ts(&msg, &rx_hw);
+			if (!rx_hw && !batch_ptp_ns)
+				batch_ptp_ns = get_ptp_ts_ns(nh->ptp_fd);
+			nh_feed_frame_ts(nh, payload, rx_ns, rx_hw ? rx_ns : batch_ptp_ns, rx_hw);
+			n++;
+		}
+		_uring_recycle_buf(u, bid, &br_tail);
+	}
+	__atomic_store_n(&u->br->tail, br_tail, __ATOMIC_RELEASE);
+	__atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
@@ -0,0 +1,604 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#include <netchan_xdp.h>
+#include <logger.h>
+#include <tracebuffer.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/*
+ * UMEM geometry
+ *
+ * 4096 frames of 2kB (8MB). The lower half is owned by the fill/Rx
+ * rings, the upper half is kept on a free-stack for Tx. Each ring holds
+ * exactly the number of frames that can be in flight on it.
+ */
+#define XDP_FRAME_SZ		2048
+#define XDP_NUM_FRAMES		4096
+#define XDP_RING_SZ		(XDP_NUM_FRAMES / 2)
+#define XDP_XSKMAP_SZ		64
+
+/*
+ * nc_xdp_ring - userspace view of one of the four XSK rings
+ *
+ * Rx/fill are only touched by the Rx thread, Tx/completion are
+ * serialized by tx_lock as multiple Tx channels share the socket.
+ */
+struct nc_xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *desc;
+	uint32_t mask;
+	void *map;
+	size_t map_sz;
+};
+
+struct nc_xdp {
+	int fd;
+	int ifidx;
+	int queue_id;
+
+	void *umem;
+	size_t umem_sz;
+
+	struct nc_xdp_ring fq;
+	struct nc_xdp_ring cq;
+	struct nc_xdp_ring rx;
+	struct nc_xdp_ring tx;
+
+	/* Free Tx frames (UMEM addresses) */
+	pthread_mutex_t tx_lock;
+	uint64_t tx_free[XDP_RING_SZ];
+	int tx_free_nr;
+
+	int sid_map_fd;
+	int xsk_map_fd;
+	int prog_fd;
+	int link_fd;
+};
+
+/*
+ * Load the XDP program
+ *
+ * Equivalent to:
+ *
+ *	if (frame too short) return XDP_PASS;
+ *	proto = eth->h_proto;
+ *	if (proto == 802.1Q) { skip tag; proto = inner proto }
+ *	if (proto != ETH_P_TSN) return XDP_PASS;
+ *	if (!map_lookup(sid_map, &avtp->stream_id)) return XDP_PASS;
+ *	return bpf_redirect_map(xsk_map, ctx->rx_queue_index, XDP_PASS);
+ *
+ * The StreamID is used as key exactly as it is found in the frame
+ * (i.e. htobe64()'d).
+ */
+static int _xdp_load_prog(struct nc_xdp *xdp)
+{
+	/* offset of stream_id in frame, ethhdr + 4 bytes into avtpdu_cshdr */
+	const int sid_off = sizeof(struct ethhdr) + 4;
+	const int min_sz = sid_off + sizeof(uint64_t);
+
+	struct bpf_insn prog[] = {
+		/* 0 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+		/* 1 */  NC_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0),
+		/* 2 */  NC_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0),
+		/* 3 */  NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		/* 4 */  NC_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, min_sz),
+		/* 5 */  NC_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 21, 0),	/* -> 27 */
+		/* 6 */  NC_INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0),
+		/* 7 */  NC_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 4, htons(ETH_P_8021Q)), /* -> 12 */
+		/* 8 */  NC_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, 4),
+		/* 9 */  NC_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 4),
+		/* 10 */ NC_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 16, 0),	/* -> 27 */
+		/* 11 */ NC_INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0),
+		/* 12 */ NC_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 14, htons(ETH_P_TSN)), /* -> 27 */
+		/* 13 */ NC_INSN(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_1, BPF_REG_2, sid_off, 0),
+		/* 14 */ NC_INSN(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_1, -8, 0),
+		/* 15 */ NC_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0),
+		/* 16 */ NC_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -8),
+		/* 17 */ NC_LD_MAP_FD(BPF_REG_1, xdp->sid_map_fd),
+		/* 19 */ NC_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		/* 20 */ NC_INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 6, 0),		/* -> 27 */
+		/* 21 */ NC_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+		/* 22 */ NC_LD_MAP_FD(BPF_REG_1, xdp->xsk_map_fd),
+		/* 24 */ NC_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+		/* 25 */ NC_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+		/* 26 */ NC_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* 27 */ NC_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+		/* 28 */ NC_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+
+	char log[4096] = {0};
+	union bpf_attr attr = {
+		.prog_type = BPF_PROG_TYPE_XDP,
+		.insns = (uint64_t)(uintptr_t)prog,
+		.insn_cnt = sizeof(prog) / sizeof(prog[0]),
+		.license = (uint64_t)(uintptr_t)"Dual MPL/GPL",
+		.log_buf = (uint64_t)(uintptr_t)log,
+		.log_size = sizeof(log),
+		.log_level = 1,
+		.expected_attach_type = BPF_XDP,
+	};
+	int fd = nc_bpf(BPF_PROG_LOAD, &attr);
+	if (fd < 0)
+		ERROR(NULL, "%s(): failed loading XDP program (%d, %s)\n%s",
+			__func__, errno, strerror(errno), log);
+	return fd;
+}
+
+static int _xdp_attach(struct nc_xdp *xdp)
+{
+	/* Prefer native (driver) XDP, fall back to generic (skb) mode
+	 * for NICs (and lo/veth) without driver support.
+	 */
+	const uint32_t modes[] = { XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE };
+	for (int i = 0; i < 2; i++) {
+		union bpf_attr attr = {
+			.link_create = {
+				.prog_fd = xdp->prog_fd,
+				.target_ifindex = xdp->ifidx,
+				.attach_type = BPF_XDP,
+				.flags = modes[i],
+			},
+		};
+		int fd = nc_bpf(BPF_LINK_CREATE, &attr);
+		if (fd >= 0) {
+			INFO(NULL, "%s(): XDP program attached in %s mode",
+				__func__, i == 0 ? "native" : "generic");
+			return fd;
+		}
+	}
+	ERROR(NULL, "%s(): failed attaching XDP program (%d, %s)",
+		__func__, errno, strerror(errno));
+	return -1;
+}
+
+static bool _xdp_map_ring(struct nc_xdp *xdp, struct nc_xdp_ring *ring,
+			struct xdp_ring_offset *off, size_t desc_sz, off_t pgoff)
+{
+	ring->map_sz = off->desc + XDP_RING_SZ * desc_sz;
+	ring->map = mmap(NULL, ring->map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, xdp->fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return false;
+	}
+	ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+	ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+	ring->flags    = (uint32_t *)((uint8_t *)ring->map + off->flags);
+	ring->desc     = (uint8_t *)ring->map + off->desc;
+	ring->mask     = XDP_RING_SZ - 1;
+	return true;
+}
+
+static void _xdp_unmap_ring(struct nc_xdp_ring *ring)
+{
+	if (ring->map)
+		munmap(ring->map, ring->map_sz);
+	memset(ring, 0, sizeof(*ring));
+}
+
+static bool _xdp_setup_xsk(struct nc_xdp *xdp)
+{
+	xdp->fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (xdp->fd < 0) {
+		ERROR(NULL, "%s(): failed creating AF_XDP socket (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	xdp->umem_sz = (size_t)XDP_NUM_FRAMES * XDP_FRAME_SZ;
+	xdp->umem = mmap(NULL, xdp->umem_sz, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (xdp->umem == MAP_FAILED) {
+		xdp->umem = NULL;
+		ERROR(NULL, "%s(): failed allocating UMEM (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	struct xdp_umem_reg reg = {
+		.addr = (uint64_t)(uintptr_t)xdp->umem,
+		.len = xdp->umem_sz,
+		.chunk_size = XDP_FRAME_SZ,
+	};
+	if (setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg))) {
+		ERROR(NULL, "%s(): failed registering UMEM (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	int ring_sz = XDP_RING_SZ;
+	if (setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_sz, sizeof(ring_sz)) ||
+		setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_sz, sizeof(ring_sz)) ||
+		setsockopt(xdp->fd, SOL_XDP, XDP_RX_RING, &ring_sz, sizeof(ring_sz)) ||
+		setsockopt(xdp->fd, SOL_XDP, XDP_TX_RING, &ring_sz, sizeof(ring_sz))) {
+		ERROR(NULL, "%s(): failed sizing XSK rings (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	if (getsockopt(xdp->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+		ERROR(NULL, "%s(): failed reading ring offsets (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	if (!_xdp_map_ring(xdp, &xdp->fq, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+		!_xdp_map_ring(xdp, &xdp->cq, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) ||
+		!_xdp_map_ring(xdp, &xdp->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+		!_xdp_map_ring(xdp, &xdp->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING)) {
+		ERROR(NULL, "%s(): failed mapping XSK rings (%d, %s)",
+			__func__, errno, strerror(errno));
+		return false;
+	}
+
+	/* Hand all Rx frames to the kernel up front */
+	uint64_t *fq_desc = xdp->fq.desc;
+	for (int i = 0; i < XDP_RING_SZ; i++)
+		fq_desc[i] = (uint64_t)i * XDP_FRAME_SZ;
+	__atomic_store_n(xdp->fq.producer, XDP_RING_SZ, __ATOMIC_RELEASE);
+
+	for (int i = 0; i < XDP_RING_SZ; i++)
+		xdp->tx_free[i] = (uint64_t)(XDP_RING_SZ + i) * XDP_FRAME_SZ;
+	xdp->tx_free_nr = XDP_RING_SZ;
+
+	/* Zero-copy requires driver support, retry in copy-mode if it
+	 * is not available.
+	 */
+	struct sockaddr_xdp sxdp = {
+		.sxdp_family = AF_XDP,
+		.sxdp_ifindex = xdp->ifidx,
+		.sxdp_queue_id = xdp->queue_id,
+		.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY,
+	};
+	if (bind(xdp->fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+		sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+		if (bind(xdp->fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+			ERROR(NULL, "%s(): failed binding XSK to queue %d (%d, %s)",
+				__func__, xdp->queue_id, errno, strerror(errno));
+			return false;
+		}
+		WARN(NULL, "%s(): zero-copy not supported, XSK running in copy-mode", __func__);
+	}
+	return true;
+}
+
+struct nc_xdp * nc_xdp_create(struct nethandler *nh, int queue_id)
+{
+	if (!nh || nh->ifidx <= 0 || queue_id < 0 || queue_id >= XDP_XSKMAP_SZ)
+		return NULL;
+
+	struct nc_xdp *xdp = calloc(1, sizeof(*xdp));
+	if (!xdp)
+		return NULL;
+	xdp->fd = -1;
+	xdp->sid_map_fd = -1;
+	xdp->xsk_map_fd = -1;
+	xdp->prog_fd = -1;
+	xdp->link_fd = -1;
+	xdp->ifidx = nh->ifidx;
+	xdp->queue_id = queue_id;
+
+	pthread_mutexattr_t mtx_attr;
+	pthread_mutexattr_init(&mtx_attr);
+	pthread_mutexattr_setprotocol(&mtx_attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&xdp->tx_lock, &mtx_attr);
+
+	if (!_xdp_setup_xsk(xdp))
+		goto err;
+
+	xdp->sid_map_fd = nc_bpf_map_create(BPF_MAP_TYPE_HASH, sizeof(uint64_t), sizeof(uint32_t), nh->hmap_sz);
+	xdp->xsk_map_fd = nc_bpf_map_create(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t), sizeof(int), XDP_XSKMAP_SZ);
+	if (xdp->sid_map_fd < 0 || xdp->xsk_map_fd < 0) {
+		ERROR(NULL, "%s(): failed creating BPF maps (%d, %s)",
+			__func__, errno, strerror(errno));
+		goto err;
+	}
+
+	uint32_t key = queue_id;
+	if (nc_bpf_map_update(xdp->xsk_map_fd, &key, &xdp->fd)) {
+		ERROR(NULL, "%s(): failed adding XSK to map (%d, %s)",
+			__func__, errno, strerror(errno));
+		goto err;
+	}
+
+	xdp->prog_fd = _xdp_load_prog(xdp);
+	if (xdp->prog_fd < 0)
+		goto err;
+
+	xdp->link_fd = _xdp_attach(xdp);
+	if (xdp->link_fd < 0)
+		goto err;
+
+	return xdp;
+err:
+	nc_xdp_destroy(&xdp);
+	return NULL;
+}
+
+void nc_xdp_destroy(struct nc_xdp **xdp)
+{
+	if (!xdp || !*xdp)
+		return;
+
+	/* Closing the link detaches the program from the NIC */
+	if ((*xdp)->link_fd >= 0)
+		close((*xdp)->link_fd);
+	if ((*xdp)->prog_fd >= 0)
+		close((*xdp)->prog_fd);
+	if ((*xdp)->xsk_map_fd >= 0)
+		close((*xdp)->xsk_map_fd);
+	if ((*xdp)->sid_map_fd >= 0)
+		close((*xdp)->sid_map_fd);
+
+	_xdp_unmap_ring(&(*xdp)->fq);
+	_xdp_unmap_ring(&(*xdp)->cq);
+	_xdp_unmap_ring(&(*xdp)->rx);
+	_xdp_unmap_ring(&(*xdp)->tx);
+	if ((*xdp)->fd >= 0)
+		close((*xdp)->fd);
+	if ((*xdp)->umem)
+		munmap((*xdp)->umem, (*xdp)->umem_sz);
+
+	pthread_mutex_destroy(&(*xdp)->tx_lock);
+	free(*xdp);
+	*xdp = NULL;
+}
+
+int nc_xdp_add_stream(struct nc_xdp *xdp, uint64_t stream_id)
+{
+	if (!xdp)
+		return -EINVAL;
+	uint64_t key = htobe64(stream_id);
+	uint32_t val = 1;
+	return nc_bpf_map_update(xdp->sid_map_fd, &key, &val) ? -errno : 0;
+}
+
+int nc_xdp_del_stream(struct nc_xdp *xdp, uint64_t stream_id)
+{
+	if (!xdp)
+		return -EINVAL;
+	uint64_t key = htobe64(stream_id);
+	return nc_bpf_map_delete(xdp->sid_map_fd, &key) ? -errno : 0;
+}
+
+int nc_xdp_get_fd(struct nc_xdp *xdp)
+{
+	return xdp ? xdp->fd : -EINVAL;
+}
+
+int nc_xdp_rx(struct nethandler *nh, int timeout_ms)
+{
+	if (!nh || !nh->xdp)
+		return -EINVAL;
+	struct nc_xdp *xdp = nh->xdp;
+
+	uint32_t cons = *xdp->rx.consumer;
+	uint32_t prod = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE);
+	if (prod == cons) {
+		struct pollfd pfd = {
+			.fd = xdp->fd,
+			.events = POLLIN,
+		};
+		if (poll(&pfd, 1, timeout_ms) <= 0)
+			return 0;
+		prod = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE);
+	}
+
+	/* No timestamps are provided by the XSK, read clocks once for
+	 * the entire batch.
+	 */
+	uint64_t recv_ptp_ns = get_ptp_ts_ns(nh->ptp_fd);
+	uint64_t rx_ns = real_get_ns();
+
+	struct xdp_desc *rx_desc = xdp->rx.desc;
+	uint64_t *fq_desc = xdp->fq.desc;
+	uint32_t fq_prod = *xdp->fq.producer;
+	int n = 0;
+
+	for (; cons != prod; cons++, fq_prod++, n++) {
+		struct xdp_desc *d = &rx_desc[cons & xdp->rx.mask];
+		nh_feed_frame_ts(nh, (unsigned char *)xdp->umem + d->addr, rx_ns, recv_ptp_ns, false);
+
+		/* Frame handled, return to kernel. The fill ring is as
+		 * large as the number of Rx frames, so it cannot be full.
+		 */
+		fq_desc[fq_prod & xdp->fq.mask] = d->addr & ~((uint64_t)XDP_FRAME_SZ - 1);
+	}
+	__atomic_store_n(xdp->rx.consumer, cons, __ATOMIC_RELEASE);
+	__atomic_store_n(xdp->fq.producer, fq_prod, __ATOMIC_RELEASE);
+
+	if (__atomic_load_n(xdp->fq.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+		recvfrom(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+
+	return n;
+}
+
+/* Move completed Tx frames back to the free-stack, tx_lock held */
+static void _xdp_reclaim_tx(struct nc_xdp *xdp)
+{
+	uint32_t cons = *xdp->cq.consumer;
+	uint32_t prod = __atomic_load_n(xdp->cq.producer, __ATOMIC_ACQUIRE);
+	uint64_t *cq_desc = xdp->cq.desc;
+
+	for (; cons != prod; cons++)
+		xdp->tx_free[xdp->tx_free_nr++] = cq_desc[cons & xdp->cq.mask];
+	__atomic_store_n(xdp->cq.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static void _xdp_kick_tx(struct nc_xdp *xdp)
+{
+	if (__atomic_load_n(xdp->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+		sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+int nc_xdp_send(struct channel *ch)
+{
+	if (!ch || !ch->nh || !ch->nh->xdp)
+		return -EINVAL;
+	struct nc_xdp *xdp = ch->nh->xdp;
+	const size_t hdr_sz = sizeof(struct ethhdr) + 4;
+	const size_t pdu_sz = sizeof(struct avtpdu_cshdr) + ch->payload_size;
+
+	pthread_mutex_lock(&xdp->tx_lock);
+	_xdp_reclaim_tx(xdp);
+	if (!xdp->tx_free_nr) {
+		_xdp_kick_tx(xdp);
+		_xdp_reclaim_tx(xdp);
+		if (!xdp->tx_free_nr) {
+			pthread_mutex_unlock(&xdp->tx_lock);
+			return -ENOBUFS;
+		}
+	}
+	uint64_t addr = xdp->tx_free[--xdp->tx_free_nr];
+
+	uint8_t *frame = (uint8_t *)xdp->umem + addr;
+	struct ethhdr *eth = (struct ethhdr *)frame;
+	memcpy(eth->h_dest, ch->dst, ETH_ALEN);
+	memcpy(eth->h_source, ch->nh->mac, ETH_ALEN);
+	eth->h_proto = htons(ETH_P_8021Q);
+	uint16_t *vlan = (uint16_t *)(frame + sizeof(*eth));
+	/* The frames bypass the Qdisc (and thereby the SO_PRIORITY ->
+	 * PCP mapping), so tag them explicitly.
+	 */
+	vlan[0] = htons(nc_chan_vlan_tci(ch));
+	vlan[1] = htons(ETH_P_TSN);
+	struct iovec iov[1 + CHAN_IOV_MAX];
+	int iovcnt = nc_chan_pdu_iov(ch, iov);
+	uint8_t *dst = frame + hdr_sz;
+	for (int i = 0; i < iovcnt; i++) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+
+	/* Tx ring is as large as the number of Tx frames, so there is
+	 * always room for a frame we managed to grab.
+	 */
+	uint32_t prod = *xdp->tx.producer;
+	struct xdp_desc *d = &((struct xdp_desc *)xdp->tx.desc)[prod & xdp->tx.mask];
+	d->addr = addr;
+	d->len = hdr_sz + pdu_sz;
+	d->options = 0;
+	__atomic_store_n(xdp->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+	_xdp_kick_tx(xdp);
+	pthread_mutex_unlock(&xdp->tx_lock);
+
+	return hdr_sz + pdu_sz;
+}
+
+/*
+ * There is no ETF below the XSK, so the txtime cannot be handed to the
+ * kernel. Instead, enforce next_tx_ns for both TAS and CBS and wait in
+ * userspace until the frame is eligible for Tx.
+ */
+static int _xdp_send_at(struct channel *ch, uint64_t *tx_ns)
+{
+	uint64_t tai_now = tai_get_ns();
+	uint64_t txtime = tai_now > ch->next_tx_ns ? tai_now : ch->next_tx_ns;
+	if (tx_ns && *tx_ns > txtime)
+		txtime = *tx_ns;
+
+	if (txtime > tai_now) {
+		struct timespec ts_cpu = {
+			.tv_sec = 0,
+			.tv_nsec = txtime,
+		};
+		ts_normalize(&ts_cpu);
+		if (clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts_cpu, NULL) == -1) {
+			WARN(ch, "%s() Failed waiting before Tx! (%d : %s)\n",
+				__func__, errno, strerror(errno));
+		}
+	}
+	ch->next_tx_ns = txtime + ch->interval_ns;
+
+	int txsz = nc_xdp_send(ch);
+	if (txsz < 0) {
+		tb_tag(ch->nh->tb, "[0x%08lx] Failed sending XDP msg (%d)", ch->sidw.s64, txsz);
+		return txsz;
+	}
+	uint64_t sent_ns = tai_get_ns();
+	log_tx(ch->nh->logger, &ch->pdu, ch->sample_ns, txtime, sent_ns);
+	if (tx_ns)
+		*tx_ns = sent_ns;
+
+	return ch->payload_size;
+}
+
+static int _xdp_send_at_wait(struct channel *ch, uint64_t *tx_ns)
+{
+	uint64_t ts = 0;
+	if (!tx_ns)
+		tx_ns = &ts;
+	int res = _xdp_send_at(ch, tx_ns);
+	if (res < 0)
+		return res;
+
+	*tx_ns += get_class_delay_bound_ns(ch);
+	nc_wait_tai(ch->nh, *tx_ns);
+
+	return res;
+}
+
+static int _xdp_send_now(struct channel *ch, void *data)
+{
+	uint64_t ts_ns = tai_get_ns();
+	if (chan_update(ch, ts_ns, data)) {
+		ERROR(ch, "%s(): chan_update failed", __func__);
+		return -1;
+	}
+
+	return _xdp_send_at(ch, NULL);
+}
+
+static int _xdp_send_now_wait(struct channel *ch, void *data)
+{
+	uint64_t ts_ns = tai_get_ns();
+	if (chan_update(ch, ts_ns, data)) {
+		ERROR(ch, "%s(): chan_update failed", __func__);
+		return -1;
+	}
+
+	return _xdp_send_at_wait(ch, NULL);
+}
+
+static struct chan_send_ops xdp_ops = {
+	.send_at       = _xdp_send_at,
+	.send_at_wait  = _xdp_send_at_wait,
+	.send_now      = _xdp_send_now,
+	.send_now_wait = _xdp_send_now_wait,
+};
+
+bool nc_create_xdp_tx(struct channel *ch)
+{
+	if (!ch || !ch->nh || !ch->nh->xdp)
+		return false;
+	ch->ops = &xdp_ops;
+	return true;
+}
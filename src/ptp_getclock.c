@@ -58,7 +58,7 @@ int get_ptp_fd(const char *ifname)
 	 * this case, it is better to fail early and either force the
 	 * caller to use CLOCK_REALTIME or just abort.
 	 */
-	if (strncmp(ifname, "lo", 2) == 0)
+	if (strcmp(ifname, "lo") == 0)
 		return -1;
 
 	struct ifreq req;
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2026 SINTEF AS
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not distributed
+ * with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+ */
+/*
+ * Microbenchmark of Rx dispatch, cost of nh_feed_pdu_ts() for a frame
+ * belonging to a registered stream (hit) and to an unrelated stream
+ * (miss) as the number of registered streams grows.
+ */
+#include <stdio.h>
+#include <time.h>
+
+/* include c directly to get at cb_priv */
+#include "../src/netchan.c"
+#include "../src/netchan_standalone.c"
+#include "../src/netchan_socket.c"
+#include "../src/netchan_xdp.c"
+#include "../src/netchan_uring.c"
+#include "../src/netchan_txts.c"
+#include "../src/netchan_pacer.c"
+#include "../src/netchan_ring.c"
+#include "../src/netchan_lv.c"
+
+#define BENCH_MAX_STREAMS 4096
+#define BENCH_ITERS (1 << 20)
+
+static int bench_cb(void *priv, struct avtpdu_cshdr *du)
+{
+	(void)priv;
+	(void)du;
+	return 0;
+}
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+}
+
+/* StreamIDs are usually MAC + index, so most of the bits are shared */
+static uint64_t bench_sid(int i)
+{
+	return 0x0000010203040000ULL | (uint64_t)i;
+}
+
+static double bench_feed(struct nethandler *nh, struct avtpdu_cshdr *pdus, int npdus)
+{
+	uint64_t start = bench_now_ns();
+	for (int i = 0; i < BENCH_ITERS; i++)
+		nh_feed_pdu_ts(nh, &pdus[i & (npdus - 1)], 0, 0);
+	return (double)(bench_now_ns() - start) / BENCH_ITERS;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *nic = argc > 1 ? argv[1] : "lo";
+	static struct cb_priv cbp[BENCH_MAX_STREAMS];
+	static struct avtpdu_cshdr hit[BENCH_MAX_STREAMS];
+	static struct avtpdu_cshdr miss[BENCH_MAX_STREAMS];
+
+	printf("%8s %12s %12s\n", "streams", "hit (ns)", "miss (ns)");
+	for (int n = 1; n <= BENCH_MAX_STREAMS; n <<= 1) {
+		struct nethandler *nh = nh_create_init(nic, n, NULL);
+		if (!nh) {
+			fprintf(stderr, "Failed creating nethandler on %s\n", nic);
+			return 1;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if (nh_reg_callback(nh, bench_sid(i), &cbp[i], bench_cb)) {
+				fprintf(stderr, "Failed registering stream %d\n", i);
+				nh_destroy(&nh);
+				return 1;
+			}
+			hit[i].stream_id = htobe64(bench_sid(i));
+			miss[i].stream_id = htobe64(bench_sid(BENCH_MAX_STREAMS + i));
+		}
+
+		double hit_ns = bench_feed(nh, hit, n);
+		double miss_ns = bench_feed(nh, miss, n);
+		printf("%8d %12.2f %12.2f\n", n, hit_ns, miss_ns);
+
+		nh_destroy(&nh);
+	}
+	return 0;
+}
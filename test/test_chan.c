@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include "unity.h"
 #include "test_net_fifo.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 /*
  * Test of external channel interface
@@ -14,6 +20,14 @@ struct channel_attrs chanattr = {
 	.interval_ns      = INT_50HZ,
 	.name      = "test1"};
 
+/* veth pair for test_chan_xdp_veth(), torn down in tearDown() */
+#define XDP_NETNS	"nc_xdp_test"
+#define XDP_VETH_RX	"nc_xdp0"
+#define XDP_VETH_TX	"nc_xdp1"
+static struct nethandler *xdp_rnh;
+static struct nethandler *xdp_tnh;
+static bool xdp_veth_up;
+
 void setUp(void)
 {
 	nh = nh_create_init("lo", 16, NULL);
@@ -23,6 +37,16 @@ void tearDown(void)
 {
 	if (nh)
 		nh_destroy(&nh);
+	if (xdp_tnh)
+		nh_destroy(&xdp_tnh);
+	if (xdp_rnh)
+		nh_destroy(&xdp_rnh);
+	if (xdp_veth_up) {
+		/* Removing the namespace takes the veth pair with it */
+		xdp_veth_up = false;
+		TEST_ASSERT_EQUAL_INT_MESSAGE(0, system("ip netns del " XDP_NETNS),
+					"failed removing netns " XDP_NETNS);
+	}
 }
 
 static void test_create_tx_channel(void)
@@ -34,8 +58,7 @@ static void test_create_tx_channel(void)
 	TEST_ASSERT_NOT_NULL(ch);
 	TEST_ASSERT(ch->nh == nh);
 	TEST_ASSERT(ch->sidw.s64 == 42);
-	TEST_ASSERT(ch->fd_r > 0);
-	TEST_ASSERT(ch->fd_w > 0);
+	TEST_ASSERT_NULL_MESSAGE(ch->ring, "Tx channel should not have an Rx ring");
 
 	TEST_ASSERT_MESSAGE(ch->tx_sock_prio == DEFAULT_TX_CBS_SOCKET_PRIO, "Invalid socket-prio.");
 	TEST_ASSERT_MESSAGE(ch->tx_sock > 0, "Invalid socket for Tx-channel.");
@@ -50,6 +73,16 @@ static void test_create_rx_channel(void)
 
 	TEST_ASSERT_NOT_NULL_MESSAGE(ch, "Channel not created with valid arguments");
 	TEST_ASSERT_NOT_NULL_MESSAGE(ch->cbp, "Generic callback not created for Rx channel");
+	TEST_ASSERT_NOT_NULL_MESSAGE(ch->ring, "Ring not created for Rx channel");
+
+	/* StreamID already taken, first channel must keep receiving */
+	TEST_ASSERT_NULL(chan_create_rx(nh, &chanattr));
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx);
+	uint64_t data = 0xabcd, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, &data) > 0);
+	TEST_ASSERT(chan_read(ch, &rx_data) > 0);
+	TEST_ASSERT(rx_data == data);
 }
 
 /* Gradually assemble and channel and make sure chan_valid() triggers on
@@ -72,9 +105,6 @@ static void test_chan_valid(void)
 	TEST_ASSERT(!chan_valid(&ch));
 	ch.payload_size = 8;
 	TEST_ASSERT(!chan_valid(&ch));
-	ch.fd_w = 1;
-	ch.fd_r = 2;
-	TEST_ASSERT(!chan_valid(&ch));
 
 	ch.ready = true;
 	ch.interval_ns = 12345;
@@ -86,12 +116,17 @@ static void test_chan_valid(void)
 
 	char buffer[128] = {0};
 	ch.cbp = (struct cb_priv *)buffer;
+	TEST_ASSERT(!chan_valid(&ch));
 
+	/* ..and a ring to read from */
+	char ring_buffer[128] = {0};
+	ch.ring = (struct nc_ring *)ring_buffer;
 	TEST_ASSERT(chan_valid(&ch));
 	/* Tx-sock should not have callback memory set */
 	ch.tx_sock = 1;
 	TEST_ASSERT(!chan_valid(&ch));
 	ch.cbp = NULL;
+	ch.ring = NULL;
 	TEST_ASSERT(chan_valid(&ch));
 
 	struct channel *ch2 = chan_create_tx(nh, &chanattr);
@@ -192,6 +227,956 @@ static void test_chan_stop(void)
 	TEST_ASSERT(chan_read(rx, (void *)&rx_data) < 0);
 }
 
+static void test_chan_rx_ring(void)
+{
+	TEST_ASSERT(!nh_set_rx_ring(NULL, true));
+	TEST_ASSERT(nh_set_rx_ring(nh, true));
+	TEST_ASSERT(nh->use_rx_ring);
+
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	uint64_t data = 0xdeadbeef;
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	TEST_ASSERT_EQUAL_UINT64_MESSAGE(data, rx_data, "Rx'd data from ring should match Tx'd");
+
+	/* Revert to recvmsg() and make sure frames still arrive */
+	TEST_ASSERT(nh_set_rx_ring(nh, false));
+	TEST_ASSERT(!nh->use_rx_ring);
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+}
+
+static void test_chan_read_borrow(void)
+{
+	TEST_ASSERT_NULL(chan_read_borrow(NULL, NULL));
+	TEST_ASSERT(chan_read_release(NULL) == -EINVAL);
+
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	/* Nothing borrowed yet */
+	TEST_ASSERT(chan_read_release(rx) == -EINVAL);
+
+	uint64_t data = 0xdeadbeef;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+
+	const struct ring_meta *meta = NULL;
+	const uint64_t *val = chan_read_borrow(rx, &meta);
+	TEST_ASSERT_NOT_NULL(val);
+	TEST_ASSERT_NOT_NULL(meta);
+	TEST_ASSERT(val == (const uint64_t *)meta->payload);
+	TEST_ASSERT(((uintptr_t)val & (sizeof(uint64_t) - 1)) == 0);
+	TEST_ASSERT_EQUAL_UINT64(data, *val);
+	TEST_ASSERT_MESSAGE(meta->ts_rx_ns > 0, "Rx timestamp missing from borrowed sample");
+
+	/* lo only stamps in software */
+	TEST_ASSERT_FALSE(meta->ts_rx_hw);
+
+	/* Same slot until released */
+	TEST_ASSERT(chan_read_borrow(rx, NULL) == val);
+	TEST_ASSERT(chan_read_release(rx) == 0);
+	TEST_ASSERT(chan_read_release(rx) == -EINVAL);
+
+	/* Copying reads still work and move on to the next sample (lo
+	 * may deliver each frame twice)
+	 */
+	data = 0xcafebabe;
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+}
+
+/* Look for addr in the kernel's list of multicast groups for lo */
+static bool _lo_has_mcast(const uint8_t *addr)
+{
+	char want[13], line[256];
+	snprintf(want, sizeof(want), "%02x%02x%02x%02x%02x%02x",
+		addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+
+	FILE *f = fopen("/proc/net/dev_mcast", "r");
+	if (!f)
+		return false;
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), f)) {
+		char ifname[IFNAMSIZ], hw[64];
+		int idx, users, global;
+		if (sscanf(line, "%d %15s %d %d %63s", &idx, ifname, &users, &global, hw) == 5)
+			found = strcmp(ifname, "lo") == 0 && strcmp(hw, want) == 0;
+	}
+	fclose(f);
+	return found;
+}
+
+static void test_chan_mcast_no_promisc(void)
+{
+	TEST_ASSERT(!nh_set_promisc(NULL, false));
+	TEST_ASSERT(nh_set_promisc(nh, false));
+	TEST_ASSERT(!nh->promisc);
+
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT(rx->mc_member);
+	TEST_ASSERT(!tx->mc_member);
+	TEST_ASSERT(_lo_has_mcast(chanattr.dst));
+
+	/* Multicast still arrives without promiscuous mode */
+	uint64_t data = 0xfeedf00d, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+
+	/* Leaving follows the channel lifecycle */
+	TEST_ASSERT(chan_stop(rx));
+	TEST_ASSERT(!rx->mc_member);
+	TEST_ASSERT(!_lo_has_mcast(chanattr.dst));
+}
+
+static uint64_t _rxw_frames(int idx)
+{
+	/* counter is updated by the worker after the frame is delivered */
+	for (int i = 0; i < 100 && !__atomic_load_n(&nh->rxw[idx].frames, __ATOMIC_RELAXED); i++)
+		usleep(1000);
+	return __atomic_load_n(&nh->rxw[idx].frames, __ATOMIC_RELAXED);
+}
+
+static void test_chan_rx_fanout(void)
+{
+	TEST_ASSERT(!nh_set_rx_fanout(NULL, true, NH_FANOUT_SID));
+	TEST_ASSERT(!nh_set_rx_worker(nh, SC_CLASS_A, -1, -1));
+	TEST_ASSERT(!nh_set_rx_worker(nh, SC_CLASS_A, 0, -2));
+	TEST_ASSERT(nh_set_rx_worker(nh, SC_CLASS_A, 0, 0));
+	TEST_ASSERT(nh_set_rx_fanout(nh, true, NH_FANOUT_SID));
+	TEST_ASSERT(nh->use_rx_fanout);
+	TEST_ASSERT(!nh_enable_xdp(nh, 0));
+
+	struct channel_attrs attr_b = chanattr;
+	attr_b.stream_id = 43;
+	attr_b.sc = SC_CLASS_B;
+	attr_b.interval_ns = INT_10HZ;
+	struct channel *rx_a = chan_create_rx(nh, &chanattr);
+	struct channel *tx_a = chan_create_tx(nh, &chanattr);
+	struct channel *rx_b = chan_create_rx(nh, &attr_b);
+	struct channel *tx_b = chan_create_tx(nh, &attr_b);
+	TEST_ASSERT_NOT_NULL(rx_a);
+	TEST_ASSERT_NOT_NULL(tx_a);
+	TEST_ASSERT_NOT_NULL(rx_b);
+	TEST_ASSERT_NOT_NULL(tx_b);
+
+	uint64_t data = 0xdeadbeef, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx_a, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx_a, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+	TEST_ASSERT(_rxw_frames(1) > 0);
+
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx_b, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx_b, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+	TEST_ASSERT(_rxw_frames(2) > 0);
+
+	/* No TAS streams, nothing for the TAS worker */
+	TEST_ASSERT(nh->rxw[0].frames == 0);
+
+	/* Back to a single Rx thread */
+	TEST_ASSERT(nh_set_rx_fanout(nh, false, NH_FANOUT_SID));
+	TEST_ASSERT(!nh->use_rx_fanout);
+	data = 0xfeedf00d;
+	TEST_ASSERT(chan_send_now(tx_a, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx_a, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+}
+
+static void test_chan_rx_fanout_classic_filter(void)
+{
+	/* Pretend the kernel refused the eBPF filter, each worker then
+	 * gets a classic filter with only the streams of its class.
+	 */
+	close(nh->rx_flt_prog);
+	close(nh->rx_flt_map);
+	nh->rx_flt_prog = -1;
+	nh->rx_flt_map = -1;
+	TEST_ASSERT(nh_set_rx_fanout(nh, true, NH_FANOUT_SID));
+
+	struct channel_attrs attr_b = chanattr;
+	attr_b.stream_id = 43;
+	attr_b.sc = SC_CLASS_B;
+	attr_b.interval_ns = INT_10HZ;
+	struct channel *rx_a = chan_create_rx(nh, &chanattr);
+	struct channel *tx_a = chan_create_tx(nh, &chanattr);
+	struct channel *rx_b = chan_create_rx(nh, &attr_b);
+	struct channel *tx_b = chan_create_tx(nh, &attr_b);
+	TEST_ASSERT_NOT_NULL(rx_a);
+	TEST_ASSERT_NOT_NULL(tx_a);
+	TEST_ASSERT_NOT_NULL(rx_b);
+	TEST_ASSERT_NOT_NULL(tx_b);
+
+	uint64_t data = 0xdeadbeef, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx_a, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx_a, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+	TEST_ASSERT(_rxw_frames(1) > 0);
+
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx_b, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx_b, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+	TEST_ASSERT(_rxw_frames(2) > 0);
+	TEST_ASSERT(nh->rxw[0].frames == 0);
+}
+
+static void test_chan_rx_busy_poll(void)
+{
+	TEST_ASSERT(!nh_set_rx_busy_poll(NULL, true, 0));
+	TEST_ASSERT(!nh_set_rx_busy_poll(nh, true, -2));
+	TEST_ASSERT(nh_get_rx_spin_stats(NULL, NULL, NULL) == -EINVAL);
+	TEST_ASSERT(nh_set_rx_busy_poll(nh, true, 0));
+	TEST_ASSERT(nh->rx_busy_poll);
+
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	uint64_t data = 0xdeadbeef, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+
+	/* Rx thread never sleeps, far more polls than 250ms timeouts */
+	uint64_t spins, idle;
+	usleep(10000);
+	TEST_ASSERT(nh_get_rx_spin_stats(nh, &spins, &idle) == 0);
+	TEST_ASSERT(spins > 100);
+	TEST_ASSERT(idle > 0);
+	TEST_ASSERT(idle < spins);
+
+	TEST_ASSERT(nh_set_rx_busy_poll(nh, false, -1));
+	TEST_ASSERT(!nh->rx_busy_poll);
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+
+	/* Busy-poll CPU does not replace the Rx affinity */
+	TEST_ASSERT(nh_set_rx_affinity(nh, 0));
+	TEST_ASSERT(nh_set_rx_busy_poll(nh, true, -1));
+	TEST_ASSERT(nh->rx_cpu == 0);
+	TEST_ASSERT(nh_set_rx_busy_poll(nh, false, -1));
+	TEST_ASSERT(nh->rx_cpu == 0);
+	TEST_ASSERT(nh->rx_busy_cpu == -1);
+}
+
+static bool fd_readable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN, };
+	return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+static void test_chan_poll_mode(void)
+{
+	TEST_ASSERT(nh_get_fd(NULL) == -EINVAL);
+	TEST_ASSERT(nh_poll(NULL, 0) == -EINVAL);
+	TEST_ASSERT(nh_get_fd(nh) == -EINVAL);
+	TEST_ASSERT(nh_poll(nh, 0) == -EINVAL);
+
+	struct nethandler *pnh = nh_create_init_poll("lo", 16, NULL);
+	TEST_ASSERT_NOT_NULL(pnh);
+	TEST_ASSERT(pnh->tid == 0);
+	TEST_ASSERT(!nh_set_rx_fanout(pnh, true, NH_FANOUT_SID));
+
+	int nfd = nh_get_fd(pnh);
+	TEST_ASSERT(nfd > 0);
+	int epfd = epoll_create1(0);
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = nfd, };
+	TEST_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, nfd, &ev) == 0);
+
+	struct channel *rx = chan_create_rx(pnh, &chanattr);
+	struct channel *tx = chan_create_tx(pnh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	uint64_t data = 0xdeadbeef, rx_data = 0;
+	TEST_ASSERT(chan_try_read(NULL, &rx_data) == -EINVAL);
+	TEST_ASSERT(chan_get_fd(NULL) == -EINVAL);
+	int cfd = chan_get_fd(rx);
+	TEST_ASSERT(cfd > 0);
+	TEST_ASSERT(chan_get_fd(rx) == cfd);
+
+	/* Starts out readable, first empty read arms it */
+	TEST_ASSERT(fd_readable(cfd));
+	TEST_ASSERT(chan_try_read(rx, &rx_data) == -EAGAIN);
+	TEST_ASSERT(!fd_readable(cfd));
+	TEST_ASSERT(nh_poll(pnh, 0) == 0);
+
+	/* Nobody reads the socket until we call nh_poll() */
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	TEST_ASSERT(epoll_wait(epfd, &ev, 1, 1000) == 1);
+	TEST_ASSERT(ev.data.fd == nfd);
+	TEST_ASSERT(!fd_readable(cfd));
+
+	TEST_ASSERT(nh_poll(pnh, 1000) > 0);
+	TEST_ASSERT(fd_readable(cfd));
+	TEST_ASSERT(chan_try_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == data);
+	while (chan_try_read(rx, &rx_data) > 0)
+		;
+	TEST_ASSERT(!fd_readable(cfd));
+
+	close(epfd);
+	nh_destroy(&pnh);
+}
+
+static void test_chan_io_uring(void)
+{
+	TEST_ASSERT(!nh_enable_io_uring(NULL, false));
+	TEST_ASSERT(nh_flush_tx(nh) == -EINVAL);
+
+	/* Created before io_uring, must be picked up */
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT(tx->uring_idx == -1);
+
+	if (!nh_enable_io_uring(nh, true))
+		TEST_IGNORE_MESSAGE("io_uring not available");
+	TEST_ASSERT_NOT_NULL(nh->uring);
+	TEST_ASSERT(tx->uring_idx >= 0);
+	TEST_ASSERT(!nh_set_rx_ring(nh, true));
+	TEST_ASSERT(!nh_set_rx_fanout(nh, true, NH_FANOUT_SID));
+
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+
+	/* Batched, nothing leaves until flushed */
+	uint64_t data = 0xdeadbeef, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	usleep(20000);
+	TEST_ASSERT(chan_try_read(rx, (void *)&rx_data) == -EAGAIN);
+
+	TEST_ASSERT(nh_flush_tx(nh) == 2);
+	TEST_ASSERT(nh_flush_tx(nh) == 0);
+	do {
+		TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	} while (rx_data != data);
+
+	/* Channel created after io_uring uses it directly */
+	struct channel *tx2 = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx2);
+	TEST_ASSERT(tx2->uring_idx >= 0);
+	TEST_ASSERT(tx2->uring_idx != tx->uring_idx);
+	chan_destroy(&tx2);
+}
+
+static void test_chan_group(void)
+{
+	struct channel_attrs attrs[3] = { chanattr, chanattr, chanattr };
+	attrs[1].stream_id = 43;
+	attrs[1].sc = SC_TAS;
+	attrs[2].stream_id = 44;
+	attrs[2].sc = SC_TAS;
+
+	struct channel *tx[3], *rx[3];
+	for (int i = 0; i < 3; i++) {
+		tx[i] = chan_create_tx(nh, &attrs[i]);
+		rx[i] = chan_create_rx(nh, &attrs[i]);
+		TEST_ASSERT_NOT_NULL(tx[i]);
+		TEST_ASSERT_NOT_NULL(rx[i]);
+	}
+
+	TEST_ASSERT_NULL(chan_group_create(NULL, tx, 3));
+	TEST_ASSERT_NULL(chan_group_create(nh, tx, 0));
+	TEST_ASSERT_NULL(chan_group_create(nh, rx, 3));
+
+	struct chan_group *grp = chan_group_create(nh, tx, 3);
+	TEST_ASSERT_NOT_NULL(grp);
+	TEST_ASSERT(grp->nr_tas == 2);
+	TEST_ASSERT(grp->tas_sock > 0);
+	TEST_ASSERT(grp->cbs_sock > 0);
+
+	uint64_t data[3] = { 0xa, 0xb, 0xc };
+	void *dp[3] = { &data[0], &data[1], &data[2] };
+	TEST_ASSERT(chan_group_update(NULL, 0, dp) == -EINVAL);
+	TEST_ASSERT(chan_group_update(grp, tai_get_ns(), dp) == 0);
+
+	uint64_t tx_ns = 0;
+	TEST_ASSERT(chan_group_send_at(NULL, NULL) == -EINVAL);
+	TEST_ASSERT(chan_group_send_at(grp, &tx_ns) == 3);
+	TEST_ASSERT(tx_ns > 0);
+
+	/* Each member arrives in its own channel */
+	for (int i = 0; i < 3; i++) {
+		uint64_t rx_data = 0;
+		TEST_ASSERT(chan_read(rx[i], (void *)&rx_data) > 0);
+		TEST_ASSERT(rx_data == data[i]);
+	}
+
+	/* CBS member (tx[0]) is held to its budget, but never blocks */
+	struct chan_tx_budget_stats st;
+	TEST_ASSERT(chan_group_update(grp, tai_get_ns(), dp) == 0);
+	TEST_ASSERT(chan_group_send_at(grp, NULL) == 3);
+	TEST_ASSERT(chan_get_tx_budget_stats(tx[0], &st) == 0);
+	TEST_ASSERT(st.over_budget == 1);
+
+	TEST_ASSERT(chan_set_tx_budget(tx[0], NC_BUDGET_BLOCK, 1) == 0);
+	uint8_t seqnr = tx[0]->pdu.seqnr;
+	TEST_ASSERT(chan_group_update(grp, tai_get_ns(), dp) == 0);
+	uint64_t start = tai_get_ns();
+	TEST_ASSERT(chan_group_send_at(grp, NULL) == 2);
+	TEST_ASSERT(tai_get_ns() - start < tx[0]->interval_ns / 2);
+	TEST_ASSERT(tx[0]->pdu.seqnr == seqnr);
+	TEST_ASSERT(chan_get_tx_budget_stats(tx[0], &st) == 0);
+	TEST_ASSERT(st.over_budget == 2);
+	TEST_ASSERT(st.blocked == 0);
+	TEST_ASSERT(st.dropped == 1);
+
+	chan_group_destroy(&grp);
+	TEST_ASSERT_NULL(grp);
+}
+
+static void test_chan_tx_ring(void)
+{
+	TEST_ASSERT(!nh_set_tx_ring(NULL, true, false));
+	TEST_ASSERT(nh_set_tx_ring(nh, true, false));
+
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx->tx_ring.map);
+	TEST_ASSERT(tx->tx_ring.frame_nr > 0);
+
+	/* Tx ring and io_uring are mutually exclusive */
+	TEST_ASSERT(!nh_enable_io_uring(nh, false));
+
+	uint64_t data = 0xdeadbeef;
+	TEST_ASSERT(chan_send_now(tx, &data) > 0);
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == data);
+
+	/* A failed kick hands the slot back */
+	int sock = tx->tx_sock;
+	unsigned int cur = tx->tx_ring.cur;
+	tx->tx_sock = eventfd(0, 0);
+	TEST_ASSERT(chan_send_now(tx, &data) < 0);
+	close(tx->tx_sock);
+	tx->tx_sock = sock;
+	TEST_ASSERT(tx->tx_ring.cur == cur);
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx, &data) > 0);
+	do {
+		TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	} while (rx_data != data);
+
+	/* Existing channels keep the ring */
+	TEST_ASSERT(nh_set_tx_ring(nh, false, false));
+	TEST_ASSERT_NOT_NULL(tx->tx_ring.map);
+}
+
+static void test_chan_tx_timestamps(void)
+{
+	TEST_ASSERT(!nh_enable_tx_timestamps(NULL));
+
+	/* Own nethandler, need a logger to see the timestamps */
+	unlink("/tmp/test_chan_txts.csv-0");
+	struct nethandler *lnh = nh_create_init("lo", 16, "/tmp/test_chan_txts.csv");
+	TEST_ASSERT_NOT_NULL(lnh);
+	struct channel *tx = chan_create_tx(lnh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	/* Existing channels are added as well */
+	TEST_ASSERT(nh_enable_tx_timestamps(lnh));
+	TEST_ASSERT_NOT_NULL(lnh->txts);
+	TEST_ASSERT(nh_enable_tx_timestamps(lnh));
+
+	uint64_t data = 0xdeadbeef;
+	TEST_ASSERT(chan_send_now(tx, &data) > 0);
+
+	/* Give collector time to drain the error queue */
+	usleep(300000);
+	nh_destroy(&lnh);
+
+	FILE *fp = fopen("/tmp/test_chan_txts.csv-0", "r");
+	TEST_ASSERT_NOT_NULL(fp);
+	char line[512];
+	TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+	TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+	fclose(fp);
+
+	uint64_t sid, avtp_ns, cap_ns, send_ns, tx_ns, rx_ns, recv_ns, sched_ns;
+	unsigned int sz, seqnr, rx_hw, tx_hw;
+	TEST_ASSERT_EQUAL(12, sscanf(line, "%lu,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%u,%lu,%u",
+					&sid, &sz, &seqnr, &avtp_ns, &cap_ns, &send_ns,
+					&tx_ns, &rx_ns, &recv_ns, &rx_hw, &sched_ns, &tx_hw));
+	TEST_ASSERT(sid == chanattr.stream_id);
+	TEST_ASSERT(sched_ns > 0);
+	TEST_ASSERT(tx_ns >= sched_ns);
+}
+
+static void test_nh_wait_until(void)
+{
+	TEST_ASSERT(nh_wait_until(NULL, 0) == 0);
+
+	/* Target passed, return immediately */
+	TEST_ASSERT(nh_wait_until(nh, tai_get_ns() - NS_IN_MS) < 0);
+
+	/* Never early, spin ends on target. Preemption may make single
+	 * waits late, but not all of them.
+	 */
+	int64_t best = INT64_MIN;
+	for (int i = 0; i < 10; i++) {
+		uint64_t target = tai_get_ns() + 2 * NS_IN_MS;
+		int64_t err = nh_wait_until(nh, target);
+		TEST_ASSERT(tai_get_ns() >= target);
+		TEST_ASSERT(err <= 0);
+		if (err > best)
+			best = err;
+	}
+	TEST_ASSERT_INT64_WITHIN(50 * NS_IN_US, 0, best);
+	TEST_ASSERT(nh->wait_margin_ns >= 5 * NS_IN_US);
+	TEST_ASSERT(nh->wait_margin_ns <= 500 * NS_IN_US);
+
+	/* *_wait() send paths, tx_ns is optional */
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	struct channel *tas = chan_create_tx(nh, &attrs);
+	struct channel *cbs = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tas);
+	TEST_ASSERT_NOT_NULL(cbs);
+	uint64_t data = 17;
+	uint64_t start = tai_get_ns();
+	TEST_ASSERT(chan_send_now_wait(tas, &data) > 0);
+	TEST_ASSERT(tai_get_ns() - start >= get_class_delay_bound_ns(tas));
+	TEST_ASSERT(chan_send_now_wait(cbs, &data) > 0);
+}
+
+static void test_nh_tx_guard(void)
+{
+	struct nh_tx_guard g;
+	TEST_ASSERT(nh_get_tx_guard(NULL, SC_TAS, &g) == -EINVAL);
+	TEST_ASSERT(nh_get_tx_guard(nh, SC_TAS, NULL) == -EINVAL);
+
+	/* Calibrated at create */
+	TEST_ASSERT(nh_get_tx_guard(nh, SC_TAS, &g) == 0);
+	TEST_ASSERT(g.launch_ns >= 10 * NS_IN_US && g.launch_ns <= NS_IN_MS);
+	TEST_ASSERT(g.wakeup_ns >= 5 * NS_IN_US && g.wakeup_ns <= 500 * NS_IN_US);
+	TEST_ASSERT(nh_get_tx_guard(nh, SC_CLASS_A, &g) == 0);
+	TEST_ASSERT(g.launch_ns == 0);
+
+	/* Missed deadline raises the launch guard */
+	nh_get_tx_guard(nh, SC_TAS, &g);
+	uint64_t launch = g.launch_ns;
+	nc_tx_guard_missed(nh, 0);
+	nh_get_tx_guard(nh, SC_TAS, &g);
+	TEST_ASSERT(g.launch_ns > launch || g.launch_ns == NS_IN_MS);
+
+	/* ... and quick sends let it decay */
+	launch = g.launch_ns;
+	for (int i = 0; i < 1000; i++)
+		nc_tx_guard_sent(nh, NS_IN_US);
+	nh_get_tx_guard(nh, SC_TAS, &g);
+	TEST_ASSERT(g.launch_ns < launch);
+
+	/* A slow send raises it right away */
+	nc_tx_guard_sent(nh, 400 * NS_IN_US);
+	nh_get_tx_guard(nh, SC_TAS, &g);
+	TEST_ASSERT(g.launch_ns >= 400 * NS_IN_US);
+
+	/* Fixed margins are left alone */
+	struct nh_tx_guard fixed = { .launch_ns = 20 * NS_IN_US, .wakeup_ns = 30 * NS_IN_US };
+	TEST_ASSERT(!nh_set_tx_guard(NULL, &fixed));
+	TEST_ASSERT(nh_set_tx_guard(nh, &fixed));
+	nc_tx_guard_missed(nh, NS_IN_MS);
+	nh_wait_until(nh, tai_get_ns() + NS_IN_MS);
+	nh_get_tx_guard(nh, SC_TAS, &g);
+	TEST_ASSERT(g.launch_ns == fixed.launch_ns);
+	TEST_ASSERT(g.wakeup_ns == fixed.wakeup_ns);
+
+	/* TAS frames launch at least launch_ns after sendmsg() */
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	struct channel *tas = chan_create_tx(nh, &attrs);
+	TEST_ASSERT_NOT_NULL(tas);
+	uint64_t data = 1, tx_ns = 0;
+	TEST_ASSERT(chan_update(tas, tai_get_ns(), &data) == 0);
+	uint64_t before = tai_get_ns();
+	TEST_ASSERT(chan_send(tas, &tx_ns) > 0);
+	TEST_ASSERT(tx_ns >= before + fixed.launch_ns);
+
+	/* Woken up launch_ns before the next slot */
+	TEST_ASSERT(wait_for_tx_slot(tas) == 0);
+	TEST_ASSERT(tai_get_ns() + fixed.launch_ns >= tas->next_tx_ns);
+
+	TEST_ASSERT(nh_set_tx_guard(nh, NULL));
+	TEST_ASSERT(!nh->tx_guard_fixed);
+}
+
+static void test_chan_send_schedule(void)
+{
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	struct channel *tas = chan_create_tx(nh, &attrs);
+	struct channel *cbs = chan_create_tx(nh, &chanattr);
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tas);
+	TEST_ASSERT_NOT_NULL(cbs);
+	TEST_ASSERT_NOT_NULL(rx);
+
+	uint64_t data[4] = { 1, 2, 3, 4 };
+	struct chan_sample s[4];
+	for (int i = 0; i < 4; i++) {
+		s[i].tx_ns = 0;
+		s[i].ts = tai_get_ns();
+		s[i].data = &data[i];
+	}
+	TEST_ASSERT(chan_send_schedule(NULL, s, 4) == -EINVAL);
+	TEST_ASSERT(chan_send_schedule(tas, NULL, 4) == -EINVAL);
+	TEST_ASSERT(chan_send_schedule(tas, s, 0) == -EINVAL);
+	TEST_ASSERT(chan_send_schedule(cbs, s, 4) == -EOPNOTSUPP);
+
+	/* Next free slots, one interval apart */
+	uint64_t before = tai_get_ns();
+	TEST_ASSERT(chan_send_schedule(tas, s, 4) == 4);
+	TEST_ASSERT(tas->next_tx_ns >= before + 4 * tas->interval_ns);
+
+	/* Explicit launch time inside reserved interval is refused, the
+	 * samples before it are queued
+	 */
+	uint64_t next = tas->next_tx_ns;
+	s[0].tx_ns = next + tas->interval_ns;
+	s[1].tx_ns = s[0].tx_ns + tas->interval_ns / 2;
+	TEST_ASSERT(chan_send_schedule(tas, s, 2) == 1);
+	TEST_ASSERT(tas->next_tx_ns == s[0].tx_ns + tas->interval_ns);
+	TEST_ASSERT(chan_send_schedule(tas, &s[1], 1) == -EINVAL);
+
+	/* No ETF on lo, all 5 frames arrive right away and in order (lo
+	 * delivers each frame twice)
+	 */
+	uint64_t expected[5] = { 1, 2, 3, 4, 1 };
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == expected[0]);
+	int seen = 1;
+	while (chan_try_read(rx, &rx_data) > 0) {
+		if (rx_data != expected[seen - 1]) {
+			TEST_ASSERT(seen < 5);
+			TEST_ASSERT(rx_data == expected[seen]);
+			seen++;
+		}
+	}
+	TEST_ASSERT(seen == 5);
+}
+
+static void test_chan_pace(void)
+{
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	attrs.interval_ns = 2 * NS_IN_MS;
+	struct channel *tas = chan_create_tx(nh, &attrs);
+	attrs.sc = SC_CLASS_A;
+	attrs.stream_id = 43;
+	struct channel *cbs = chan_create_tx(nh, &attrs);
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tas);
+	TEST_ASSERT_NOT_NULL(cbs);
+	TEST_ASSERT_NOT_NULL(rx);
+
+	uint64_t data = 1;
+	struct chan_pace_stats st;
+	TEST_ASSERT(chan_pace(tas) == -EINVAL);
+	TEST_ASSERT(chan_post(tas, tai_get_ns(), &data) == -EINVAL);
+	TEST_ASSERT(chan_get_pace_stats(tas, &st) == -EINVAL);
+
+	TEST_ASSERT(nh_enable_pacer(nh, 0, -1));
+	TEST_ASSERT(chan_pace(tas) == 0);
+	TEST_ASSERT(chan_pace(tas) == -EEXIST);
+	TEST_ASSERT(chan_pace(rx) == -EINVAL);
+	TEST_ASSERT(chan_pace(cbs) == 0);
+
+	/* Nothing is sent before the first post */
+	usleep(10000);
+	TEST_ASSERT(chan_get_pace_stats(tas, &st) == 0);
+	TEST_ASSERT(st.sent == 0);
+	TEST_ASSERT(st.duplicates == 0);
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_try_read(rx, &rx_data) <= 0);
+
+	/* Newest value wins, the first is coalesced */
+	TEST_ASSERT(chan_post(tas, tai_get_ns(), &data) == 0);
+	data = 2;
+	TEST_ASSERT(chan_post(tas, tai_get_ns(), &data) == 0);
+	TEST_ASSERT(chan_post(cbs, tai_get_ns(), &data) == 0);
+	TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == 2);
+
+	/* Without new samples, slots resend the last one */
+	usleep(20000);
+	TEST_ASSERT(chan_get_pace_stats(tas, &st) == 0);
+	TEST_ASSERT(st.coalesced == 1);
+	TEST_ASSERT(st.sent > 1);
+	TEST_ASSERT(st.duplicates > 0);
+	TEST_ASSERT(st.sent == st.duplicates + 1);
+	TEST_ASSERT(chan_get_pace_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.coalesced == 0);
+	TEST_ASSERT(st.sent > 1);
+
+	/* Channel leaves the pacer when destroyed */
+	chan_destroy(&tas);
+	TEST_ASSERT_NULL(tas);
+	usleep(5000);
+	TEST_ASSERT(chan_get_pace_stats(cbs, &st) == 0);
+}
+
+static void test_chan_tx_budget(void)
+{
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	struct channel *tas = chan_create_tx(nh, &attrs);
+	struct channel *cbs = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tas);
+	TEST_ASSERT_NOT_NULL(cbs);
+
+	struct chan_tx_budget_stats st;
+	TEST_ASSERT(chan_set_tx_budget(tas, NC_BUDGET_DROP, 1) == -EINVAL);
+	TEST_ASSERT(chan_get_tx_budget_stats(tas, &st) == -EINVAL);
+	TEST_ASSERT(chan_set_tx_budget(cbs, 42, 1) == -EINVAL);
+
+	/* Default only counts, sending back to back does not wait */
+	uint64_t data = 1;
+	TEST_ASSERT(chan_send_now(cbs, &data) > 0);
+	uint64_t start = tai_get_ns();
+	TEST_ASSERT(chan_send_now(cbs, &data) > 0);
+	TEST_ASSERT(tai_get_ns() - start < cbs->interval_ns / 2);
+	TEST_ASSERT(chan_get_tx_budget_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.over_budget == 1);
+	TEST_ASSERT(st.blocked == 0);
+
+	/* Blocks until the interval (less slack) has passed */
+	TEST_ASSERT(chan_set_tx_budget(cbs, NC_BUDGET_BLOCK, 1) == 0);
+	start = tai_get_ns();
+	TEST_ASSERT(chan_send_now(cbs, &data) > 0);
+	TEST_ASSERT(tai_get_ns() - start >= cbs->interval_ns - cbs->interval_ns / 8 - NS_IN_MS);
+	TEST_ASSERT(chan_get_tx_budget_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.over_budget == 2);
+	TEST_ASSERT(st.blocked == 1);
+	TEST_ASSERT(st.blocked_ns > 0);
+
+	/* Dropped frames do not use up a seqnr */
+	TEST_ASSERT(chan_set_tx_budget(cbs, NC_BUDGET_DROP, 1) == 0);
+	uint8_t seqnr = cbs->pdu.seqnr;
+	TEST_ASSERT(chan_send_now(cbs, &data) == -EAGAIN);
+	TEST_ASSERT(chan_send_now(cbs, &data) == -EAGAIN);
+	TEST_ASSERT(cbs->pdu.seqnr == seqnr);
+	TEST_ASSERT(chan_get_tx_budget_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.over_budget == 4);
+	TEST_ASSERT(st.dropped == 2);
+	usleep(2 * cbs->interval_ns / 1000);
+	TEST_ASSERT(chan_send_now(cbs, &data) > 0);
+	TEST_ASSERT(cbs->pdu.seqnr == (uint8_t)(seqnr + 1));
+
+	/* After a quiet period, burst frames go back to back */
+	TEST_ASSERT(chan_set_tx_budget(cbs, NC_BUDGET_DROP, 3) == 0);
+	usleep(3 * cbs->interval_ns / 1000 + 5000);
+	for (int i = 0; i < 3; i++)
+		TEST_ASSERT(chan_send_now(cbs, &data) > 0);
+	TEST_ASSERT(chan_send_now(cbs, &data) == -EAGAIN);
+	TEST_ASSERT(chan_get_tx_budget_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.over_budget == 5);
+	TEST_ASSERT(st.dropped == 3);
+
+	/* Paced channels drop rather than block */
+	TEST_ASSERT(chan_set_tx_budget(cbs, NC_BUDGET_BLOCK, 1) == 0);
+	TEST_ASSERT(nh_enable_pacer(nh, 0, -1));
+	TEST_ASSERT(chan_pace(cbs) == 0);
+	start = tai_get_ns();
+	TEST_ASSERT(chan_send_now(cbs, &data) == -EAGAIN);
+	TEST_ASSERT(tai_get_ns() - start < cbs->interval_ns / 2);
+	TEST_ASSERT(chan_get_tx_budget_stats(cbs, &st) == 0);
+	TEST_ASSERT(st.blocked == 1);
+	TEST_ASSERT(st.dropped == 4);
+}
+
+static void test_chan_send_iov(void)
+{
+	struct channel_attrs attrs = chanattr;
+	attrs.sc = SC_TAS;
+	struct channel *tx = chan_create_tx(nh, &attrs);
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT_NOT_NULL(rx);
+
+	uint32_t lo = 0xcafebabe, hi = 0xdeadbeef;
+	struct iovec iov[CHAN_IOV_MAX + 1] = {
+		{ .iov_base = &lo, .iov_len = sizeof(lo) },
+		{ .iov_base = &hi, .iov_len = sizeof(hi) },
+	};
+	TEST_ASSERT(chan_update_iov(rx, tai_get_ns(), iov, 2) == -EINVAL);
+	TEST_ASSERT(chan_update_iov(tx, tai_get_ns(), iov, 1) == -EINVAL);
+	TEST_ASSERT(chan_update_iov(tx, tai_get_ns(), iov, CHAN_IOV_MAX + 1) == -EINVAL);
+	TEST_ASSERT(chan_send_iov(tx, tai_get_ns(), NULL, 2, NULL) == -EINVAL);
+
+	/* Header from channel, payload gathered from both buffers */
+	uint8_t seqnr = tx->pdu.seqnr;
+	TEST_ASSERT(chan_send_iov(tx, tai_get_ns(), iov, 2, NULL) == 8);
+	TEST_ASSERT(tx->pdu.seqnr == (uint8_t)(seqnr + 1));
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == ((uint64_t)hi << 32 | lo));
+	while (chan_try_read(rx, &rx_data) > 0)
+		;
+
+	/* Buffers are referenced until next update */
+	TEST_ASSERT(tx->tx_iovcnt == 2);
+	uint64_t data = 42;
+	TEST_ASSERT(chan_update(tx, tai_get_ns(), &data) == 0);
+	TEST_ASSERT(tx->tx_iovcnt == 0);
+
+	/* In place, no copy */
+	uint64_t *payload = chan_get_payload(tx);
+	*payload = 0x1122334455667788;
+	TEST_ASSERT(chan_send_now(tx, payload) > 0);
+	TEST_ASSERT(chan_read(rx, &rx_data) > 0);
+	TEST_ASSERT(rx_data == 0x1122334455667788);
+}
+
+static void test_chan_rx_many_streams(void)
+{
+	/* A classic per-stream Rx filter would outgrow socket option
+	 * memory (optmem_max) well before this, frames for the last
+	 * stream must still arrive.
+	 */
+	const int nr = 420;
+	struct nethandler *nh_many = nh_create_init("lo", nr + 1, NULL);
+	TEST_ASSERT_NOT_NULL(nh_many);
+
+	struct channel_attrs attrs = chanattr;
+	struct channel *rx = NULL;
+	for (int i = 0; i < nr; i++) {
+		attrs.stream_id = 1000 + i;
+		rx = chan_create_rx(nh_many, &attrs);
+		TEST_ASSERT_NOT_NULL(rx);
+	}
+	struct channel *tx = chan_create_tx(nh_many, &attrs);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	uint64_t data = 0xfeedf00d, rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, &data) > 0);
+	int res = 0;
+	for (int i = 0; i < 100 && (res = chan_try_read(rx, &rx_data)) <= 0; i++)
+		usleep(1000);
+	TEST_ASSERT(res > 0);
+	TEST_ASSERT(rx_data == data);
+
+	nh_destroy(&nh_many);
+}
+
+static void test_chan_xdp(void)
+{
+	TEST_ASSERT(!nh_enable_xdp(NULL, 0));
+	if (!nh_enable_xdp(nh, 0))
+		TEST_IGNORE_MESSAGE("AF_XDP not available (requires CAP_BPF and CAP_NET_ADMIN)");
+	TEST_ASSERT_NOT_NULL(nh->xdp);
+
+	/* Streams registered after XDP is enabled */
+	struct channel *rx = chan_create_rx(nh, &chanattr);
+	struct channel *tx = chan_create_tx(nh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT(chan_valid(tx));
+
+	uint64_t data = 0xdeadbeef;
+	uint64_t rx_data = 0;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	TEST_ASSERT_EQUAL_UINT64_MESSAGE(data, rx_data, "Rx'd data from XSK should match Tx'd");
+
+	/* Interval is enforced in userspace */
+	uint64_t ts_start = tai_get_ns();
+	data = 0xcafebabe;
+	TEST_ASSERT(chan_send_now(tx, (void *)&data) > 0);
+	TEST_ASSERT(tai_get_ns() - ts_start >= chanattr.interval_ns / 2);
+	TEST_ASSERT(chan_read(rx, (void *)&rx_data) > 0);
+	TEST_ASSERT_EQUAL_UINT64(data, rx_data);
+}
+
+static void test_chan_xdp_veth(void)
+{
+	/* Talker in its own namespace on one end of a veth pair, the
+	 * listener receives on the other end through the XDP program.
+	 * veth has no PHC, so both ends are created with
+	 * nh_create_init_nophc().
+	 */
+	if (geteuid() != 0)
+		TEST_IGNORE_MESSAGE("veth/netns test requires root");
+	if (access("/var/run/netns/" XDP_NETNS, F_OK) == 0)
+		TEST_ASSERT_EQUAL_INT_MESSAGE(0, system("ip netns del " XDP_NETNS),
+					"failed removing stale netns " XDP_NETNS);
+	if (system("ip netns add " XDP_NETNS) != 0)
+		TEST_IGNORE_MESSAGE("failed creating netns " XDP_NETNS);
+	xdp_veth_up = true;
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0,
+		system("ip link add " XDP_VETH_RX " type veth peer name " XDP_VETH_TX " netns " XDP_NETNS " && "
+			"ip link set " XDP_VETH_RX " up && ip -n " XDP_NETNS " link set " XDP_VETH_TX " up"),
+		"failed creating veth pair");
+
+	xdp_rnh = nh_create_init_nophc(XDP_VETH_RX, 16, NULL);
+	TEST_ASSERT_NOT_NULL(xdp_rnh);
+	if (!nh_enable_xdp(xdp_rnh, 0))
+		TEST_IGNORE_MESSAGE("AF_XDP not available on veth");
+	struct channel *rx = chan_create_rx(xdp_rnh, &chanattr);
+	TEST_ASSERT_NOT_NULL(rx);
+
+	/* Only the XDP program may deliver, block the Rx socket */
+	TEST_ASSERT(nc_set_rx_filter(xdp_rnh->rx_sock, NULL, 0) == 0);
+
+	/* Sockets and threads keep the namespace they were created in */
+	int self_ns = open("/proc/self/ns/net", O_RDONLY);
+	int test_ns = open("/var/run/netns/" XDP_NETNS, O_RDONLY);
+	TEST_ASSERT(self_ns >= 0 && test_ns >= 0);
+	TEST_ASSERT(setns(test_ns, CLONE_NEWNET) == 0);
+	xdp_tnh = nh_create_init_nophc(XDP_VETH_TX, 16, NULL);
+	struct channel *tx = xdp_tnh ? chan_create_tx(xdp_tnh, &chanattr) : NULL;
+	TEST_ASSERT(setns(self_ns, CLONE_NEWNET) == 0);
+	close(test_ns);
+	close(self_ns);
+	TEST_ASSERT_NOT_NULL(xdp_tnh);
+	TEST_ASSERT_NOT_NULL(tx);
+
+	/* veth may need a moment after link up, keep sending */
+	uint64_t data = 0xfeedf00d, rx_data = 0;
+	int res = 0;
+	for (int i = 0; i < 50 && res <= 0; i++) {
+		TEST_ASSERT(chan_send_now(tx, &data) > 0);
+		usleep(10000);
+		res = chan_try_read(rx, &rx_data);
+	}
+	TEST_ASSERT(res > 0);
+	TEST_ASSERT_EQUAL_UINT64(data, rx_data);
+}
+
 int main(int argc, char *argv[])
 {
 	UNITY_BEGIN();
@@ -204,5 +1189,25 @@ int main(int argc, char *argv[])
 	RUN_TEST(test_chan_create_rx_async);
 	RUN_TEST(test_chan_timedwait);
 	RUN_TEST(test_chan_stop);
+	RUN_TEST(test_chan_rx_ring);
+	RUN_TEST(test_chan_read_borrow);
+	RUN_TEST(test_chan_mcast_no_promisc);
+	RUN_TEST(test_chan_rx_fanout);
+	RUN_TEST(test_chan_rx_fanout_classic_filter);
+	RUN_TEST(test_chan_rx_busy_poll);
+	RUN_TEST(test_chan_poll_mode);
+	RUN_TEST(test_chan_io_uring);
+	RUN_TEST(test_chan_group);
+	RUN_TEST(test_chan_tx_ring);
+	RUN_TEST(test_chan_tx_timestamps);
+	RUN_TEST(test_nh_wait_until);
+	RUN_TEST(test_nh_tx_guard);
+	RUN_TEST(test_chan_send_schedule);
+	RUN_TEST(test_chan_pace);
+	RUN_TEST(test_chan_tx_budget);
+	RUN_TEST(test_chan_send_iov);
+	RUN_TEST(test_chan_rx_many_streams);
+	RUN_TEST(test_chan_xdp);
+	RUN_TEST(test_chan_xdp_veth);
 	return UNITY_END();
 }
@@ -59,6 +59,65 @@ static void test_log_destroy(void)
 	log_destroy(logger);
 }
 
+static void test_log_tx_ts(void)
+{
+	struct logc *logc = log_create("/tmp/testlogger_txts.csv");
+	TEST_ASSERT_NOT_NULL(logc);
+
+	struct avtpdu_cshdr du = {
+		.seqnr = 7,
+		.stream_id = htobe64(42),
+	};
+	log_tx(logc, &du, 100, 200, 0);
+	log_rx(logc, &du, 300, 400, false);
+	TEST_ASSERT_EQUAL(2, logc->lb->idx);
+
+	/* Unknown stream or seqnr is ignored */
+	log_tx_ts(logc, 43, 7, 250, 260, false);
+	log_tx_ts(logc, 42, 8, 250, 260, false);
+	TEST_ASSERT(logc->lb->tx_ns[0] == 0);
+	TEST_ASSERT(logc->lb->sched_ns[0] == 0);
+
+	/* Tx entry is updated, not the later Rx entry */
+	log_tx_ts(logc, 42, 7, 250, 0, false);
+	log_tx_ts(logc, 42, 7, 0, 260, false);
+	TEST_ASSERT(logc->lb->sched_ns[0] == 250);
+	TEST_ASSERT(logc->lb->tx_ns[0] == 260);
+	TEST_ASSERT(logc->lb->tx_hw[0] == 0);
+	TEST_ASSERT(logc->lb->sched_ns[1] == 0);
+	TEST_ASSERT(logc->lb->tx_ns[1] == 0);
+
+	/* Hardware replaces software, but not the other way around */
+	log_tx_ts(logc, 42, 7, 0, 270, true);
+	log_tx_ts(logc, 42, 7, 0, 280, false);
+	TEST_ASSERT(logc->lb->tx_ns[0] == 270);
+	TEST_ASSERT(logc->lb->tx_hw[0] == 1);
+
+	log_tx_ts(NULL, 42, 7, 0, 280, false);
+	log_destroy(logc);
+}
+
+static void test_log_txtime_err(void)
+{
+	struct logc *logc = log_create("/tmp/testlogger_txerr.csv");
+	TEST_ASSERT_NOT_NULL(logc);
+	TEST_ASSERT_NOT_NULL(logc->teb);
+
+	log_txtime_err(logc, 42, 3, 1000, 20, 2);
+	TEST_ASSERT_EQUAL(1, logc->teb->idx);
+	TEST_ASSERT(logc->teb->sid[0] == 42);
+	TEST_ASSERT(logc->teb->late_ns[0] == 20);
+	TEST_ASSERT(logc->teb->code[0] == 2);
+
+	/* Tx/Rx log is not touched */
+	TEST_ASSERT_EQUAL(0, logc->lb->idx);
+
+	log_reset(logc);
+	TEST_ASSERT_EQUAL(0, logc->teb->idx);
+	log_txtime_err(NULL, 42, 3, 1000, 20, 2);
+	log_destroy(logc);
+}
+
 int main(int argc, char *argv[])
 {
 	UNITY_BEGIN();
@@ -66,5 +125,7 @@ int main(int argc, char *argv[])
 	RUN_TEST(test_create_wb);
 	RUN_TEST(test_create_ts);
 	RUN_TEST(test_log_destroy);
+	RUN_TEST(test_log_tx_ts);
+	RUN_TEST(test_log_txtime_err);
 	return UNITY_END();
 }
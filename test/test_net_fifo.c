@@ -10,6 +10,12 @@
 #include "../src/netchan.c"
 #include "../src/netchan_standalone.c"
 #include "../src/netchan_socket.c"
+#include "../src/netchan_xdp.c"
+#include "../src/netchan_uring.c"
+#include "../src/netchan_txts.c"
+#include "../src/netchan_pacer.c"
+#include "../src/netchan_ring.c"
+#include "../src/netchan_lv.c"
 
 void tearDown(void)
 {
@@ -69,37 +75,44 @@ struct tg_container {
 	char buffer[2048];
 };
 
-static void test_create_netfifo_rx_pipe_ok(void)
+static void test_create_netfifo_rx_ring_ok(void)
 {
 	/* NETCHAN_RX() tested in test_pdu */
 	int r = nc_rx_create("missing", nc_channels, nfc_sz);
 	TEST_ASSERT(r==-1);
 	r = nc_rx_create("test1", nc_channels, nfc_sz);
-	TEST_ASSERT(r>=0);
+	TEST_ASSERT(r==0);
+
+	struct nc_ring *ring = _nh->du_rx_tail->ring;
+	TEST_ASSERT_NOT_NULL(ring);
+	TEST_ASSERT(nc_ring_capacity(ring) >= 8);
 
 	uint64_t data = 0xdeadbeef;
-	write(_nh->du_rx_tail->fd_w, &data, 8);
+	struct ring_meta *wm = nc_ring_reserve(ring);
+	TEST_ASSERT_NOT_NULL(wm);
+	memcpy(wm->payload, &data, 8);
+	nc_ring_commit(ring);
 
-	uint64_t res = 0;
-	read(_nh->du_rx_tail->fd_r, &res, 8);
-	TEST_ASSERT(data == res);
+	struct ring_meta *rm = nc_ring_acquire(ring);
+	TEST_ASSERT(rm == wm);
+	TEST_ASSERT(*(uint64_t *)rm->payload == data);
+	nc_ring_release(ring);
+	TEST_ASSERT_NULL(nc_ring_acquire(ring));
 }
 
 static void test_create_netfifo_rx_send_ok(void)
 {
-	/* Create listening socket and pipe-pair */
+	/* Create listening socket and ring */
 	int r = nc_rx_create("test1", nc_channels, nfc_sz);
-	TEST_ASSERT(r > 0);
+	TEST_ASSERT(r == 0);
 
 	uint64_t data = 0xdeadbeef;
 	int txsz = helper_send_8byte(0, data);
 	TEST_ASSERT(txsz == 8);
 
-	struct pipe_meta *pm = malloc(sizeof(struct pipe_meta) + sizeof(uint64_t));
-	read(r, pm, sizeof(*pm) + sizeof(uint64_t));
-	uint64_t *received = (uint64_t *)&pm->payload[0];
-	TEST_ASSERT(*received == data);
-	free(pm);
+	uint64_t received = 0;
+	chan_read(_nh->du_rx_tail, &received);
+	TEST_ASSERT(received == data);
 }
 
 static void test_create_netfifo_rx_recv(void)
@@ -111,14 +124,278 @@ static void test_create_netfifo_rx_recv(void)
 	int txsz = helper_send_8byte(1, data);
 	TEST_ASSERT(txsz == 8);
 
+	uint64_t r = 0;
+	int rsz = chan_read(_nh->du_rx_tail, &r);
+	TEST_ASSERT(rsz == (sizeof(struct ring_meta) + sizeof(uint64_t)));
+	TEST_ASSERT(r == data);
+}
+
+static void test_netfifo_ring_full(void)
+{
+	int r = nc_rx_create("test1", nc_channels, nfc_sz);
+	TEST_ASSERT(r == 0);
+	struct channel *ch = _nh->du_rx_tail;
+
+	/* Rx thread must never block, once full, newest is dropped */
+	for (uint32_t i = 0; i < nc_ring_capacity(ch->ring); i++) {
+		uint64_t val = i;
+		TEST_ASSERT(chan_update(ch, 0, &val) == 0);
+		TEST_ASSERT(nh_feed_pdu(_nh, &ch->pdu) == 0);
+	}
+	TEST_ASSERT(nh_feed_pdu(_nh, &ch->pdu) == -ENOSPC);
+	TEST_ASSERT(chan_get_dropped(ch) == 1);
+
+	uint64_t val = 0;
+	TEST_ASSERT(chan_read(ch, &val) > 0);
+	TEST_ASSERT(val == 0);
+	TEST_ASSERT(nh_feed_pdu(_nh, &ch->pdu) == 0);
+}
+
+static void test_netfifo_drop_oldest(void)
+{
+	struct channel_attrs attrs = nc_channels[0];
+	attrs.overflow = NC_DROP_OLDEST;
+	struct channel *ch = chan_create_rx(nh_create_init("lo", 16, NULL), &attrs);
+	TEST_ASSERT_NOT_NULL(ch);
+	uint32_t cap = nc_ring_capacity(ch->ring);
+
+	/* Overfill by 3, the 3 oldest should be gone */
+	for (uint64_t i = 0; i < cap + 3; i++) {
+		TEST_ASSERT(chan_update(ch, 0, &i) == 0);
+		TEST_ASSERT(nh_feed_pdu(ch->nh, &ch->pdu) == 0);
+	}
+	TEST_ASSERT(chan_get_dropped(ch) == 3);
+
+	uint64_t val = 0;
+	TEST_ASSERT(chan_read(ch, &val) > 0);
+	TEST_ASSERT(val == 3);
+
+	/* Borrowed slot must survive a full lap of the ring */
+	const uint64_t *borrowed = chan_read_borrow(ch, NULL);
+	TEST_ASSERT_NOT_NULL(borrowed);
+	TEST_ASSERT(*borrowed == 4);
+	for (uint64_t i = 0; i < 2 * cap; i++) {
+		uint64_t v = 1000 + i;
+		TEST_ASSERT(chan_update(ch, 0, &v) == 0);
+		nh_feed_pdu(ch->nh, &ch->pdu);
+	}
+	TEST_ASSERT(*borrowed == 4);
+	TEST_ASSERT(chan_read_release(ch) == 0);
+
+	struct nethandler *nh = ch->nh;
+	nh_destroy(&nh);
+}
+
+static void test_netfifo_overwrite(void)
+{
+	int r = nc_rx_create("test1", nc_channels, nfc_sz);
+	TEST_ASSERT(r == 0);
+	struct channel *ch = _nh->du_rx_tail;
+	TEST_ASSERT(chan_set_overflow_policy(ch, NC_OVERWRITE) == 0);
+	TEST_ASSERT(chan_set_overflow_policy(ch, 42) == -EINVAL);
+	TEST_ASSERT(chan_set_overflow_policy(NULL, NC_OVERWRITE) == -EINVAL);
+
+	for (uint64_t i = 0; i < 5; i++) {
+		TEST_ASSERT(chan_update(ch, 0, &i) == 0);
+		TEST_ASSERT(nh_feed_pdu(_nh, &ch->pdu) == 0);
+	}
+	TEST_ASSERT(chan_get_dropped(ch) == 4);
+
+	uint64_t val = 0;
+	TEST_ASSERT(chan_read(ch, &val) > 0);
+	TEST_ASSERT(val == 4);
+	TEST_ASSERT_NULL(nc_ring_acquire(ch->ring));
+	nc_ring_release(ch->ring);
+}
+
+static void test_netfifo_lvchan(void)
+{
+	struct channel_attrs attrs = nc_channels[0];
+	attrs.last_value = true;
+	struct channel *ch = chan_create_rx(nh_create_init("lo", 16, NULL), &attrs);
+	TEST_ASSERT_NOT_NULL(ch);
+	TEST_ASSERT_NULL(ch->ring);
+	TEST_ASSERT_NOT_NULL(ch->lv);
+
+	uint64_t val = 0;
+	struct ring_meta meta;
+	TEST_ASSERT(chan_read_latest(ch, &val, &meta) == -EAGAIN);
+
+	for (uint64_t i = 1; i <= 3; i++) {
+		TEST_ASSERT(chan_update(ch, 0, &i) == 0);
+		TEST_ASSERT(nh_feed_pdu(ch->nh, &ch->pdu) == 0);
+	}
+	TEST_ASSERT(chan_read_latest(ch, &val, &meta) == 1);
+	TEST_ASSERT(val == 3);
+	TEST_ASSERT(meta.avtp_timestamp == ntohl(ch->pdu.avtp_timestamp));
+
+	/* No new sample, same value again */
+	val = 0;
+	TEST_ASSERT(chan_read_latest(ch, &val, NULL) == 0);
+	TEST_ASSERT(val == 3);
+
+	uint64_t next = 4;
+	TEST_ASSERT(chan_update(ch, 0, &next) == 0);
+	TEST_ASSERT(nh_feed_pdu(ch->nh, &ch->pdu) == 0);
+	TEST_ASSERT(chan_read_latest(ch, &val, NULL) == 1);
+	TEST_ASSERT(val == 4);
+
+	/* lvchan has no queue */
+	TEST_ASSERT(chan_read(ch, &val) == -EINVAL);
+
+	struct nethandler *nh = ch->nh;
+	nh_destroy(&nh);
+}
+
+static int _recv_sids(int sock, uint64_t *sids, int max)
+{
+	unsigned char buf[1514];
+	int n = 0;
+
+	/* Rx socket has a 250ms timeout, read until nothing more arrives */
+	while (n < max) {
+		int sz = recv(sock, buf, sizeof(buf), 0);
+		if (sz < (int)(ETH_HLEN + sizeof(struct avtpdu_cshdr)))
+			break;
+		struct avtpdu_cshdr *du = (struct avtpdu_cshdr *)(buf + ETH_HLEN);
+		sids[n++] = be64toh(du->stream_id);
+	}
+	return n;
+}
+
+static void test_netfifo_rx_filter(void)
+{
+	int sock = nc_create_rx_sock("lo");
+	TEST_ASSERT(sock >= 0);
+	uint64_t sids[16];
+
+	/* Nothing registered, nothing passes */
+	TEST_ASSERT(helper_send_8byte(0, 1) == 8);
+	TEST_ASSERT(_recv_sids(sock, sids, 16) == 0);
+
+	uint64_t reg = nc_channels[0].stream_id;
+	TEST_ASSERT(nc_set_rx_filter(sock, &reg, 1) == 0);
+	TEST_ASSERT(helper_send_8byte(1, 2) == 8);
+	TEST_ASSERT(helper_send_8byte(0, 3) == 8);
+	int n = _recv_sids(sock, sids, 16);
+	TEST_ASSERT(n > 0);
+	for (int i = 0; i < n; i++)
+		TEST_ASSERT(sids[i] == reg);
+
+	/* Too many streams for the filter, accept all AVTP */
+	uint64_t many[1024];
+	for (int i = 0; i < 1024; i++)
+		many[i] = 1000 + i;
+	TEST_ASSERT(nc_set_rx_filter(sock, many, 1024) == 0);
+	TEST_ASSERT(helper_send_8byte(1, 4) == 8);
+	n = _recv_sids(sock, sids, 16);
+	TEST_ASSERT(n > 0);
+	TEST_ASSERT(sids[0] == nc_channels[1].stream_id);
+
+	TEST_ASSERT(nc_set_rx_filter(sock, NULL, 1) == -EINVAL);
+	close(sock);
+}
+
+static void test_netfifo_rx_filter_ebpf(void)
+{
+	int sock = nc_create_rx_sock("lo");
+	TEST_ASSERT(sock >= 0);
+	uint64_t sids[16];
+
+	int map = -1;
+	int prog = nc_rx_filter_create(1024, &map);
+	TEST_ASSERT(prog >= 0);
+	TEST_ASSERT(map >= 0);
+	TEST_ASSERT(nc_rx_filter_attach(sock, prog) == 0);
+
+	/* Empty map, nothing passes */
+	TEST_ASSERT(helper_send_8byte(0, 1) == 8);
+	TEST_ASSERT(_recv_sids(sock, sids, 16) == 0);
+
+	/* More streams than the classic filter can hold, still only
+	 * the registered ones pass */
+	for (int i = 0; i < 1024; i++)
+		TEST_ASSERT(nc_rx_filter_add(map, 1000 + i) == 0);
+	uint64_t reg = nc_channels[0].stream_id;
+	TEST_ASSERT(nc_rx_filter_add(map, reg) == -E2BIG);
+	TEST_ASSERT(nc_rx_filter_del(map, 1000) == 0);
+	TEST_ASSERT(nc_rx_filter_add(map, reg) == 0);
+	TEST_ASSERT(helper_send_8byte(1, 2) == 8);
+	TEST_ASSERT(helper_send_8byte(0, 3) == 8);
+	int n = _recv_sids(sock, sids, 16);
+	TEST_ASSERT(n > 0);
+	for (int i = 0; i < n; i++)
+		TEST_ASSERT(sids[i] == reg);
+
+	TEST_ASSERT(nc_rx_filter_del(map, reg) == 0);
+	TEST_ASSERT(nc_rx_filter_del(map, reg) == -ENOENT);
+	TEST_ASSERT(helper_send_8byte(0, 4) == 8);
+	TEST_ASSERT(_recv_sids(sock, sids, 16) == 0);
+
+	TEST_ASSERT(nc_rx_filter_create(0, &map) == -EINVAL);
+	TEST_ASSERT(nc_rx_filter_attach(sock, -1) == -EINVAL);
+	close(prog);
+	close(map);
+	close(sock);
+}
+
+static void test_netfifo_rx_timestamp(void)
+{
+	int sock = nc_create_rx_sock("lo");
+	TEST_ASSERT(sock >= 0);
+
+	/* lo cannot stamp in hardware, expect software fallback */
+	TEST_ASSERT_FALSE(nc_enable_rx_hwts(sock, "lo"));
+
+	uint64_t reg = nc_channels[0].stream_id;
+	TEST_ASSERT(nc_set_rx_filter(sock, &reg, 1) == 0);
+	uint64_t before = real_get_ns();
+	TEST_ASSERT(helper_send_8byte(0, 5) == 8);
+
+	unsigned char buf[1514];
+	unsigned char cmsg[CMSG_SPACE(sizeof(struct scm_timestamping))];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg,
+		.msg_controllen = sizeof(cmsg),
+	};
+	TEST_ASSERT(recvmsg(sock, &msg, 0) > 0);
+
+	bool hw = true;
+	uint64_t rx_ns = nc_get_rx_ts(&msg, &hw);
+	TEST_ASSERT_FALSE(hw);
+	TEST_ASSERT(rx_ns >= before);
+	TEST_ASSERT(rx_ns <= real_get_ns());
+
+	/* No control message, no timestamp */
+	msg.msg_controllen = 0;
+	TEST_ASSERT(nc_get_rx_ts(&msg, &hw) == 0);
+	close(sock);
+}
+
+static void *_blocked_reader(void *data)
+{
+	struct channel *ch = data;
+	uint64_t val;
+	return (void *)(intptr_t)chan_read(ch, &val);
+}
+
+static void test_netfifo_stop_wakes_reader(void)
+{
+	int r = nc_rx_create("test1", nc_channels, nfc_sz);
+	TEST_ASSERT(r == 0);
+	struct channel *ch = _nh->du_rx_tail;
 
-	struct pipe_meta *pm = malloc(sizeof(struct pipe_meta) + sizeof(uint64_t));
-	int rsz = read(rxchan, pm, sizeof(*pm) + sizeof(uint64_t));
-	uint64_t *r = (uint64_t *)&pm->payload[0];
-	TEST_ASSERT(rsz == (sizeof(struct pipe_meta) + sizeof(uint64_t)));
-	TEST_ASSERT(*r == data);
+	pthread_t tid;
+	TEST_ASSERT(pthread_create(&tid, NULL, _blocked_reader, ch) == 0);
+	usleep(10000);
+	TEST_ASSERT(chan_stop(ch));
 
-	free(pm);
+	void *res;
+	pthread_join(tid, &res);
+	TEST_ASSERT((intptr_t)res == -EINVAL);
 }
 
 int main(int argc, char *argv[])
@@ -129,9 +406,17 @@ int main(int argc, char *argv[])
 	RUN_TEST(test_arr_size);
 	RUN_TEST(test_arr_idx);
 	RUN_TEST(test_arr_get_ref);
-	RUN_TEST(test_create_netfifo_rx_pipe_ok);
+	RUN_TEST(test_create_netfifo_rx_ring_ok);
 	RUN_TEST(test_create_netfifo_rx_send_ok);
 	RUN_TEST(test_create_netfifo_rx_recv);
+	RUN_TEST(test_netfifo_ring_full);
+	RUN_TEST(test_netfifo_drop_oldest);
+	RUN_TEST(test_netfifo_overwrite);
+	RUN_TEST(test_netfifo_lvchan);
+	RUN_TEST(test_netfifo_rx_filter);
+	RUN_TEST(test_netfifo_rx_filter_ebpf);
+	RUN_TEST(test_netfifo_rx_timestamp);
+	RUN_TEST(test_netfifo_stop_wakes_reader);
 
 	return UNITY_END();
 }
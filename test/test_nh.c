@@ -13,6 +13,12 @@
 #include "../src/netchan.c"
 #include "../src/netchan_standalone.c"
 #include "../src/netchan_socket.c"
+#include "../src/netchan_xdp.c"
+#include "../src/netchan_uring.c"
+#include "../src/netchan_txts.c"
+#include "../src/netchan_pacer.c"
+#include "../src/netchan_ring.c"
+#include "../src/netchan_lv.c"
 
 #define DATA17SZ 32
 #define INT17 INT_10HZ
@@ -30,8 +36,8 @@ struct nethandler *nh;
 static void *cb_data = NULL;
 static void *cb_pdu = NULL;
 
-/* PIPE callback */
-int pfd[2];
+/* ring for callback */
+struct nc_ring *ring;
 void setUp(void)
 {
 	nh = nh_create_init("lo", 16, NULL);
@@ -44,8 +50,8 @@ void setUp(void)
 	memset(data42, 0x42, DATA42SZ);
 	memset(data17, 0x17, DATA17SZ);
 
-	/* Use a pipe as fd to test callback */
-	pipe(pfd);
+	/* Use a standalone ring to test callback */
+	ring = nc_ring_create(sizeof(struct ring_meta) + sizeof(uint64_t), INT_50HZ);
 }
 
 void tearDown(void)
@@ -55,9 +61,7 @@ void tearDown(void)
 	chan_destroy(&pdu43_r);
 	nh_destroy(&nh);
 
-	/* close pipes */
-	close(pfd[0]);
-	close(pfd[1]);
+	nc_ring_destroy(&ring);
 
 	nh_destroy_standalone();
 	cb_data = NULL;
@@ -80,32 +84,95 @@ static void test_nh_hashmap(void)
 		return;
 
 	TEST_ASSERT(nh->hmap_sz == 16);
+	TEST_ASSERT(nh->hmap_mask == 7);
+	TEST_ASSERT(sizeof(struct nh_bucket) == 64);
+
+	/* The overflow count shares the line with the keys, never a match */
+	struct nh_bucket bkt = { .sid = {1, 2, 3, 4, 5, 6, 7}, .overflow = 9 };
+	TEST_ASSERT(_nh_match_bucket(&bkt, 7) == 7);
+	TEST_ASSERT(_nh_match_bucket(&bkt, 9) == 0);
+	TEST_ASSERT(((uintptr_t)nh->hmap & 63) == 0);
 	TEST_ASSERT(nh_reg_callback(NULL, 16, cb_priv_data, nh_callback) == -EINVAL);
 	TEST_ASSERT(nh_reg_callback(nh, 16, NULL, NULL) == -EINVAL);
+	TEST_ASSERT(nh_reg_callback(nh, 0, NULL, nh_callback) == -EINVAL);
 
 	TEST_ASSERT(nh_reg_callback(nh, 15, NULL, nh_callback) == 0);
 	TEST_ASSERT(nh_reg_callback(nh, 16, cb_priv_data, nh_callback) == 0);
-	TEST_ASSERT(nh->hmap[0].priv_data == cb_priv_data);
-	TEST_ASSERT(nh->hmap[0].cb == nh_callback);
-	TEST_ASSERT(get_hm_idx(NULL, 17) == -ENOMEM);
-
-	TEST_ASSERT(get_hm_idx(nh, 16) == 0);
-	TEST_ASSERT(get_hm_idx(nh, 17) == -1);
+	TEST_ASSERT(nh_reg_callback(nh, 16, cb_priv_data, nh_callback) == -EEXIST);
+	TEST_ASSERT(_nh_lookup(NULL, 17) == NULL);
+
+	struct cb_entity *ent = _nh_lookup(nh, 16);
+	TEST_ASSERT_NOT_NULL(ent);
+	TEST_ASSERT(ent->priv_data == cb_priv_data);
+	TEST_ASSERT(ent->cb == nh_callback);
+	TEST_ASSERT_NULL(_nh_lookup(nh, 17));
 	TEST_ASSERT(nh_reg_callback(nh, 17, cb_priv_data, nh_callback) == 0);
-	TEST_ASSERT(get_hm_idx(nh, 17) == 1);
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 17));
+	TEST_ASSERT(nh->hm_small && nh->hm_small->n == 3);
+
+	/* Fill to capacity, moves lookup from fastpath to the table */
+	for (uint64_t sid = 100; nh->hmap_cnt < nh->hmap_sz; sid++)
+		TEST_ASSERT(nh_reg_callback(nh, sid, cb_priv_data, nh_callback) == 0);
+	TEST_ASSERT_NULL(nh->hm_small);
+	TEST_ASSERT(nh_reg_callback(nh, 33, cb_priv_data, nh_callback) == -ENOMEM);
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 15));
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 16));
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 17));
+	TEST_ASSERT_NULL(_nh_lookup(nh, 33));
+
+	TEST_ASSERT(nh_unreg_callback(nh, 33) == -ENOENT);
+	TEST_ASSERT(nh_unreg_callback(nh, 16) == 0);
+	TEST_ASSERT_NULL(_nh_lookup(nh, 16));
 	TEST_ASSERT(nh_reg_callback(nh, 33, cb_priv_data, nh_callback) == 0);
-	TEST_ASSERT(get_hm_idx(nh, 33) == 2);
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 33));
+
+	/* Remove all but 3, back to fastpath */
+	for (uint64_t sid = 100; nh->hmap_cnt > 3; sid++)
+		TEST_ASSERT(nh_unreg_callback(nh, sid) == 0);
+	TEST_ASSERT(nh->hm_small && nh->hm_small->n == 3);
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 15));
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 17));
+	TEST_ASSERT_NOT_NULL(_nh_lookup(nh, 33));
 
 	nh_destroy(&nh);
 	free(cb_priv_data);
 }
 
+static void test_nh_hashmap_many(void)
+{
+	int cb_priv_data;
+	struct nethandler *nhl = nh_create_init("lo", 1024, NULL);
+	TEST_ASSERT_NOT_NULL(nhl);
+
+	/* Register all, then remove every other and verify that the
+	 * overflow chains are still intact.
+	 */
+	for (uint64_t i = 1; i <= 1024; i++)
+		TEST_ASSERT(nh_reg_callback(nhl, i * 0x10000, &cb_priv_data, nh_callback) == 0);
+	for (uint64_t i = 1; i <= 1024; i += 2)
+		TEST_ASSERT(nh_unreg_callback(nhl, i * 0x10000) == 0);
+	for (uint64_t i = 1; i <= 1024; i++) {
+		struct cb_entity *ent = _nh_lookup(nhl, i * 0x10000);
+		TEST_ASSERT((i & 1) ? ent == NULL : ent != NULL);
+	}
+	for (uint64_t i = 2; i <= 1024; i += 2)
+		TEST_ASSERT(nh_unreg_callback(nhl, i * 0x10000) == 0);
+
+	uint32_t overflow = 0;
+	for (uint32_t b = 0; b <= nhl->hmap_mask; b++)
+		overflow += nhl->hmap[b].overflow;
+	TEST_ASSERT(overflow == 0);
+	TEST_ASSERT(nhl->hmap_cnt == 0);
+
+	nh_destroy(&nhl);
+}
+
 static void test_nh_feed_pdu(void)
 {
-	unsigned char *cb_priv_data = malloc(32);
+	unsigned char *cb_priv_data = malloc(64);
 	if (!cb_priv_data)
 		return;
-	memset(cb_priv_data, 0xa0, 32);
+	memset(cb_priv_data, 0xa0, 64);
 
 	TEST_ASSERT(nh_feed_pdu(NULL, NULL) == -EINVAL);
 	TEST_ASSERT(nh_feed_pdu(nh, &pdu42->pdu) == -EBADFD);
@@ -123,7 +190,7 @@ static void test_nh_feed_pdu(void)
 	TEST_ASSERT(((struct avtpdu_cshdr *)cb_pdu)->stream_id == htobe64(42));
 
 	TEST_ASSERT(((unsigned char *)cb_data)[0] == 0xa0);
-	TEST_ASSERT(((unsigned char *)cb_data)[31] == 0xa0);
+	TEST_ASSERT(((unsigned char *)cb_data)[63] == 0xa0);
 
 	/* verify that calling feed_pdu will call cb with correct data */
 	TEST_ASSERT(nh_reg_callback(nh, 17, cb_priv_data, nh_callback) == 0);
@@ -138,10 +205,10 @@ static void test_nh_feed_pdu(void)
 
 static void test_create_cb(void)
 {
-	/* use pipe w to send data */
+	/* use ring to send data */
 	struct cb_priv cbp = {
 		.sz = sizeof(uint64_t),
-		.fd = pfd[1], };
+		.ring = ring, };
 
 	int (*cb)(void *priv_data, struct avtpdu_cshdr *du) = nh_std_cb;
 	TEST_ASSERT(cb(NULL, NULL) == -EINVAL);
@@ -152,6 +219,7 @@ static void test_create_cb(void)
 	 * update the cbp pointer as well.
 	 */
 	pdu43_r->cbp = &cbp;
+	pdu43_r->ring = ring;
 
 	TEST_ASSERT(nh_reg_callback(nh, 43, &cbp, cb) == 0);
 
@@ -159,29 +227,28 @@ static void test_create_cb(void)
 	TEST_ASSERT(chan_update(pdu43_r, 0, &val) == 0);
 	TEST_ASSERT(nh_feed_pdu(nh, &pdu43_r->pdu) == 0);
 
-	/* Verify that callback has written data into pipe
+	/* Verify that callback has written data into ring
 	 *
-	 * We bundle some metadata alongside the payload in the pipe (to
+	 * We bundle some metadata alongside the payload in the ring (to
 	 * feed timestamps), so it's somewhat more involved dissecting
 	 * the data.
 	 */
-	struct pipe_meta *pm = malloc(sizeof(struct pipe_meta) + sizeof(uint64_t));
-	int rdsz = read(pfd[0], pm, sizeof(*pm) + sizeof(uint64_t));
+	struct ring_meta *pm = nc_ring_acquire(ring);
+	TEST_ASSERT_NOT_NULL(pm);
 	uint64_t *res = (uint64_t *)&pm->payload[0];
-
-	TEST_ASSERT(rdsz == sizeof(*pm) + sizeof(uint64_t));
 	TEST_ASSERT(*res == 0xdeadbeef);
-	if (pm)
-		free(pm);
+	nc_ring_release(ring);
+	TEST_ASSERT_NULL(nc_ring_acquire(ring));
 	val = 1;
 
 	/* Remember to drop ref to object of automatic storage duration.. (thanks Olve!) */
 	pdu43_r->cbp = NULL;
+	pdu43_r->ring = NULL;
 }
 
 static void test_nh_add_cb_overflow(void)
 {
-	struct cb_priv cbp = { .fd = pfd[1], };
+	struct cb_priv cbp = { .ring = ring, };
 	int (*cb)(void *priv_data, struct avtpdu_cshdr *du) = nh_std_cb;
 	struct nethandler *nh_small = nh_create_init("lo", 4, NULL);
 
@@ -375,12 +442,149 @@ static void test_nh_stop(void)
 	}
 }
 
+static void test_nh_rx_placement(void)
+{
+	TEST_ASSERT(!nh_set_rx_affinity(NULL, 0));
+	TEST_ASSERT(!nh_set_rx_affinity(nh, -2));
+	TEST_ASSERT(!nh_set_rx_sched(nh, -1));
+	TEST_ASSERT(!nh_set_rx_sched(nh, 100));
+	TEST_ASSERT(!nh_set_srp_sched(nh, 0, -2));
+
+	/* Applied to the running Rx thread */
+	TEST_ASSERT(nh_set_rx_affinity(nh, 0));
+	cpu_set_t cs;
+	TEST_ASSERT(pthread_getaffinity_np(nh->tid, sizeof(cs), &cs) == 0);
+	TEST_ASSERT(CPU_COUNT(&cs) == 1);
+	TEST_ASSERT(CPU_ISSET(0, &cs));
+
+	if (nh_set_rx_sched(nh, 10)) {
+		int policy;
+		struct sched_param sp;
+		TEST_ASSERT(pthread_getschedparam(nh->tid, &policy, &sp) == 0);
+		TEST_ASSERT(policy == SCHED_FIFO);
+		TEST_ASSERT(sp.sched_priority == 10);
+		TEST_ASSERT(nh_set_rx_sched(nh, 0));
+	}
+	TEST_ASSERT(nh_set_rx_affinity(nh, -1));
+	TEST_ASSERT(pthread_getaffinity_np(nh->tid, sizeof(cs), &cs) == 0);
+	TEST_ASSERT(CPU_COUNT(&cs) >= 1);
+
+	/* ... and kept when the Rx thread is restarted */
+	TEST_ASSERT(nh_set_rx_affinity(nh, 0));
+	TEST_ASSERT(nh_set_rx_ring(nh, true));
+	TEST_ASSERT(pthread_getaffinity_np(nh->tid, sizeof(cs), &cs) == 0);
+	TEST_ASSERT(CPU_COUNT(&cs) == 1);
+
+	/* A failed restart leaves the ring disabled (invalid priority
+	 * makes pthread_create() fail)
+	 */
+	TEST_ASSERT(nh_set_rx_ring(nh, false));
+	nh->rx_sched_prio = 1000;
+	TEST_ASSERT(!nh_set_rx_ring(nh, true));
+	TEST_ASSERT(!nh->use_rx_ring);
+	nh->rx_sched_prio = 0;
+
+	/* lo is not attached to any node */
+	TEST_ASSERT(nh_get_numa_node(nh) == -1);
+	TEST_ASSERT(!nh_set_numa(nh, true));
+
+	/* Every system has node 0 */
+	struct nc_ring *ring = nc_ring_create(64, INT_50HZ);
+	TEST_ASSERT_NOT_NULL(ring);
+	TEST_ASSERT(_nh_numa_bind(ring, nc_ring_map_size(ring), 0) == 0);
+	TEST_ASSERT(_nh_numa_bind(ring, nc_ring_map_size(ring), -1) == 0);
+
+	/* Dispatch table has its own pages, binding moves nothing else */
+	TEST_ASSERT(((uintptr_t)nh->hmap & (sysconf(_SC_PAGESIZE) - 1)) == 0);
+	TEST_ASSERT((uint8_t *)nh->hm_small_buf >= (uint8_t *)nh->hmap);
+	TEST_ASSERT((uint8_t *)(nh->hm_small_buf + 2) <= (uint8_t *)nh->hmap + nh->hmap_map_sz);
+	TEST_ASSERT(_nh_numa_bind(nh->hmap, nh->hmap_map_sz, 0) == 0);
+	TEST_ASSERT(_nh_numa_bind(nh->hmap, nh->hmap_map_sz, -1) == 0);
+	nc_ring_destroy(&ring);
+
+	TEST_ASSERT(_nh_parse_cpulist("0-3,8-9,12\n", &cs));
+	TEST_ASSERT(CPU_COUNT(&cs) == 7);
+	TEST_ASSERT(CPU_ISSET(3, &cs) && CPU_ISSET(9, &cs) && CPU_ISSET(12, &cs));
+	TEST_ASSERT(!CPU_ISSET(4, &cs));
+	TEST_ASSERT(!_nh_parse_cpulist("\n", &cs));
+}
+
+static void test_nh_txtime_stats(void)
+{
+	struct chan_txtime_stats st;
+	TEST_ASSERT(chan_get_txtime_stats(NULL, &st) == -EINVAL);
+	struct channel *tx = chan_create_tx(nh, &nc_channels[MCAST42]);
+	TEST_ASSERT_NOT_NULL(tx);
+	TEST_ASSERT(chan_get_txtime_stats(tx, &st) == -EINVAL);
+
+	TEST_ASSERT(nh_enable_txtime_stats(nh));
+	TEST_ASSERT_NOT_NULL(nh->txts);
+	TEST_ASSERT(!nh->tx_timestamps);
+	TEST_ASSERT(chan_get_txtime_stats(tx, &st) == 0);
+	TEST_ASSERT(st.missed == 0 && st.invalid == 0);
+
+	/* Feed errors as ETF would report them */
+	uint64_t now = tai_get_ns();
+	uint64_t txtime = now - 5 * NS_IN_US;
+	struct sock_extended_err serr = {
+		.ee_origin = SO_EE_ORIGIN_TXTIME,
+		.ee_code = SO_EE_CODE_TXTIME_MISSED,
+		.ee_data = txtime >> 32,
+		.ee_info = txtime & 0xffffffff,
+	};
+	_txts_txtime_err(nh->txts, &serr, &tx->pdu);
+	serr.ee_code = SO_EE_CODE_TXTIME_INVALID_PARAM;
+	_txts_txtime_err(nh->txts, &serr, &tx->pdu);
+
+	/* Unknown stream, not counted */
+	_txts_txtime_err(nh->txts, &serr, NULL);
+
+	TEST_ASSERT(chan_get_txtime_stats(tx, &st) == 0);
+	TEST_ASSERT(st.missed == 1);
+	TEST_ASSERT(st.invalid == 1);
+	TEST_ASSERT(st.max_late_ns >= 5 * NS_IN_US);
+
+	/* Lateness depends on when the error is handled, only the
+	 * number of entries is known here */
+	uint64_t total = 0;
+	for (int i = 0; i < CHAN_TXTIME_HIST_BINS; i++)
+		total += st.hist[i];
+	TEST_ASSERT(total == 2);
+
+	/* 5 us late lands in [4, 8) us, way too late in the last bin */
+	struct chan_txtime_stats hs = {0};
+	_txts_account(&hs, SO_EE_CODE_TXTIME_MISSED, 5 * NS_IN_US);
+	_txts_account(&hs, SO_EE_CODE_TXTIME_INVALID_PARAM, 5 * NS_IN_US);
+	_txts_account(&hs, SO_EE_CODE_TXTIME_MISSED, NS_IN_SEC);
+	_txts_account(&hs, SO_EE_CODE_TXTIME_MISSED, 500);
+	_txts_account(&hs, 0, 500);
+	TEST_ASSERT(hs.missed == 3);
+	TEST_ASSERT(hs.invalid == 1);
+	TEST_ASSERT(hs.hist[3] == 2);
+	TEST_ASSERT(hs.hist[CHAN_TXTIME_HIST_BINS - 1] == 1);
+	TEST_ASSERT(hs.hist[0] == 1);
+	TEST_ASSERT(hs.max_late_ns == NS_IN_SEC);
+
+	/* Table grows past its initial size, entries leave with their channel */
+	for (uint64_t sid = 1000; sid < 1000 + 4 * TXTS_STREAMS; sid++)
+		TEST_ASSERT_NOT_NULL(_txts_stats(nh->txts, sid, true));
+	TEST_ASSERT(nh->txts->nr_streams == 4 * TXTS_STREAMS + 1);
+	TEST_ASSERT(_txts_stats(nh->txts, 1000, false)->missed == 0);
+	TEST_ASSERT(_txts_stats(nh->txts, tx->sidw.s64, false)->missed == 1);
+
+	uint64_t sid = tx->sidw.s64;
+	chan_destroy(&tx);
+	TEST_ASSERT_NULL(_txts_stats(nh->txts, sid, false));
+	TEST_ASSERT(nh->txts->nr_streams == 4 * TXTS_STREAMS);
+}
+
 int main(int argc, char *argv[])
 {
 	UNITY_BEGIN();
 	nc_set_nic("lo");
 
 	RUN_TEST(test_nh_hashmap);
+	RUN_TEST(test_nh_hashmap_many);
 	RUN_TEST(test_nh_feed_pdu);
 	RUN_TEST(test_create_cb);
 	RUN_TEST(test_nh_add_cb_overflow);
@@ -393,6 +597,8 @@ int main(int argc, char *argv[])
 	RUN_TEST(test_invalid_txprio);
 	RUN_TEST(test_change_class_txprio);
 	RUN_TEST(test_nh_stop);
+	RUN_TEST(test_nh_rx_placement);
+	RUN_TEST(test_nh_txtime_stats);
 
 	return UNITY_END();
 }
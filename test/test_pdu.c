@@ -8,6 +8,12 @@
  */
 #include "../src/netchan.c"
 #include "../src/netchan_socket.c"
+#include "../src/netchan_xdp.c"
+#include "../src/netchan_uring.c"
+#include "../src/netchan_txts.c"
+#include "../src/netchan_pacer.c"
+#include "../src/netchan_ring.c"
+#include "../src/netchan_lv.c"
 #include "../src/netchan_standalone.c"
 
 char data17[DATA17SZ] = {0};
@@ -202,6 +208,10 @@ static void test_create_standalone(void)
 	pdu = chan_create_standalone("test1", false, nc_channels, nfc_sz);
 	TEST_ASSERT(pdu != NULL);
 
+	/* Only one Rx channel per StreamID */
+	TEST_ASSERT(chan_create_standalone("test1", false, nc_channels, nfc_sz) == NULL);
+	chan_destroy(&pdu);
+
 	pdu = chan_create_standalone("test2", false, nc_channels, nfc_sz);
 	TEST_ASSERT(pdu != NULL);
 